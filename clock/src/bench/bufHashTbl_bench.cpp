@@ -0,0 +1,208 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ Microbenchmark of the open-addressing BufHashTbl against the chained hash
+ table it replaced. For every pool size the table is filled with one entry
+ per frame, then timed on lookups that hit, lookups that miss and the
+ remove+insert pair that allocBuf performs on every eviction.
+
+ Build with "make bench" and run ./bufhash_bench [frames...]
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include "bufHashTbl.h"
+
+using namespace badgerdb;
+
+namespace {
+
+/*
+ The chained table as it was before it was replaced: one heap allocated
+ node per entry and a hash that truncates the file pointer to an int.
+*/
+class ChainedHashTbl
+{
+ private:
+  struct node {
+    const File* file;
+    PageId pageNo;
+    FrameId frameNo;
+    node* next;
+  };
+
+  int HTSIZE;
+  node** ht;
+
+  int hash(const File* file, const PageId pageNo) const {
+    int tmp, value;
+    tmp = (long)file;
+    value = (tmp + pageNo) % HTSIZE;
+    if (value < 0)
+      value += HTSIZE;
+    return value;
+  }
+
+ public:
+  ChainedHashTbl(const int htSize) : HTSIZE(htSize) {
+    ht = new node* [htSize];
+    for (int i = 0; i < HTSIZE; i++)
+      ht[i] = NULL;
+  }
+
+  ~ChainedHashTbl() {
+    for (int i = 0; i < HTSIZE; i++) {
+      while (ht[i]) {
+        node* tmp = ht[i];
+        ht[i] = ht[i]->next;
+        delete tmp;
+      }
+    }
+    delete [] ht;
+  }
+
+  void insert(const File* file, const PageId pageNo, const FrameId frameNo) {
+    int index = hash(file, pageNo);
+    node* tmp = new node;
+    tmp->file = file;
+    tmp->pageNo = pageNo;
+    tmp->frameNo = frameNo;
+    tmp->next = ht[index];
+    ht[index] = tmp;
+  }
+
+  bool find(const File* file, const PageId pageNo, FrameId &frameNo) const {
+    node* tmp = ht[hash(file, pageNo)];
+    while (tmp) {
+      if (tmp->file == file && tmp->pageNo == pageNo) {
+        frameNo = tmp->frameNo;
+        return true;
+      }
+      tmp = tmp->next;
+    }
+    return false;
+  }
+
+  void remove(const File* file, const PageId pageNo) {
+    int index = hash(file, pageNo);
+    node* tmp = ht[index];
+    node* prev = NULL;
+    while (tmp) {
+      if (tmp->file == file && tmp->pageNo == pageNo) {
+        if (prev)
+          prev->next = tmp->next;
+        else
+          ht[index] = tmp->next;
+        delete tmp;
+        return;
+      }
+      prev = tmp;
+      tmp = tmp->next;
+    }
+  }
+};
+
+/*
+ Entries are spread over a handful of files, the same way a buffer pool
+ holds pages of several open files. The table never dereferences the file
+ pointers on these paths, so fake addresses are enough.
+*/
+const int NUM_FILES = 8;
+char fileObjects[NUM_FILES][256];
+
+const File* fileOf(std::uint64_t i) {
+  return reinterpret_cast<const File*>(fileObjects[i % NUM_FILES]);
+}
+
+PageId pageOf(std::uint64_t i) {
+  return (PageId) (i / NUM_FILES) + 1;
+}
+
+double nsPerOp(std::chrono::steady_clock::time_point start, std::uint64_t ops) {
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / ops;
+}
+
+template <class Table>
+void run(const char* name, Table& table, std::uint32_t frames) {
+  const std::uint64_t ops = 4000000;
+  std::vector<std::uint32_t> order(ops);
+  std::uint64_t seed = 88172645463325252ULL;
+  for (std::uint64_t i = 0; i < ops; i++) {
+    seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+    order[i] = (std::uint32_t) (seed % frames);
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (std::uint32_t i = 0; i < frames; i++)
+    table.insert(fileOf(i), pageOf(i), i);
+  double fill = nsPerOp(start, frames);
+
+  FrameId frame = 0;
+  std::uint64_t found = 0;
+  start = std::chrono::steady_clock::now();
+  for (std::uint64_t i = 0; i < ops; i++)
+    found += table.find(fileOf(order[i]), pageOf(order[i]), frame);
+  double hit = nsPerOp(start, ops);
+
+  start = std::chrono::steady_clock::now();
+  for (std::uint64_t i = 0; i < ops; i++)
+    found += table.find(fileOf(order[i]), pageOf(order[i]) + frames, frame);
+  double miss = nsPerOp(start, ops);
+
+  // evict a resident page and load a new one into its frame, like allocBuf followed by readPage
+  std::vector<std::uint64_t> resident(frames);
+  for (std::uint32_t i = 0; i < frames; i++)
+    resident[i] = i;
+  std::uint64_t next = frames;
+  start = std::chrono::steady_clock::now();
+  for (std::uint64_t i = 0; i < ops; i++) {
+    std::uint32_t victim = order[i];
+    table.remove(fileOf(resident[victim]), pageOf(resident[victim]));
+    resident[victim] = next++;
+    table.insert(fileOf(resident[victim]), pageOf(resident[victim]), victim);
+  }
+  double evict = nsPerOp(start, ops);
+
+  std::cout << std::setw(10) << frames << "  " << std::setw(10) << name
+            << std::fixed << std::setprecision(1)
+            << std::setw(10) << fill << std::setw(10) << hit
+            << std::setw(10) << miss << std::setw(14) << evict
+            << (found == ops ? "" : "  (lookup mismatch)") << "\n";
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  std::vector<std::uint32_t> sizes;
+  for (int i = 1; i < argc; i++)
+    sizes.push_back((std::uint32_t) std::strtoul(argv[i], NULL, 10));
+  if (sizes.empty()) {
+    sizes.push_back(10000);
+    sizes.push_back(1000000);
+    sizes.push_back(10000000);
+  }
+
+  std::cout << "    frames       table   fill ns    hit ns   miss ns  evict+load ns\n";
+  for (std::size_t i = 0; i < sizes.size(); i++) {
+    {
+      // same sizing the buffer manager used for the chained table
+      ChainedHashTbl chained(((((int) (sizes[i] * 1.2))*2)/2)+1);
+      run("chained", chained, sizes[i]);
+    }
+    {
+      BufHashTbl open(sizes[i]);
+      run("open", open, sizes[i]);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ Throughput of loading a new file through the buffer manager for every I/O
+ backend and durability mode. Pages are allocated, filled and unpinned
+ dirty, so most of them are written back when their frame is replaced; the
+ load ends with BufMgr::flushFile and File::sync, so every mode ends with
+ all pages on disk.
+
+ Build with "make bench" and run ./bulkload_bench [pages] [frames]
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include "buffer.h"
+#include "exceptions/file_not_found_exception.h"
+
+using namespace badgerdb;
+
+int main(int argc, char* argv[])
+{
+  PageId numPages = argc > 1 ? std::atoi(argv[1]) : 50000;
+  std::uint32_t numFrames = argc > 2 ? std::atoi(argv[2]) : 1000;
+  const std::string filename = "bench.db";
+  const char* backendNames[] = {"fstream", "pread"};
+  const File::IoBackend backends[] = {File::STREAM_IO, File::POSITIONAL_IO};
+  const char* modeNames[] = {"flush each write", "flush on checkpoint", "sync on request"};
+  const File::Durability modes[] = {File::FLUSH_EACH_WRITE, File::FLUSH_ON_CHECKPOINT, File::SYNC_ON_REQUEST};
+  const std::string record(200, 'x');
+
+  std::cout << "backend  durability             pages/s\n";
+  for (int b = 0; b < 2; b++) {
+    for (int m = 0; m < 3; m++) {
+      try {
+        File::remove(filename);
+      } catch (const FileNotFoundException&) {
+      }
+
+      {
+        File file = File::create(filename, backends[b]);
+        file.setDurability(modes[m]);
+        BufMgr bufMgr(numFrames);
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (PageId i = 0; i < numPages; i++) {
+          PageId pageNo;
+          Page* page;
+          bufMgr.allocPage(&file, pageNo, page);
+          while (page->hasSpaceForRecord(record))
+            page->insertRecord(record);
+          bufMgr.unPinPage(&file, pageNo, true);
+        }
+        bufMgr.flushFile(&file);
+        file.sync();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        std::cout << std::setw(7) << backendNames[b] << "  " << std::setw(20) << std::left << modeNames[m]
+                  << std::right << std::setw(10) << std::fixed << std::setprecision(0)
+                  << numPages / elapsed.count() << "\n";
+      }
+    }
+  }
+
+  File::remove(filename);
+  return 0;
+}
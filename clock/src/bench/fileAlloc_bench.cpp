@@ -0,0 +1,100 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ Cost of allocating and deleting pages as a file grows: the file is filled
+ with pages, then a delete-heavy workload deletes pages in random order and
+ allocates them again, directly on the File and through
+ BufMgr::disposePage/allocPage.
+
+ Build with "make bench" and run ./filealloc_bench [pages]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include "buffer.h"
+#include "exceptions/file_not_found_exception.h"
+
+using namespace badgerdb;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double opsPerSecond(std::size_t ops, Clock::time_point begin) {
+  std::chrono::duration<double> elapsed = Clock::now() - begin;
+  return ops / elapsed.count();
+}
+
+void report(const char* name, double throughput) {
+  std::cout << std::setw(24) << std::left << name << std::right << std::setw(12)
+            << std::fixed << std::setprecision(0) << throughput << "\n";
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  PageId numPages = argc > 1 ? std::atoi(argv[1]) : 4000;
+  const std::string filename = "bench.db";
+  std::mt19937 random(42);
+
+  try {
+    File::remove(filename);
+  } catch (const FileNotFoundException&) {
+  }
+
+  {
+    File file = File::create(filename);
+    std::vector<PageId> pages(numPages);
+
+    Clock::time_point begin = Clock::now();
+    for (PageId i = 0; i < numPages; i++)
+      pages[i] = file.allocatePage().page_number();
+    std::cout << numPages << " pages\n" << std::setw(24) << std::left << "operation"
+              << std::right << std::setw(12) << "ops/s" << "\n";
+    report("append", opsPerSecond(numPages, begin));
+
+    // delete half of the pages in random order, then allocate them again
+    std::shuffle(pages.begin(), pages.end(), random);
+    const std::size_t half = numPages / 2;
+    begin = Clock::now();
+    for (std::size_t i = 0; i < half; i++)
+      file.deletePage(pages[i]);
+    report("delete", opsPerSecond(half, begin));
+
+    begin = Clock::now();
+    for (std::size_t i = 0; i < half; i++)
+      pages[i] = file.allocatePage().page_number();
+    report("reuse", opsPerSecond(half, begin));
+
+    // the same through the buffer manager, whose pool holds all pages
+    BufMgr bufMgr(numPages + 1);
+    Page* page;
+    std::shuffle(pages.begin(), pages.end(), random);
+    begin = Clock::now();
+    for (std::size_t i = 0; i < half; i++)
+      bufMgr.disposePage(&file, pages[i]);
+    report("disposePage", opsPerSecond(half, begin));
+
+    begin = Clock::now();
+    for (std::size_t i = 0; i < half; i++) {
+      bufMgr.allocPage(&file, pages[i], page);
+      bufMgr.unPinPage(&file, pages[i], true);
+    }
+    report("allocPage", opsPerSecond(half, begin));
+    bufMgr.flushFile(&file);
+  }
+
+  File::remove(filename);
+  return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ Throughput of File::readPage and File::writePage on random pages, for the
+ fstream backend and the positional pread/pwrite backend, with an increasing
+ number of threads sharing one open file.
+
+ Build with "make bench" and run ./file_bench [max threads] [pages]
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include "file.h"
+#include "page.h"
+#include "exceptions/file_not_found_exception.h"
+
+using namespace badgerdb;
+
+namespace {
+
+const std::uint64_t OPS_PER_THREAD = 50000;
+
+double runThreads(File& file, const std::vector<Page>& pages, int numThreads, bool write) {
+  std::atomic<bool> start(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < numThreads; t++) {
+    threads.push_back(std::thread([&, t]() {
+      std::uint64_t seed = 88172645463325252ULL + t;
+      while (!start)
+        std::this_thread::yield();
+      for (std::uint64_t i = 0; i < OPS_PER_THREAD; i++) {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        const Page& page = pages[seed % pages.size()];
+        if (write)
+          file.writePage(page);
+        else
+          file.readPage(page.page_number());
+      }
+    }));
+  }
+
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+  start = true;
+  for (int t = 0; t < numThreads; t++)
+    threads[t].join();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  return numThreads * OPS_PER_THREAD / elapsed.count();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  int maxThreads = argc > 1 ? std::atoi(argv[1]) : 8;
+  PageId numPages = argc > 2 ? std::atoi(argv[2]) : 4096;
+  const std::string filename = "bench.db";
+  const char* names[] = {"fstream", "pread"};
+  const File::IoBackend backends[] = {File::STREAM_IO, File::POSITIONAL_IO};
+
+  std::cout << "backend  threads   reads/s  writes/s\n";
+  for (int b = 0; b < 2; b++) {
+    try {
+      File::remove(filename);
+    } catch (const FileNotFoundException&) {
+    }
+
+    {
+      File file = File::create(filename, backends[b]);
+      std::vector<Page> pages;
+      for (PageId i = 0; i < numPages; i++) {
+        pages.push_back(file.allocatePage());
+        pages.back().insertRecord("file bench");
+      }
+
+      for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        double reads = runThreads(file, pages, threads, false);
+        double writes = runThreads(file, pages, threads, true);
+        std::cout << std::setw(7) << names[b] << std::setw(9) << threads << std::setw(10) << std::fixed
+                  << std::setprecision(0) << reads << std::setw(10) << writes << "\n";
+      }
+    }
+  }
+
+  File::remove(filename);
+  return 0;
+}
@@ -5,8 +5,12 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <new>
 #include <iostream>
+#include <sys/mman.h>
 #include "buffer.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
@@ -16,21 +20,68 @@
 
 namespace badgerdb {
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
+BufMgr::BufMgr(std::uint32_t bufs, std::uint32_t shards, Policy policy)
+	: numBufs(bufs), policy(policy), cleanerStop(false), cleanTarget(0), prefetchStop(false), prefetchFile(NULL), readaheadEnabled(true) {
 	bufDescTable = new BufDesc[bufs];
+	frameState = new std::atomic<std::uint64_t>[bufs];
 
   for (FrameId i = 0; i < bufs; i++) {
   	bufDescTable[i].frameNo = i;
-  	bufDescTable[i].valid = false;
+  	bufDescTable[i].state = &frameState[i];
+  	bufDescTable[i].Clear();
   }
 
-  bufPool = new Page[bufs];
+  //the frames live in one anonymous mapping, which the kernel only backs with memory once a
+  //frame is used; it is rounded up to 2 MB so that it can be put on huge pages
+  const std::size_t hugePage = 2 * 1024 * 1024;
+  arenaSize = ((std::size_t) bufs * Page::SIZE + hugePage - 1) / hugePage * hugePage;
+  void* arena = mmap(NULL, arenaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (arena == MAP_FAILED)
+    throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+  madvise(arena, arenaSize, MADV_HUGEPAGE);
+#endif
+  frameArena = static_cast<char*>(arena);
 
-  int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+  //every page of the pool is a view over its frame
+  bufPool = static_cast<Page*>(::operator new(bufs * sizeof(Page)));
+  for (FrameId i = 0; i < bufs; i++)
+    new (&bufPool[i]) Page(frameArena + (std::size_t) i * Page::SIZE);
 
-  clockHand = bufs - 1;
+  //every shard needs at least one frame
+  numShards = std::max(1u, std::min(shards, bufs));
+  framesPerShard = bufs / numShards;
+  this->shards = new BufShard[numShards];
+  for (std::uint32_t s = 0; s < numShards; s++) {
+  	BufShard& shard = this->shards[s];
+  	shard.firstFrame = s * framesPerShard;
+  	shard.numBufs = (s == numShards - 1) ? bufs - shard.firstFrame : framesPerShard;
+  	shard.hashTable = new BufHashTbl (shard.numBufs);  // allocate the buffer hash table, one entry per frame
+  	shard.prefetchClaims = 0;
+  	shard.prefetchEvents = 0;
+
+  	shard.clockHand = shard.firstFrame + shard.numBufs - 1;
+  	//CLOCK-Pro starts with an empty list and half of the frames for cold pages
+  	shard.proTestTable = NULL;
+  	shard.proHandHot = shard.proHandCold = shard.proHandTest = BufDesc::INVALID_FRAME;
+  	shard.proHot = shard.proCold = shard.proTest = 0;
+  	shard.proColdTarget = std::max(1u, shard.numBufs / 2);
+  	if (policy == CLOCK_PRO) {
+  		ClockProEntry unlinked = {ClockProEntry::UNLINKED, false, NULL, Page::INVALID_NUMBER,
+  		                          BufDesc::INVALID_FRAME, BufDesc::INVALID_FRAME};
+  		shard.proEntries.assign(2 * shard.numBufs, unlinked);
+  		for (std::uint32_t e = 2 * shard.numBufs; e-- > shard.numBufs; )
+  			shard.proFreeEntries.push_back(e);
+  		shard.proTestTable = new BufHashTbl (shard.numBufs);
+  	}
+  	//every frame starts out empty, so every frame goes on the free list, the lowest frame on top
+  	shard.freeHead = BufDesc::INVALID_FRAME;
+  	shard.numFree = 0;
+  	for (FrameId i = shard.firstFrame + shard.numBufs; i-- > shard.firstFrame; )
+  		freePush(shard, i);
+  }
+  //pages of a File object which is closed are not read ahead anymore, since the prefetcher would use it after it is gone
+  closeHook = File::addCloseHook([this](const File* file) { cancelPrefetch(file); });
 }
 
 /*
@@ -38,96 +89,1098 @@ BufMgr::BufMgr(std::uint32_t bufs)
  allocated for buf description and the hashtable.
 */
 BufMgr::~BufMgr() {
+  File::removeCloseHook(closeHook);
+  stopPrefetcher();
+  stopCleaner();
+  //writes the dirty pages back file by file, sorted by page number
+  std::vector<FrameId> dirty;
   for(FrameId i =0; i<numBufs;i++){
-    if(bufDescTable[i].dirty == true)
-      bufDescTable[i].file->writePage(bufPool[i]);
+    if(frameState[i] & BufDesc::DIRTY)
+      dirty.push_back(i);
+    }
+  std::sort(dirty.begin(), dirty.end(), [this](FrameId a, FrameId b) {
+    return bufDescTable[a].file < bufDescTable[b].file;
+  });
+  std::vector<const Page*> pages;
+  for(std::size_t i = 0; i < dirty.size(); i++){
+    pages.push_back(&bufPool[dirty[i]]);
+    if(i + 1 == dirty.size() || bufDescTable[dirty[i + 1]].file != bufDescTable[dirty[i]].file){
+      bufDescTable[dirty[i]].file->writePages(pages.data(), pages.size());
+      pages.clear();
     }
-  free(bufDescTable);
-  delete[] bufPool;
-  free(hashTable);
+  }
+  delete[] bufDescTable;
+  delete[] frameState;
+  for (FrameId i = 0; i < numBufs; i++)
+    bufPool[i].~Page();
+  ::operator delete(bufPool);
+  munmap(frameArena, arenaSize);
+  for (std::uint32_t s = 0; s < numShards; s++) {
+    delete shards[s].hashTable;
+    delete shards[s].proTestTable;
+  }
+  delete[] shards;
 }
 
 /*
- Increment the clockhand within the circular buffer pool .
+ Pages are spread over the shards by a multiplicative hash of the
+ file pointer and the page number. The high bits are used, so the
+ choice of shard does not correlate with the slot the page gets
+ in the hash table of the shard.
 */
-void BufMgr::advanceClock() {
-    clockHand++;
-    clockHand=clockHand%numBufs;
+BufShard& BufMgr::pageShard(const File* file, const PageId pageNo) {
+    if(numShards==1)
+        return shards[0];
+    std::uint64_t key=(std::uint64_t)(std::uintptr_t)file ^ ((std::uint64_t)pageNo << 32 | pageNo);
+    key*=0x9E3779B97F4A7C15ULL;
+    return shards[(key >> 32) % numShards];
+}
+
+BufShard& BufMgr::frameShard(FrameId frame) {
+    return shards[std::min(frame / framesPerShard, numShards - 1)];
 }
 
 /*
- This function allocates a new frame in the buffer pool
- for the page to be read. The method used to allocate
- a new frame is the clock algorithm.
+ Links the frame at the front of the list of frames of its file
+ in the shard, starting the list if it is the first page of the
+ file there.
 */
-void BufMgr::allocBuf(FrameId & frame) {
+void BufMgr::fileLink(BufShard& shard, FrameId frame) {
+    BufDesc& desc=bufDescTable[frame];
+    std::pair<std::unordered_map<const File*, FrameId>::iterator, bool> entry=
+        shard.fileFrames.insert(std::make_pair((const File*) desc.file,frame));
 
+    desc.filePrev=BufDesc::INVALID_FRAME;
+    desc.fileNext=BufDesc::INVALID_FRAME;
+    if(!entry.second){
+        desc.fileNext=entry.first->second;
+        bufDescTable[desc.fileNext].filePrev=frame;
+        entry.first->second=frame;
+    }
+}
 
+/*
+ Takes the frame out of the list of frames of its file in
+ constant time. The list is dropped once it is empty, so the
+ shard keeps no entry for a file without pages in it.
+*/
+void BufMgr::fileUnlink(BufShard& shard, FrameId frame) {
+    BufDesc& desc=bufDescTable[frame];
 
-   std::uint32_t buffsChecked=0;
+    if(desc.filePrev!=BufDesc::INVALID_FRAME)
+        bufDescTable[desc.filePrev].fileNext=desc.fileNext;
+    else if(desc.fileNext!=BufDesc::INVALID_FRAME)
+        shard.fileFrames[desc.file]=desc.fileNext;
+    else
+        shard.fileFrames.erase(desc.file);
+    if(desc.fileNext!=BufDesc::INVALID_FRAME)
+        bufDescTable[desc.fileNext].filePrev=desc.filePrev;
+    desc.filePrev=desc.fileNext=BufDesc::INVALID_FRAME;
+}
 
+void BufMgr::residentFrames(const File* file, std::vector<FrameId>& frames) {
+    for(std::uint32_t s=0;s<numShards;s++){
+        std::shared_lock<std::shared_mutex> tableLock(shards[s].tableLatch);
+        std::unordered_map<const File*, FrameId>::const_iterator entry=shards[s].fileFrames.find(file);
+        if(entry==shards[s].fileFrames.end())
+            continue;
+        for(FrameId i=entry->second;i!=BufDesc::INVALID_FRAME;i=bufDescTable[i].fileNext)
+            frames.push_back(i);
+    }
+}
 
-   while(buffsChecked<=2*numBufs)
-   {
-        advanceClock();
-        if(bufDescTable[clockHand].valid==true)
-        {
-            if(bufDescTable[clockHand].refbit==false)
-            {
-                if(bufDescTable[clockHand].pinCnt==0)
-                {
-                    if(bufDescTable[clockHand].dirty==true){
+/*
+ Pushes the empty frame on the free list of its shard, unless
+ it is on the list already.
+*/
+void BufMgr::freePush(BufShard& shard, FrameId frame) {
+    BufDesc& desc=bufDescTable[frame];
 
-                        //writes the page to the file
+    if(desc.onFreeList)
+        return;
+    desc.freeNext=shard.freeHead;
+    shard.freeHead=frame;
+    desc.onFreeList=true;
+    shard.numFree++;
+}
 
-                        bufDescTable[clockHand].file->writePage(bufPool[clockHand]);
+/*
+ Pops frames off the free list of the shard until one can be
+ claimed. A frame on the list may have been claimed by an
+ eviction in the meantime; such entries are simply dropped.
+*/
+bool BufMgr::freePop(BufShard& shard, FrameId & frame) {
+    while(shard.freeHead!=BufDesc::INVALID_FRAME){
+        FrameId candidate=shard.freeHead;
+        BufDesc& desc=bufDescTable[candidate];
+        shard.freeHead=desc.freeNext;
+        desc.freeNext=BufDesc::INVALID_FRAME;
+        desc.onFreeList=false;
+        shard.numFree--;
 
-                        bufDescTable[clockHand].dirty=false;
+        std::uint64_t empty=0;
+        if(frameState[candidate].compare_exchange_strong(empty,1)){
+            frame=candidate;
+            return true;
+        }
+    }
+    return false;
+}
 
-                        //removes the page from the hash table and makes the returned frame equal to that one from the clockHand
-                        hashTable->remove(bufDescTable[clockHand].file,bufDescTable[clockHand].pageNo);
+/*
+ Increment the clockhand within the frames of the shard.
+*/
+void BufMgr::advanceClock(BufShard& shard) {
+    shard.clockHand++;
+    if(shard.clockHand==shard.firstFrame+shard.numBufs)
+        shard.clockHand=shard.firstFrame;
+}
 
-                        frame=bufDescTable[clockHand].frameNo;
-                        break;
+/*
+ New entries go just behind the hot hand, so it is the last hand
+ to reach them. The first entry starts the list with all three
+ hands on it.
+*/
+void BufMgr::clockProLink(BufShard& shard, std::uint32_t entry) {
+    ClockProEntry& e=shard.proEntries[entry];
+    if(shard.proHandHot==BufDesc::INVALID_FRAME){
+        e.prev=e.next=entry;
+        shard.proHandHot=shard.proHandCold=shard.proHandTest=entry;
+        return;
+    }
+    ClockProEntry& head=shard.proEntries[shard.proHandHot];
+    e.next=shard.proHandHot;
+    e.prev=head.prev;
+    shard.proEntries[head.prev].next=entry;
+    head.prev=entry;
+}
+
+void BufMgr::clockProUnlink(BufShard& shard, std::uint32_t entry) {
+    ClockProEntry& e=shard.proEntries[entry];
+    const std::uint32_t next=(e.next==entry) ? BufDesc::INVALID_FRAME : e.next;
+    if(shard.proHandHot==entry)
+        shard.proHandHot=next;
+    if(shard.proHandCold==entry)
+        shard.proHandCold=next;
+    if(shard.proHandTest==entry)
+        shard.proHandTest=next;
+    shard.proEntries[e.prev].next=e.next;
+    shard.proEntries[e.next].prev=e.prev;
+    e.prev=e.next=BufDesc::INVALID_FRAME;
+}
+
+void BufMgr::clockProDrop(BufShard& shard, FrameId frame) {
+    const std::uint32_t entry=frame-shard.firstFrame;
+    ClockProEntry& e=shard.proEntries[entry];
+    if(e.state==ClockProEntry::UNLINKED)
+        return;
+    clockProUnlink(shard,entry);
+    if(e.state==ClockProEntry::HOT)
+        shard.proHot--;
+    else
+        shard.proCold--;
+    e.state=ClockProEntry::UNLINKED;
+    e.inTest=false;
+}
+
+/*
+ A test period which ends without the page being used again
+ means cold pages got more frames than they needed.
+*/
+void BufMgr::clockProEndTest(BufShard& shard, std::uint32_t entry) {
+    ClockProEntry& e=shard.proEntries[entry];
+    if(shard.proColdTarget>1)
+        shard.proColdTarget--;
+    e.inTest=false;
+    if(e.state!=ClockProEntry::TEST)
+        return;
+    shard.proTestTable->remove(e.file,e.pageNo);
+    clockProUnlink(shard,entry);
+    e.state=ClockProEntry::UNLINKED;
+    shard.proFreeEntries.push_back(entry);
+    shard.proTest--;
+}
+
+/*
+ The hot hand turns a hot page cold unless it was used since the
+ hand last passed it. It does not overtake the test hand, which
+ ends the test periods ahead of it first.
+*/
+void BufMgr::clockProHotHand(BufShard& shard, bool force) {
+    const std::uint32_t entry=shard.proHandHot;
+    if(entry==BufDesc::INVALID_FRAME)
+        return;
+    if(entry==shard.proHandTest)
+        clockProTestHand(shard);
+    //the test hand may have dropped the entry
+    if(shard.proHandHot!=entry)
+        return;
+    ClockProEntry& e=shard.proEntries[entry];
+    shard.proHandHot=e.next;
+    if(e.state!=ClockProEntry::HOT)
+        return;
+    const FrameId frame=shard.firstFrame+entry;
+    if((frameState[frame].fetch_and(~BufDesc::REFBIT) & BufDesc::REFBIT) && !force)
+        return;
+    e.state=ClockProEntry::COLD;
+    shard.proHot--;
+    shard.proCold++;
+}
+
+void BufMgr::clockProTrimHot(BufShard& shard) {
+    //the list holds at most twice as many entries as the shard has frames
+    for(std::uint32_t steps=0;shard.proHot>shard.numBufs-shard.proColdTarget;steps++)
+        clockProHotHand(shard,steps>=2*shard.numBufs);
+}
+
+void BufMgr::clockProTestHand(BufShard& shard) {
+    const std::uint32_t entry=shard.proHandTest;
+    if(entry==BufDesc::INVALID_FRAME)
+        return;
+    ClockProEntry& e=shard.proEntries[entry];
+    shard.proHandTest=e.next;
+    if(e.inTest)
+        clockProEndTest(shard,entry);
+}
+
+/*
+ The cold hand passes hot pages and test pages. A cold page used
+ since the hand last passed it becomes hot if it is in its test
+ period, and otherwise starts a new one as the newest entry. The
+ first unpinned cold page which was not used is the victim; it
+ stays on the list until allocBuf managed to evict it.
+
+ Hot pages beyond their share are turned cold first, and while
+ no cold page can be replaced, because there is none or it is
+ pinned, the hot hand runs along with the cold one.
+ The hands only read and clear reference bits in the dense array
+ of frame states, like the clock sweep, so other threads keep
+ setting them meanwhile. If that keeps every page referenced,
+ the second half of the search ignores the bits and takes any
+ page which is not pinned; it gives up when every page is.
+*/
+bool BufMgr::clockProVictim(BufShard& shard, FrameId & frame) {
+    clockProTrimHot(shard);
+
+    for(std::uint32_t steps=0;steps<=8*shard.numBufs;steps++){
+        const bool force=steps>4*shard.numBufs;
+        if(shard.proCold==0)
+            clockProHotHand(shard,force);
+        const std::uint32_t entry=shard.proHandCold;
+        if(entry==BufDesc::INVALID_FRAME)
+            return false;
+        ClockProEntry& e=shard.proEntries[entry];
+        shard.proHandCold=e.next;
+        if(e.state!=ClockProEntry::COLD)
+            continue;
+        const FrameId candidate=shard.firstFrame+entry;
+        const std::uint64_t state=frameState[candidate];
+        if(BufDesc::pinCount(state)>0){
+            clockProHotHand(shard,force);
+            continue;
+        }
+        if(!(state & BufDesc::REFBIT) || force){
+            frame=candidate;
+            return true;
+        }
+        frameState[candidate].fetch_and(~BufDesc::REFBIT);
+        if(e.inTest){
+            e.state=ClockProEntry::HOT;
+            e.inTest=false;
+            shard.proCold--;
+            shard.proHot++;
+            clockProTrimHot(shard);
+        }else{
+            e.inTest=true;
+            clockProUnlink(shard,entry);
+            clockProLink(shard,entry);
+        }
+    }
+    return false;
+}
+
+/*
+ The empty frame goes on the free list, so it is reused before
+ any page is replaced. Under CLOCK-Pro it leaves the list without
+ becoming a test page.
+*/
+void BufMgr::frameFreed(FrameId frame) {
+    BufShard& shard=frameShard(frame);
+    std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+    if(policy==CLOCK_PRO)
+        clockProDrop(shard,frame);
+    freePush(shard,frame);
+}
+
+/*
+ A page read again while it is a test page was replaced too soon,
+ so cold pages get one more frame and the page comes back hot.
+ Any other page starts cold and in its test period, except pages
+ nobody asked for yet, which start without one. A page still
+ remembered as a test page is forgotten either way.
+*/
+void BufMgr::frameLoaded(FrameId frame, const File* file, const PageId pageNo, bool cold) {
+    if(policy!=CLOCK_PRO)
+        return;
+    BufShard& shard=frameShard(frame);
+    std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+    //a frame recycled by a strategy is still on the list for its last page
+    clockProDrop(shard,frame);
+
+    const std::uint32_t entry=frame-shard.firstFrame;
+    ClockProEntry& e=shard.proEntries[entry];
+    e.file=file;
+    e.pageNo=pageNo;
+    FrameId test;
+    bool reused=false;
+    if(shard.proTestTable->find(file,pageNo,test)){
+        ClockProEntry& t=shard.proEntries[test];
+        shard.proTestTable->remove(file,pageNo);
+        clockProUnlink(shard,test);
+        t.state=ClockProEntry::UNLINKED;
+        t.inTest=false;
+        shard.proFreeEntries.push_back(test);
+        shard.proTest--;
+        reused=!cold;
+    }
+
+    if(reused){
+        shard.bufStats.recentGhostHits++;
+        if(shard.proColdTarget<std::max(1u,shard.numBufs-1))
+            shard.proColdTarget++;
+        e.state=ClockProEntry::HOT;
+        e.inTest=false;
+        shard.proHot++;
+    }else{
+        e.state=ClockProEntry::COLD;
+        e.inTest=!cold;
+        shard.proCold++;
+    }
+    clockProLink(shard,entry);
+}
+
+/*
+ Under CLOCK-Pro a page replaced during its test period keeps its
+ place on the list as a test page; the test hand makes room first
+ if the shard already remembers one test page per frame.
+*/
+void BufMgr::frameReplaced(FrameId frame, const File* file, const PageId pageNo) {
+    if(policy!=CLOCK_PRO)
+        return;
+    BufShard& shard=frameShard(frame);
+    std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+    const std::uint32_t entry=frame-shard.firstFrame;
+    ClockProEntry& e=shard.proEntries[entry];
+    while(file!=NULL && e.inTest && shard.proTest>=shard.numBufs)
+        clockProTestHand(shard);
+    FrameId other;
+    //the page may already be back in another frame and remembered from an earlier replacement
+    if(file==NULL || !e.inTest || e.state!=ClockProEntry::COLD || shard.proTestTable->find(file,pageNo,other)){
+        clockProDrop(shard,frame);
+        return;
+    }
+
+    const std::uint32_t test=shard.proFreeEntries.back();
+    shard.proFreeEntries.pop_back();
+    ClockProEntry& t=shard.proEntries[test];
+    t.state=ClockProEntry::TEST;
+    t.inTest=true;
+    t.file=file;
+    t.pageNo=pageNo;
+    //the test page takes the place of the frame on the list, and the hands on the frame move to it
+    if(e.next==entry){
+        t.prev=t.next=test;
+    }else{
+        t.prev=e.prev;
+        t.next=e.next;
+        shard.proEntries[e.prev].next=test;
+        shard.proEntries[e.next].prev=test;
+    }
+    if(shard.proHandHot==entry)
+        shard.proHandHot=test;
+    if(shard.proHandCold==entry)
+        shard.proHandCold=test;
+    if(shard.proHandTest==entry)
+        shard.proHandTest=test;
+    e.prev=e.next=BufDesc::INVALID_FRAME;
+    e.state=ClockProEntry::UNLINKED;
+    e.inTest=false;
+    shard.proTestTable->insert(file,pageNo,test);
+    shard.proCold--;
+    shard.proTest++;
+}
+
+/*
+ The clock hand visits the frames of the shard in replacement
+ order, starting right after its current position. The CLOCK-Pro
+ cold hand visits the cold pages in that order.
+*/
+void BufMgr::nextVictims(BufShard& shard, std::uint32_t count, std::vector<FrameId>& frames) {
+    FrameId frame;
+    {
+        std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+        if(policy==CLOCK_PRO){
+            std::uint32_t entry=shard.proHandCold;
+            for(std::uint32_t n=shard.proHot+shard.proCold+shard.proTest; n>0 && count>0; n--){
+                const ClockProEntry& e=shard.proEntries[entry];
+                if(e.state==ClockProEntry::COLD){
+                    frames.push_back(shard.firstFrame+entry);
+                    count--;
+                }
+                entry=e.next;
+            }
+            return;
+        }
+        frame=shard.clockHand;
+    }
+    for(count=std::min(count,shard.numBufs); count>0; count--){
+        frame++;
+        if(frame==shard.firstFrame+shard.numBufs)
+            frame=shard.firstFrame;
+        frames.push_back(frame);
+    }
+}
+
+/*
+ This function allocates a new frame in the buffer pool
+ for the page to be read. The method used to allocate
+ a new frame is the clock algorithm, run over the frames
+ of the shard, or CLOCK-Pro if the buffer manager was given it.
+
+ The sweep only picks a victim; the victim is written back
+ and evicted after the policy latch is released, and if
+ another thread pinned it in the meantime the sweep goes on.
+ It only reads the dense array of frame states, and only runs
+ when there is no empty frame on the free list.
+*/
+void BufMgr::allocBuf(BufShard& shard, FrameId & frame) {
 
-                    }else{
-                        //if the page is not dirty it delets it from the hash table and makes the return frame equal to that one from the clockHand
-                        hashTable->remove(bufDescTable[clockHand].file,bufDescTable[clockHand].pageNo);
+    for(;;){
+        FrameId victim;
+        {
+            std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+            //an empty frame needs neither a write nor an eviction
+            if(freePop(shard,frame)){
+                return;
+            }
+            if(policy==CLOCK_PRO){
+                //the hands of CLOCK-Pro do the sweep
+                if(!clockProVictim(shard,victim)){
+                    throw BufferExceededException();
+                }
+            }else{
+                std::uint32_t buffsChecked=0;
 
-                        frame=bufDescTable[clockHand].frameNo;
+                while(buffsChecked<=2*shard.numBufs)
+                {
+                    advanceClock(shard);
+                    std::uint64_t state=frameState[shard.clockHand];
+                    if(state & BufDesc::VALID)
+                    {
+                        //if the reference bit is false and the page is not pinned the frame is the victim
+                        if(!(state & BufDesc::REFBIT))
+                        {
+                            if(BufDesc::pinCount(state)==0)
+                                break;
+                        }
+                        else{
+                            //if the reference bit is true it sets it false
+                            frameState[shard.clockHand].fetch_and(~BufDesc::REFBIT);
+                        }
+                    }
+                    //empty frames are normally on the free list; one which is not there yet is the victim,
+                    //unless another thread already claimed it
+                    else if(BufDesc::pinCount(state)==0)
+                    {
                         break;
                     }
+                    buffsChecked++;
+                }
 
-
+                //if the buffer frames checked are larger than the number of frames in the shard then
+                //throws a buffer exceeded exception
+                if(buffsChecked>2*shard.numBufs){
+                    throw BufferExceededException();
                 }
+                victim=shard.clockHand;
             }
-            else{
-             //if the reference bit is true it sets it false
-                bufDescTable[clockHand].refbit=false;
+        }
+
+        //if the page is modified it is written in the disk
+        bool written;
+        writeBack(victim,written);
+        if(written)
+            shard.bufStats.victimWrites++;
+
+        //the page is removed from the hash table and its bufDescTable position is cleared
+        const File* replacedFile;
+        PageId replacedPage;
+        if(evictFrame(victim,&replacedFile,&replacedPage)){
+            frame=victim;
+            frameReplaced(victim,replacedFile,replacedPage);
+            //lets the cleaner prepare the next victims
+            if(cleanTarget>0)
+                cleanerWake.notify_one();
+            return;
+        }
+    }
+
+}
+
+/*
+ Gives back a frame that allocBuf handed out but that did
+ not receive a page.
+*/
+void BufMgr::releaseBuf(FrameId frame) {
+    frameState[frame]=0;
+    frameFreed(frame);
+}
+
+/*
+ Frames the prefetcher claimed are only held until their pages
+ are read, so a thread which finds every frame of the shard
+ pinned waits for those before it gives up. It only gives up
+ if the prefetcher holds no frame of the shard and neither
+ claimed nor released one while allocBuf was looking.
+*/
+void BufMgr::allocBufWaiting(BufShard& shard, FrameId & frame) {
+    for(;;){
+        const std::uint64_t events=shard.prefetchEvents;
+        try{
+            allocBuf(shard,frame);
+            return;
+        }catch (BufferExceededException&){
+            if(shard.prefetchClaims==0 && shard.prefetchEvents==events)
+                throw;
+        }
+        std::this_thread::yield();
+    }
+}
+
+/*
+ Recycles the frames of the ring of the strategy in turn. A frame
+ is only taken back while it holds a page nobody but a strategy
+ used; otherwise, and until the ring is full, a frame is allocated
+ as usual and takes that place in the ring.
+*/
+void BufMgr::allocStrategyBuf(BufStrategy& strategy, BufShard& shard, FrameId & frame) {
+    //the rings are set up on first use, and again if the strategy was used with another buffer manager
+    if(strategy.owner!=this){
+        strategy.owner=this;
+        strategy.rings.assign(numShards,std::vector<FrameId>());
+        strategy.next.assign(numShards,0);
+    }
+    const std::uint32_t s=&shard-shards;
+    const std::uint32_t ringSize=std::max<std::uint32_t>(1,std::min(strategy.frames,numBufs/8)/numShards);
+    std::vector<FrameId>& ring=strategy.rings[s];
+    if(ring.size()<ringSize){
+        allocBufWaiting(shard,frame);
+        ring.push_back(frame);
+        return;
+    }
+
+    FrameId& slot=ring[strategy.next[s]];
+    strategy.next[s]=(strategy.next[s]+1)%ringSize;
+    const std::uint64_t state=frameState[slot];
+    //a page another thread used stays in the buffer pool, and so does a page modified during a bulk read
+    bool reuse=!(state & BufDesc::REFBIT) &&
+               (!(state & BufDesc::DIRTY) || strategy.type==BufStrategy::BULK_WRITE);
+    if(reuse && (state & BufDesc::DIRTY)){
+        bool written;
+        reuse=writeBack(slot,written);
+        if(written)
+            shard.bufStats.victimWrites++;
+    }
+    if(reuse && evictFrame(slot)){
+        frame=slot;
+        return;
+    }
+    allocBufWaiting(shard,frame);
+    slot=frame;
+}
+
+/*
+ Writes the page held by the frame to its file if it is dirty.
+ The frame latch is held shared while writing, so the frame
+ can not be evicted or reloaded underneath the write.
+*/
+bool BufMgr::writeBack(FrameId frame, bool & written) {
+    BufShard& shard=frameShard(frame);
+    BufDesc& desc=bufDescTable[frame];
+    File* file;
+    written=false;
+    {
+        std::shared_lock<std::shared_mutex> tableLock(shard.tableLatch);
+        std::uint64_t state=frameState[frame];
+        if(!(state & BufDesc::VALID) || !(state & BufDesc::DIRTY))
+            return true;
+        //the frame is being loaded, evicted or disposed by another thread
+        if(!desc.latch.try_lock_shared())
+            return false;
+        file=desc.file;
+    }
+
+    //the dirty bit is cleared before writing, so a modification made while
+    //the write is in progress marks the page dirty again
+    frameState[frame].fetch_and(~BufDesc::DIRTY);
+    try{
+        file->writePage(bufPool[frame]);
+    }catch (...){
+        frameState[frame].fetch_or(BufDesc::DIRTY);
+        desc.latch.unlock_shared();
+        throw;
+    }
+    shard.bufStats.diskwrites++;
+    desc.latch.unlock_shared();
+    written=true;
+    return true;
+}
+
+/*
+ Writes all dirty pages of a file back with one call to the file,
+ which sorts and coalesces them. Every frame of the file is
+ checked before anything is written; the frames written are
+ latched shared until the write is done.
+*/
+void BufMgr::writeBackFile(const File* file, std::vector<FrameId>& frames) {
+    std::vector<FrameId> latched;
+    std::vector<const Page*> pages;
+    File* target=NULL;
+    std::vector<FrameId> resident;
+    residentFrames(file,resident);
+    try{
+        for(std::size_t r=0;r<resident.size();r++)
+        {
+            const FrameId i=resident[r];
+            BufDesc& desc=bufDescTable[i];
+            std::shared_lock<std::shared_mutex> tableLock(frameShard(i).tableLatch);
+            if (desc.file!=file)
+                continue;
+            std::uint64_t state=frameState[i];
+            if (BufDesc::pinCount(state)>0){
+                throw PagePinnedException(file->filename(),desc.pageNo,desc.frameNo);
             }
-        }else{
+            if (!(state & BufDesc::VALID)){
+                throw BadBufferException(i,(state & BufDesc::DIRTY)!=0,false,(state & BufDesc::REFBIT)!=0);
+            }
+            //the frame is being loaded, evicted or disposed by another thread
+            if(!(state & BufDesc::DIRTY) || !desc.latch.try_lock_shared())
+                continue;
+            latched.push_back(i);
+            pages.push_back(&bufPool[i]);
+            target=desc.file;
+        }
 
-            //hashTable->remove(bufDescTable[clockHand].file,bufDescTable[clockHand].pageNo);
-            //bufDescTable[clockHand].Clear();
-            //if the page is not valid makes the returned frame equal to that one from the clockHand
-            frame=bufDescTable[clockHand].frameNo;
-            break;
+        //the dirty bits are cleared before writing, so a modification made while
+        //the write is in progress marks the page dirty again
+        for(std::size_t i=0;i<latched.size();i++)
+            frameState[latched[i]].fetch_and(~BufDesc::DIRTY);
+        if(target!=NULL){
+            try{
+                target->writePages(pages.data(),pages.size());
+            }catch (...){
+                for(std::size_t i=0;i<latched.size();i++)
+                    frameState[latched[i]].fetch_or(BufDesc::DIRTY);
+                throw;
+            }
+        }
+    }catch (...){
+        for(std::size_t i=0;i<latched.size();i++)
+            bufDescTable[latched[i]].latch.unlock_shared();
+        throw;
+    }
+
+    for(std::size_t i=0;i<latched.size();i++){
+        frameShard(latched[i]).bufStats.diskwrites++;
+        bufDescTable[latched[i]].latch.unlock_shared();
+    }
+    frames.insert(frames.end(),latched.begin(),latched.end());
+}
+
+/*
+ Removes the page held by the frame from the buffer pool and
+ claims the empty frame for the caller. Pins are only ever
+ taken while the page table latch is held, so holding it
+ exclusively guarantees nobody pins the page meanwhile.
+*/
+bool BufMgr::evictFrame(FrameId frame, const File** file, PageId* pageNo) {
+    BufShard& shard=frameShard(frame);
+    BufDesc& desc=bufDescTable[frame];
+    std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+
+    //a single compare-and-swap checks that the page is neither pinned nor dirty and pins it
+    std::uint64_t state=frameState[frame];
+    if((state & (BufDesc::PIN_MASK | BufDesc::DIRTY | BufDesc::IO_IN_PROGRESS)) != 0 ||
+       !frameState[frame].compare_exchange_strong(state,state+1))
+        return false;
+    //another thread is writing the page back
+    if(!desc.latch.try_lock()){
+        frameState[frame].fetch_sub(1);
+        return false;
+    }
+
+    if(file!=NULL)
+        *file=(state & BufDesc::VALID) ? desc.file : NULL;
+    if(pageNo!=NULL)
+        *pageNo=desc.pageNo;
+    if(state & BufDesc::VALID){
+        shard.hashTable->remove(desc.file,desc.pageNo);
+        fileUnlink(shard,frame);
+    }
+    if(state & BufDesc::PREFETCHED)
+        shard.bufStats.readaheadWasted++;
+    desc.Clear();
+    frameState[frame]=1;
+    desc.latch.unlock();
+    return true;
+}
+
+/*
+ Writes back the dirty pages the replacement policy would take
+ next, until enough clean frames are waiting. The frames are
+ collected under the policy latch and written after it is
+ released, like allocBuf does.
+*/
+void BufMgr::cleanShard(BufShard& shard) {
+    const std::uint32_t target=std::min(cleanTarget.load(),shard.numBufs);
+    std::uint32_t clean;
+    {
+        std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+        clean=shard.numFree;
+    }
+    if(clean>=target)
+        return;
+
+    //looks at twice as many frames as needed, so a few pinned pages in line do not hold the cleaner up
+    std::vector<FrameId> frames;
+    nextVictims(shard,std::min(shard.numBufs,2*target),frames);
+
+    for(std::size_t i=0;i<frames.size() && clean<target;i++){
+        std::uint64_t state=frameState[frames[i]];
+        //empty frames are already counted through the free list and pinned pages can not be replaced
+        if(!(state & BufDesc::VALID) || BufDesc::pinCount(state)>0)
+            continue;
+        if(state & BufDesc::DIRTY){
+            bool written;
+            try{
+                if(!writeBack(frames[i],written))
+                    continue;
+            }catch (...){
+                //the page stays dirty, whoever replaces it runs into the error again and gets the exception
+                continue;
+            }
+            if(written)
+                shard.bufStats.cleanerWrites++;
         }
-       // std::cout<<"Current buffsChecked: "<<buffsChecked<<std::endl;
-        buffsChecked++;
+        clean++;
+    }
+}
+
+void BufMgr::cleanerLoop() {
+    std::unique_lock<std::mutex> cleanerLock(cleanerLatch);
+    while(!cleanerStop){
+        cleanerLock.unlock();
+        for(std::uint32_t s=0;s<numShards;s++)
+            cleanShard(shards[s]);
+        cleanerLock.lock();
+        if(!cleanerStop)
+            cleanerWake.wait_for(cleanerLock,std::chrono::milliseconds(10));
+    }
+}
+
+void BufMgr::startCleaner(std::uint32_t target) {
+    std::lock_guard<std::mutex> cleanerLock(cleanerLatch);
+    cleanTarget=target;
+    if(!cleaner.joinable()){
+        cleanerStop=false;
+        cleaner=std::thread(&BufMgr::cleanerLoop,this);
     }
+    cleanerWake.notify_one();
+}
 
-    //if the buffer frames checked are larger than the number of frames in the buffer pool then
-    //throws a buffer exceeded exception
-    if(buffsChecked>2*numBufs){
-        throw BufferExceededException();
+void BufMgr::stopCleaner() {
+    {
+        std::lock_guard<std::mutex> cleanerLock(cleanerLatch);
+        if(!cleaner.joinable())
+            return;
+        cleanerStop=true;
+        cleanTarget=0;
     }
+    cleanerWake.notify_one();
+    cleaner.join();
+}
 
-    //clears the returned frame in the bufDescTabel so it canbe used
-    bufDescTable[clockHand].Clear();
+void BufMgr::prefetchPages(File* file, const PageId first, const std::uint32_t count) {
+    if(count==0)
+        return;
+    std::lock_guard<std::mutex> prefetchLock(prefetchLatch);
+    queuePrefetch(file,first,count);
+}
 
+void BufMgr::queuePrefetch(File* file, const PageId first, const std::uint32_t count) {
+    if(!prefetcher.joinable()){
+        prefetchStop=false;
+        prefetcher=std::thread(&BufMgr::prefetchLoop,this);
+    }
+    PrefetchRequest request={file,first,count};
+    prefetchQueue.push_back(request);
+    //flushFile() waits on the same condition variable, so everybody is woken up
+    prefetchWake.notify_all();
 }
 
+/*
+ Carries out the prefetch requests one after the other. The
+ pages of a request which are not in the buffer pool yet are
+ loaded in runs of consecutive pages, each run with one read.
+ Runs are kept short compared to the buffer pool, since all
+ frames of a run are claimed before it is read.
+*/
+void BufMgr::prefetchLoop() {
+    const std::uint32_t maxRun=std::max<std::uint32_t>(1,std::min<std::uint32_t>(File::MAX_IO_PAGES,numBufs/8));
+    std::unique_lock<std::mutex> prefetchLock(prefetchLatch);
+    for(;;){
+        while(!prefetchStop && prefetchQueue.empty())
+            prefetchWake.wait(prefetchLock);
+        if(prefetchStop)
+            return;
+        PrefetchRequest request=prefetchQueue.front();
+        prefetchQueue.pop_front();
+        prefetchFile=request.file;
+        prefetchLock.unlock();
+
+        //pages past the end of the file are not looked at
+        const std::uint64_t end=std::min<std::uint64_t>((std::uint64_t)request.first+request.count,request.file->pageLimit());
+        std::uint64_t pageNo=request.first;
+        while(pageNo<end){
+            if(isResident(request.file,pageNo)){
+                pageNo++;
+                continue;
+            }
+            std::uint32_t run=1;
+            while(pageNo+run<end && run<maxRun && !isResident(request.file,pageNo+run))
+                run++;
+            //the buffer pool is full of pinned pages, the rest of the request is dropped
+            if(!prefetchRun(request.file,pageNo,run))
+                break;
+            pageNo+=run;
+        }
+
+        prefetchLock.lock();
+        prefetchFile=NULL;
+        prefetchWake.notify_all();
+    }
+}
+
+void BufMgr::stopPrefetcher() {
+    {
+        std::lock_guard<std::mutex> prefetchLock(prefetchLatch);
+        if(!prefetcher.joinable())
+            return;
+        prefetchStop=true;
+        prefetchQueue.clear();
+    }
+    prefetchWake.notify_all();
+    prefetcher.join();
+}
+
+void BufMgr::cancelPrefetch(const File* file) {
+    std::unique_lock<std::mutex> prefetchLock(prefetchLatch);
+    for(std::deque<PrefetchRequest>::iterator it=prefetchQueue.begin();it!=prefetchQueue.end();){
+        if(it->file==file)
+            it=prefetchQueue.erase(it);
+        else
+            ++it;
+    }
+    while(prefetchFile==file)
+        prefetchWake.wait(prefetchLock);
+    readahead.erase(file);
+}
+
+/*
+ Reads ahead while a file is read sequentially. A page read from
+ disk right after the page noted last, or the page that one
+ points to, opens a window of READAHEAD_MIN pages; any other page
+ read from disk closes it again; the first page read from a file
+ has nothing before it and is not taken as sequential. Using the
+ first page of the last window for the first time reads the next
+ window, twice as large, so one window is on its way while the
+ pages before it are used. A window counts the used pages that
+ follow in the list of used pages, so pages deleted from the file
+ are neither read nor counted.
+*/
+void BufMgr::noteSequential(File* file, const PageId pageNo, const PageId nextPageNo, const bool miss) {
+    if(!readaheadEnabled)
+        return;
+    //the window is kept small enough not to push the whole buffer pool out
+    const std::uint32_t maxWindow=std::max<std::uint32_t>(1,std::min<std::uint32_t>(READAHEAD_MAX,numBufs/4));
+    std::lock_guard<std::mutex> prefetchLock(prefetchLatch);
+    ReadaheadState& state=readahead.emplace(file,ReadaheadState()).first->second;
+    //a new state has no page noted yet, page 1 does not follow it
+    const bool sequential=state.lastPage!=Page::INVALID_NUMBER &&
+                          (pageNo==state.lastPage+1 || pageNo==state.nextPage);
+    state.lastPage=pageNo;
+    state.nextPage=nextPageNo;
+
+    if(miss){
+        //random access backs off
+        if(!sequential){
+            state.window=0;
+            state.end=0;
+            return;
+        }
+        //the page was already asked for, the prefetcher just did not get to it yet
+        if(pageNo<state.end)
+            return;
+        state.window=std::min(READAHEAD_MIN,maxWindow);
+    }else{
+        if(state.window==0 || pageNo<state.trigger)
+            return;
+        state.window=std::min(2*state.window,maxWindow);
+    }
+
+    //the window holds the used pages the scan reaches by following the next page numbers, which skip deleted pages
+    const std::vector<PageId> pages=file->usedPagesAfter(std::max<PageId>(pageNo+1,state.end)-1,state.window);
+    if(pages.empty())
+        return;
+    //pages with consecutive numbers are asked for together, so that they are read together
+    std::size_t runStart=0;
+    for(std::size_t i=1;i<=pages.size();i++){
+        if(i==pages.size() || pages[i]!=pages[i-1]+1){
+            queuePrefetch(file,pages[runStart],i-runStart);
+            runStart=i;
+        }
+    }
+    state.trigger=pages.front();
+    state.end=pages.back()+1;
+}
+
+void BufMgr::setReadahead(bool enabled) {
+    std::lock_guard<std::mutex> prefetchLock(prefetchLatch);
+    readaheadEnabled=enabled;
+    //access patterns seen so far are forgotten, so a window does not pick up where it stopped
+    readahead.clear();
+}
+
+bool BufMgr::isResident(const File* file, const PageId pageNo) {
+    BufShard& shard=pageShard(file,pageNo);
+    std::shared_lock<std::shared_mutex> tableLock(shard.tableLatch);
+    FrameId frame;
+    return shard.hashTable->find(file,pageNo,frame);
+}
+
+/*
+ Claims a frame for every page of the run, publishes the pages
+ in the page table with their frame latches held exclusively,
+ like readPage does, and reads them. All frames are claimed
+ before the first one is latched, since allocBuf takes the
+ policy latch, which is never held together with a frame latch.
+*/
+bool BufMgr::prefetchRun(File* file, const PageId first, const std::uint32_t count) {
+    std::vector<FrameId> frames;
+    for(std::uint32_t i=0;i<count;i++){
+        BufShard& shard=pageShard(file,first+i);
+        FrameId frame;
+        //counted before the frame is claimed, so no thread gives up on the shard while it is being claimed
+        shard.prefetchClaims++;
+        shard.prefetchEvents++;
+        try{
+            allocBuf(shard,frame);
+        }catch (...){
+            shard.prefetchClaims--;
+            shard.prefetchEvents++;
+            break;
+        }
+        frames.push_back(frame);
+    }
+
+    //a page another thread loaded in the meantime splits the run, the pages before it are read right away
+    std::vector<FrameId> batch;
+    std::vector<FrameId> spare;
+    PageId batchFirst=first;
+    for(std::size_t i=0;i<frames.size();i++){
+        const PageId pageNo=first+i;
+        BufShard& shard=pageShard(file,pageNo);
+        BufDesc& desc=bufDescTable[frames[i]];
+        desc.latch.lock();
+        std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+        FrameId other;
+        if(shard.hashTable->find(file,pageNo,other)){
+            tableLock.unlock();
+            desc.latch.unlock();
+            spare.push_back(frames[i]);
+            if(!batch.empty())
+                loadFrames(file,batchFirst,batch);
+            batch.clear();
+            batchFirst=pageNo+1;
+            continue;
+        }
+        shard.hashTable->insert(file,pageNo,frames[i]);
+        desc.Set(file,pageNo,BufDesc::IO_IN_PROGRESS);
+        fileLink(shard,frames[i]);
+        batch.push_back(frames[i]);
+    }
+    if(!batch.empty())
+        loadFrames(file,batchFirst,batch);
+
+    for(std::size_t i=0;i<spare.size();i++){
+        releaseBuf(spare[i]);
+        frameShard(spare[i]).prefetchClaims--;
+        frameShard(spare[i]).prefetchEvents++;
+    }
+    return frames.size()==count;
+}
+
+void BufMgr::loadFrames(File* file, const PageId first, const std::vector<FrameId>& frames) {
+    std::vector<Page*> pages;
+    for(std::size_t i=0;i<frames.size();i++)
+        pages.push_back(&bufPool[frames[i]]);
+    std::vector<bool> loaded(frames.size(),true);
+    try{
+        file->readPages(first,pages.data(),pages.size());
+    }catch (...){
+        //a page which can not be read, like a deleted one, does not keep the others out
+        for(std::size_t i=0;i<frames.size();i++){
+            try{
+                file->readPages(first+i,&pages[i],1);
+            }catch (...){
+                loaded[i]=false;
+            }
+        }
+    }
+
+    for(std::size_t i=0;i<frames.size();i++){
+        const FrameId frame=frames[i];
+        BufShard& shard=frameShard(frame);
+        BufDesc& desc=bufDescTable[frame];
+        if(loaded[i]){
+            shard.bufStats.diskreads++;
+            //nobody has asked for the page yet, so it does not count as referenced
+            std::uint64_t state=frameState[frame];
+            while(!frameState[frame].compare_exchange_weak(state,
+                      (state & ~(BufDesc::IO_IN_PROGRESS | BufDesc::REFBIT)) | BufDesc::PREFETCHED)){
+            }
+        }else{
+            std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+            shard.hashTable->remove(file,first+i);
+            fileUnlink(shard,frame);
+            desc.Clear();
+        }
+        desc.latch.unlock();
+    }
+
+    //empty frames go back on the free list once none of the frames is latched any more,
+    //the pin taken by allocBuf is dropped
+    for(std::size_t i=0;i<frames.size();i++){
+        if(!loaded[i])
+            frameFreed(frames[i]);
+        else{
+            frameLoaded(frames[i],file,first+i,true);
+            frameState[frames[i]].fetch_sub(1);
+        }
+        frameShard(frames[i]).prefetchClaims--;
+        frameShard(frames[i]).prefetchEvents++;
+    }
+}
 
 /*
  This function reads a page of a file from the buffer pool
@@ -135,30 +1188,107 @@ void BufMgr::allocBuf(FrameId & frame) {
  a frame in the bufpool by calling allocBuf function and
  returns the Page.
 */
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, BufStrategy* strategy) {
 
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page) {
-    FrameId frameID;
-    // looks for the page in the hashtable, if it exists it sets the page reference bit and
-    //increases the pinCnt and also makes the variable page equals to the page thats in the
-    //specific frame in the buffer
-    try{
+	FrameId frameID;
+    BufShard& shard=pageShard(file,pageNo);
+    shard.bufStats.accesses++;
 
-        hashTable->lookup(file,pageNo,frameID);
-       // bufDescTable[frameID].refbit=true;
-        bufDescTable[frameID].pinCnt++;
-        page=&bufPool[frameID];
-    }
-    // if the page doesnt exist in the buffer pool, it reads the page from the file, allocates a frame
-    //in the buffer and sets the specif frame in the buffer pool equals to the page that read from the file
-    //also inserts the page in the hash table and sets the bufDescTable for the spesific frame
-    catch (HashNotFoundException er){
-        
+    for(;;){
+        // looks for the page in the hash table, if it exists, it
+        //increases the pin count and also makes the variable page equal to the page that's in the
+        //specific frame in the buffer
+        bool found=false;
+        std::uint64_t state=0;
+        //CLOCK-Pro counts every use of a page, except the first use of a page read ahead and uses through a strategy
+        const std::uint64_t hitRef=(policy==CLOCK_PRO && strategy==NULL) ? BufDesc::REFBIT : 0;
+        {
+            std::shared_lock<std::shared_mutex> tableLock(shard.tableLatch);
+            if(shard.hashTable->find(file,pageNo,frameID)){
+                found=true;
+                //pins the page in one step, unless another thread is still reading it from disk
+                state=frameState[frameID];
+                while(!(state & BufDesc::IO_IN_PROGRESS) &&
+                      !frameState[frameID].compare_exchange_weak(state,
+                          ((state+1) & ~BufDesc::PREFETCHED) | ((state & BufDesc::PREFETCHED) ? 0 : hitRef))){
+                }
+            }
+        }
+
+        if(found && !(state & BufDesc::IO_IN_PROGRESS)){
+            page=&bufPool[frameID];
+            //the first use of a page read ahead may read further ahead, unless it goes through a strategy,
+            //whose pages are not to be read into the rest of the buffer pool
+            if(state & BufDesc::PREFETCHED){
+                shard.bufStats.readaheadHits++;
+                if(strategy==NULL)
+                    noteSequential(file,pageNo,page->next_page_number(),false);
+            }
+            return;
+        }
+
+        //waits for the read of the page by the other thread to finish and looks again,
+        //the other thread holds the frame latch exclusively until then
+        if(found){
+            bufDescTable[frameID].latch.lock_shared();
+            bufDescTable[frameID].latch.unlock_shared();
+            continue;
+        }
+
+        // if the page doesn't exist in the buffer pool, it allocates a frame, reads the page from the file
+        //into the specific frame in the buffer pool
+        //and also inserts the page in the hash table and sets the bufDescTable for the specific frame
+        if(strategy!=NULL)
+            allocStrategyBuf(*strategy,shard,frameID);
+        else
+            allocBufWaiting(shard,frameID);
+        BufDesc& desc=bufDescTable[frameID];
+
+        //the page is published in the hash table before it is read, with the frame latch held
+        //exclusively, so that other threads missing on the same page wait for this read
+        desc.latch.lock();
+        {
+            std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+            FrameId other;
+            if(shard.hashTable->find(file,pageNo,other)){
+                //another thread loaded the page in the meantime
+                tableLock.unlock();
+                desc.latch.unlock();
+                releaseBuf(frameID);
+                continue;
+            }
+            shard.hashTable->insert(file,pageNo,frameID);
+            desc.Set(file,pageNo,BufDesc::IO_IN_PROGRESS);
+            fileLink(shard,frameID);
+        }
+
+        try{
+            //reads the page straight into the frame
+            file->readPage(pageNo,bufPool[frameID]);
+        }catch (...){
+            //the page can not be read, so it is taken out of the buffer pool again
+            {
+                std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+                shard.hashTable->remove(file,pageNo);
+                fileUnlink(shard,frameID);
+                desc.Clear();
+            }
+            desc.latch.unlock();
+            frameFreed(frameID);
+            throw;
+        }
+        shard.bufStats.diskreads++;
+        //under CLOCK-Pro loading the page is not a use yet, the test period of the page tells whether it is used again
+        const std::uint64_t done=(strategy==NULL && policy==CLOCK) ? BufDesc::IO_IN_PROGRESS : BufDesc::IO_IN_PROGRESS | BufDesc::REFBIT;
+        frameState[frameID].fetch_and(~done);
+        desc.latch.unlock();
+        frameLoaded(frameID,file,pageNo,strategy!=NULL);
 
-        allocBuf(frameID);
-        bufPool[frameID]=file->readPage(pageNo);
         page=&bufPool[frameID];
-        hashTable->insert(file,pageNo,frameID);
-        bufDescTable[frameID].Set(file,pageNo);
+        //readahead loads pages outside the ring of a strategy
+        if(strategy==NULL)
+            noteSequential(file,pageNo,page->next_page_number(),true);
+        return;
     }
 
 }
@@ -168,25 +1298,28 @@ void BufMgr::readPage(File* file, const PageId pageNo, Page*& page) {
  Checks if the page is modified, then sets the dirty bit to true.
  If the page is already unpinned throws a PageNotPinned exception.
 */
-void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) {
-    FrameId frame;
-    //looks for the given page in the hash table
-    hashTable->lookup(file,pageNo,frame);
-    //if the page is already unpinned then throws a page not pinned exception
-    if (bufDescTable[frame].pinCnt==0){
-        throw PageNotPinnedException(file->filename(),pageNo,frame);
-    }
-    //else if the page is pinned, increases the pinCnt of the page in the bufDescTable
-    //using the frame that found from the hash table and it sets the dirty bit if the given variable dirty is true
-    //if the page does not exist in the hash table it throws a hash not found exception
-    try {
-        bufDescTable[frame].pinCnt=bufDescTable[frame].pinCnt-1;
-        if(dirty==true)
-        {
-            bufDescTable[frame].dirty=true;
+void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty, BufStrategy* strategy) {
+
+	FrameId frame;
+    BufShard& shard=pageShard(file,pageNo);
+    std::uint64_t state;
+    {
+        std::shared_lock<std::shared_mutex> tableLock(shard.tableLatch);
+        //looks for the given page in the hash table
+        //if the page does not exist in the hash table it throws a HashNotFoundException
+        if(!shard.hashTable->find(file,pageNo,frame)){
+            throw HashNotFoundException(file->filename(),pageNo);
         }
-    }catch (HashNotFoundException e){
-        throw HashNotFoundException(file->filename(),pageNo);
+        //if the page is already unpinned then throws a PageNotPinned exception
+        //else if the page is pinned, decreases the pin count of the page using the frame that found in the hash table
+        //and sets the dirty bit if the given variable dirty is true, both in one step
+        const std::uint64_t dirtyBit=(dirty==true) ? BufDesc::DIRTY : 0;
+        state=frameState[frame];
+        do{
+            if (BufDesc::pinCount(state)==0){
+                throw PageNotPinnedException(file->filename(),pageNo,frame);
+            }
+        }while(!frameState[frame].compare_exchange_weak(state,(state-1) | dirtyBit));
     }
 
 }
@@ -198,89 +1331,180 @@ void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) {
  services, then throws a pagePinnedException.
  Else if the frame is not valid then throws a BadBufferException.
 */
-void BufMgr::flushFile(const File* file){
-        //for every frame in the buffer
-        for(FrameId i=0;i<numBufs;i++)
+void BufMgr::flushFile(const File* file) {
+
+        //no page of the file is loaded by the prefetcher any more once this returns
+        cancelPrefetch(file);
+
+        //writes all dirty pages of the file in one go first; the frames written are
+        //still taken out of the buffer pool below, like any other dirty frame
+        std::vector<FrameId> written;
+        writeBackFile(file,written);
+        std::sort(written.begin(),written.end());
+
+	//for every frame holding a page of the file
+        std::vector<FrameId> resident;
+        residentFrames(file,resident);
+        for(std::size_t r=0;r<resident.size();r++)
         {
-            //if the file of the page that is stored in i spot of the buffer equals to the given file
-            //and the page is dirty
-            //then writes that page to corresponding the file, removes that page from the hashtable and clears the bufDescTable that is was stored
-            if (bufDescTable[i].file==file){
+            const FrameId i=resident[r];
+            BufDesc& desc=bufDescTable[i];
+            bool wasDirty=std::binary_search(written.begin(),written.end(),i);
+            for(;;)
+            {
+                //if the file of the page that is stored in i spot of the buffer equals to the given file
+                //and the page is dirty
+                //then writes that page to the corresponding file, removes that page from the hash table
+                //and clears the spot of the bufDescTable that it was stored
+                bool dirty;
+                {
+                    std::shared_lock<std::shared_mutex> tableLock(frameShard(i).tableLatch);
+                    if (desc.file!=file)
+                        break;
+                    std::uint64_t state=frameState[i];
                     //if the page is pinned it throws a pin exception
-                if (bufDescTable[i].pinCnt>0){
-                    throw PagePinnedException(file->filename(),bufDescTable[i].pageNo,bufDescTable[i].frameNo);
-                }
-                 //if the page is not valid it throws a bad buffer exception
-                if (!bufDescTable[i].valid){
-                    throw BadBufferException(i,bufDescTable[i].dirty,bufDescTable[i].valid,bufDescTable[i].refbit);
+                    if (BufDesc::pinCount(state)>0){
+                        throw PagePinnedException(file->filename(),desc.pageNo,desc.frameNo);
+                    }
+                    //if the page is not valid it throws a bad buffer exception
+                    if (!(state & BufDesc::VALID)){
+                        throw BadBufferException(i,(state & BufDesc::DIRTY)!=0,false,(state & BufDesc::REFBIT)!=0);
+                    }
+                    dirty=(state & BufDesc::DIRTY)!=0 || wasDirty;
                 }
-                if(bufDescTable[i].dirty==true)
+
+                //writeBack() only writes the page if it was dirtied again in the meantime
+                bool rewritten;
+                if(dirty && writeBack(i,rewritten) && evictFrame(i))
                 {
-                    bufDescTable[i].file->writePage(bufPool[i]);
-                    hashTable->remove(file,bufDescTable[i].pageNo);
-                    bufDescTable[i].Clear();
+                    releaseBuf(i);
+                    break;
                 }
+
+                //waits for a write of the page by the cleaner to finish, so nothing writes to
+                //the file once this returns
+                desc.latch.lock();
+                desc.latch.unlock();
+                wasDirty=false;
+                if(!dirty)
+                    break;
             }
         }
+
+        //the header of the file is only written back on a flush
+        file->flush();
 }
 
 /*
  This function allocates a new page and reads it into the buffer pool.
 */
-void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) {
+void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page, BufStrategy* strategy) {
 
 	FrameId frameid;
-	//allocates a frame of the buffer for the page to be stored
-	//if it cant find any it throws a buffer exceeded exception
-	try{
-        allocBuf(frameid);
-	}catch (BufferExceededException e){
-        throw BufferExceededException();
-	}
-
-
-    //page=file->allocatePage();
-    //allocates the page from the file that is stored and puts it in the specific frame to the buffer pool
-	bufPool[frameid]=file->allocatePage();
 
-	//makes the variable page equals to the page that was allocated earlier from the file
-       page=&bufPool[frameid];
-    //makes the variable pageNo equals to the page number that was allocated earlier from the file
-	pageNo=page->page_number();
-
-	//inserts the page in the hash table and if it cants throws a hash not found exception
+    //the page number decides which shard the page belongs to, and the file only picks it when it allocates the page
+    if(numShards==1){
+        //with a single shard the frame is claimed first and the file builds the page right in it
+        try{
+            if(strategy!=NULL)
+                allocStrategyBuf(*strategy,shards[0],frameid);
+            else
+                allocBufWaiting(shards[0],frameid);
+        }catch (...){
+            shards[0].bufStats.accesses++;
+            throw;
+        }
+        try{
+            file->allocatePage(bufPool[frameid]);
+        }catch (...){
+            releaseBuf(frameid);
+            throw;
+        }
+        pageNo=bufPool[frameid].page_number();
+    }else{
+        //otherwise the page is built in a buffer of the thread and copied into a frame of its shard
+        static thread_local Page newPage;
+        file->allocatePage(newPage);
+        pageNo=newPage.page_number();
+        BufShard& shard=pageShard(file,pageNo);
 
-	try{
-        hashTable->insert(file,pageNo,frameid);
-	}catch (HashNotFoundException e){
-        throw HashNotFoundException(file->filename(),pageNo);
-	}
+        //if no frame is left the page is given back to the file and a buffer exceeded exception is thrown
+        try{
+            if(strategy!=NULL)
+                allocStrategyBuf(*strategy,shard,frameid);
+            else
+                allocBufWaiting(shard,frameid);
+        }catch (...){
+            shard.bufStats.accesses++;
+            file->deletePage(pageNo);
+            throw;
+        }
+        bufPool[frameid]=newPage;
+    }
+    BufShard& shard=pageShard(file,pageNo);
+	//makes the variable page equal to the page that was allocated from the file
+    page=&bufPool[frameid];
 
-	//also sets the corresponding frame in the bubDescTable with the specific file and page
+	//inserts the page in the hash table
+	//also sets the corresponding frame in the bufDescTable with the specific file and page
+    std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+    FrameId other;
+    if(shard.hashTable->find(file,pageNo,other)){
+        //readahead read the new page from disk since it was allocated in the file, so that copy is used
+        tableLock.unlock();
+        releaseBuf(frameid);
+        readPage(file,pageNo,page,strategy);
+        return;
+    }
+    shard.hashTable->insert(file,pageNo,frameid);
     bufDescTable[frameid].Set(file,pageNo);
-
+    if(strategy!=NULL || policy==CLOCK_PRO)
+        frameState[frameid].fetch_and(~BufDesc::REFBIT);
+    fileLink(shard,frameid);
+    shard.bufStats.accesses++;
+    shard.bufStats.diskreads++;
+    tableLock.unlock();
+    frameLoaded(frameid,file,pageNo,strategy!=NULL);
 }
 
 /* This function is used for disposing a page from the buffer pool
    and deleting it from the corresponding file
 */
 void BufMgr::disposePage(File* file, const PageId PageNo) {
-    FrameId frameid;
-    //it looks for the page in the hash table, if it exists it return the frame that is stored
-    //else it goes to the HashNotFoundException and then deletes the page from the file in both cases
-    try{
 
-        hashTable->lookup(file,PageNo,frameid);
-        //deletes the page from the hashtable
-        hashTable->remove(file,PageNo);
-        //it clears the frame that the deleted page was stored
-        bufDescTable[frameid].Clear();
+	FrameId frameid;
+    BufShard& shard=pageShard(file,PageNo);
+    bool present;
+    {
+        std::shared_lock<std::shared_mutex> tableLock(shard.tableLatch);
+        present=shard.hashTable->find(file,PageNo,frameid);
     }
-    catch(HashNotFoundException e){
-        //throw HashNotFoundException(file->filename(),PageNo);
+    //it looks for the page in the hash table, if it exists it removes it from the buffer pool
+    //and then deletes the page from the file in both cases
+    if(present){
+        BufDesc& desc=bufDescTable[frameid];
+        bool cleared=false;
+        {
+            //waits for any read or write of the frame to finish
+            std::unique_lock<std::shared_mutex> frameLock(desc.latch);
+            std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+            FrameId current;
+            if(shard.hashTable->find(file,PageNo,current) && current==frameid){
+                //deletes the page from the hash table
+                shard.hashTable->remove(file,PageNo);
+                fileUnlink(shard,frameid);
+                //it clears the frame that the deleted page was stored
+                desc.Clear();
+                cleared=true;
+            }
+        }
+        //and puts the empty frame on the free list so it is reused first
+        if(cleared)
+            frameFreed(frameid);
     }
     //deletes the page from the corresponding file
     file->deletePage(PageNo);
+
 }
 
 void BufMgr::printSelf(void)
@@ -294,11 +1518,50 @@ void BufMgr::printSelf(void)
 		std::cout << "FrameNo:" << i << " ";
 		tmpbuf->Print();
 
-  	if (tmpbuf->valid == true)
+  	if (frameState[i] & BufDesc::VALID)
     	validFrames++;
   }
 
 	std::cout << "Total Number of Valid Frames:" << validFrames << "\n";
 }
 
+BufStats BufMgr::getBufStats()
+{
+  BufStats total;
+  for (std::uint32_t s = 0; s < numShards; s++)
+	{
+		total.accesses += shards[s].bufStats.accesses;
+		total.diskreads += shards[s].bufStats.diskreads;
+		total.diskwrites += shards[s].bufStats.diskwrites;
+		total.victimWrites += shards[s].bufStats.victimWrites;
+		total.cleanerWrites += shards[s].bufStats.cleanerWrites;
+		total.readaheadHits += shards[s].bufStats.readaheadHits;
+		total.readaheadWasted += shards[s].bufStats.readaheadWasted;
+		total.recentGhostHits += shards[s].bufStats.recentGhostHits;
+		total.frequentGhostHits += shards[s].bufStats.frequentGhostHits;
+		if (policy == CLOCK_PRO)
+			total.adaptiveTarget += shards[s].proColdTarget;
+  }
+	return total;
+}
+
+void BufMgr::clearBufStats()
+{
+  for (std::uint32_t s = 0; s < numShards; s++)
+		shards[s].bufStats.clear();
+}
+
+void BufMgr::getFileStats(const File* file, std::uint32_t& residentPages, std::uint32_t& dirtyPages)
+{
+	std::vector<FrameId> frames;
+	residentFrames(file, frames);
+	residentPages = frames.size();
+	dirtyPages = 0;
+	for (std::size_t i = 0; i < frames.size(); i++)
+	{
+		if (frameState[frames[i]] & BufDesc::DIRTY)
+			dirtyPages++;
+	}
+}
+
 }
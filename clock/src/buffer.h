@@ -7,6 +7,15 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "file.h"
 #include "bufHashTbl.h"
 
@@ -19,19 +28,70 @@ class BufMgr;
 
 /**
 * @brief Class for maintaining information about buffer pool frames
+*
+* The state the buffer manager checks and changes on every access (pin count, valid, dirty and reference bits and
+* whether the page is being read in) is packed into one 64 bit atomic word per frame, so pinning or unpinning a page
+* is a single compare-and-swap. These words are kept in their own dense array owned by BufMgr; a BufDesc holds the
+* rest of the information about the frame and points to its state word.
 */
 class BufDesc {
 
 	friend class BufMgr;
 
+ public:
+	/**
+   * Frame number used to terminate the free list
+	 */
+  static const FrameId INVALID_FRAME = std::numeric_limits<FrameId>::max();
+
+	/**
+   * Bits of the state word holding the pin count
+	 */
+  static constexpr std::uint64_t PIN_MASK = 0xFFFFFFFFULL;
+
+	/**
+   * State bit set if the frame holds a page
+	 */
+  static constexpr std::uint64_t VALID = 1ULL << 32;
+
+	/**
+   * State bit set if the page is dirty
+	 */
+  static constexpr std::uint64_t DIRTY = 1ULL << 33;
+
+	/**
+   * State bit set if the page has been referenced recently
+	 */
+  static constexpr std::uint64_t REFBIT = 1ULL << 34;
+
+	/**
+   * State bit set while the page is read from disk into the frame. The page can not be pinned until the read is done.
+	 */
+  static constexpr std::uint64_t IO_IN_PROGRESS = 1ULL << 35;
+
+	/**
+   * State bit set if the page was loaded ahead of use by the prefetcher and has not been pinned since
+	 */
+  static constexpr std::uint64_t PREFETCHED = 1ULL << 36;
+
+	/**
+   * Pin count held in a state word
+	 */
+  static std::uint32_t pinCount(std::uint64_t state)
+  {
+		return (std::uint32_t) (state & PIN_MASK);
+  }
+
  private:
 	/**
-   * Pointer to file to which corresponding frame is assigned
+   * Pointer to file to which corresponding frame is assigned.
+   * Only changes while the buffer manager holds the page table latch exclusively.
 	 */
   File* file;
 
 	/**
-   * Page within file to which corresponding frame is assigned
+   * Page within file to which corresponding frame is assigned.
+   * Only changes while the buffer manager holds the page table latch exclusively.
 	 */
   PageId pageNo;
 
@@ -41,57 +101,65 @@ class BufDesc {
   FrameId	frameNo;
 
 	/**
-   * Number of times this page has been pinned
+   * State word of the frame: pin count, valid, dirty and reference bits and the I/O in progress flag
+	 */
+  std::atomic<std::uint64_t>* state;
+
+	/**
+   * Shared/exclusive latch of the frame. Held exclusively while the page is read from disk into the frame
+   * (so other threads asking for the same page wait for that read instead of issuing their own) and shared
+   * while the frame is written back to disk.
 	 */
-  int pinCnt;
+  std::shared_mutex latch;
 
 	/**
-   * True if page is dirty;  false otherwise
+   * Next frame in the free list of the shard, INVALID_FRAME if this is the last one or not on the list
 	 */
-  bool dirty;
+  FrameId freeNext;
 
 	/**
-   * True if page is valid
+   * True if the frame is currently on the free list
 	 */
-  bool valid;
+  bool onFreeList;
 
 	/**
-   * Has this buffer frame been reference recently
+   * Previous frame holding a page of the same file in the shard, INVALID_FRAME if this is the first one or not linked
 	 */
-  bool refbit;
+  FrameId filePrev;
+
+	/**
+   * Next frame holding a page of the same file in the shard, INVALID_FRAME if this is the last one or not linked
+	 */
+  FrameId fileNext;
 
 	/**
    * Initialize buffer frame for a new user
 	 */
   void Clear()
 	{
-    pinCnt = 0;
 		file = NULL;
 		pageNo = Page::INVALID_NUMBER;
-    dirty = false;
-    refbit = false;
-		valid = false;
+		*state = 0;
   };
 
 	/**
-	 * Set values of member variables corresponding to assignment of frame to a page in the file. Called when a frame 
+	 * Set values of member variables corresponding to assignment of frame to a page in the file. Called when a frame
 	 * in buffer pool is allocated to any page in the file through readPage() or allocPage()
 	 *
 	 * @param filePtr	File object
 	 * @param pageNum	Page number in the file
+	 * @param flags		Additional state bits to set, IO_IN_PROGRESS if the page still has to be read in
 	 */
-  void Set(File* filePtr, PageId pageNum)
-	{ 
+  void Set(File* filePtr, PageId pageNum, std::uint64_t flags = 0)
+	{
 		file = filePtr;
     pageNo = pageNum;
-    pinCnt = 1;
-    dirty = false;
-    valid = true;
-    refbit = true;
+    *state = 1 | VALID | REFBIT | flags;
   }
 
   void Print()
 	{
+		std::uint64_t current = *state;
 		if(file)
 		{
 			std::cout << "file:" << file->filename() << " ";
@@ -100,80 +168,546 @@ class BufDesc {
 		else
 			std::cout << "file:NULL ";
 
-		std::cout << "valid:" << valid << " ";
-		std::cout << "pinCnt:" << pinCnt << " ";
-		std::cout << "dirty:" << dirty << " ";
-		std::cout << "refbit:" << refbit << "\n";
+		std::cout << "valid:" << ((current & VALID) != 0) << " ";
+		std::cout << "pinCnt:" << pinCount(current) << " ";
+		std::cout << "dirty:" << ((current & DIRTY) != 0) << " ";
+		std::cout << "refbit:" << ((current & REFBIT) != 0) << "\n";
   }
 
 	/**
-   * Constructor of BufDesc class 
+   * Constructor of BufDesc class. The state word is attached by the buffer manager.
 	 */
   BufDesc()
 	{
-  	Clear();
+		file = NULL;
+		pageNo = Page::INVALID_NUMBER;
+		state = NULL;
+  	freeNext = INVALID_FRAME;
+  	onFreeList = false;
+  	filePrev = fileNext = INVALID_FRAME;
   }
 };
 
 
 /**
-* @brief Class to maintain statistics of buffer usage 
+* @brief Class to maintain statistics of buffer usage
+*
+* The counters are atomic because they are updated by every thread using the buffer manager.
 */
 struct BufStats
 {
 	/**
    * Total number of accesses to buffer pool
 	 */
-  int accesses;
+  std::atomic<int> accesses;
 
 	/**
    * Number of pages read from disk (including allocs)
 	 */
-  int diskreads;
+  std::atomic<int> diskreads;
 
 	/**
    * Number of pages written back to disk
 	 */
-  int diskwrites;
+  std::atomic<int> diskwrites;
+
+	/**
+   * Number of pages written back by a thread which needed the frame for another page (included in diskwrites)
+	 */
+  std::atomic<int> victimWrites;
+
+	/**
+   * Number of pages written back by the background cleaner (included in diskwrites)
+	 */
+  std::atomic<int> cleanerWrites;
+
+	/**
+   * Number of pages loaded ahead of use (by readahead or prefetchPages()) which were then asked for
+	 */
+  std::atomic<int> readaheadHits;
+
+	/**
+   * Number of pages loaded ahead of use which were replaced before anybody asked for them
+	 */
+  std::atomic<int> readaheadWasted;
 
 	/**
-   * Clear all values 
+   * Number of pages read again while the replacement policy remembered replacing them after a single use
+	 */
+  std::atomic<int> recentGhostHits;
+
+	/**
+   * Number of pages read again while the replacement policy remembered replacing them after repeated use
+	 */
+  std::atomic<int> frequentGhostHits;
+
+	/**
+   * Number of frames an adaptive replacement policy currently aims to give to pages used once, summed over the
+   * shards. Not a counter: filled in by BufMgr::getBufStats().
+	 */
+  std::atomic<int> adaptiveTarget;
+
+	/**
+   * Clear all values
 	 */
   void clear()
   {
-		accesses = diskreads = diskwrites = 0;
+		accesses = diskreads = diskwrites = victimWrites = cleanerWrites = readaheadHits = readaheadWasted = 0;
+		recentGhostHits = frequentGhostHits = adaptiveTarget = 0;
   }
-      
+
 	/**
-   * Constructor of BufStats class 
+   * Constructor of BufStats class
 	 */
   BufStats()
   {
 		clear();
+  }
+
+	/**
+   * Copy constructor, takes a snapshot of the other statistics
+	 */
+  BufStats(const BufStats& other)
+  {
+		*this = other;
+  }
+
+	/**
+   * Assignment operator, takes a snapshot of the other statistics
+	 */
+  BufStats& operator=(const BufStats& other)
+  {
+		accesses = other.accesses.load();
+		diskreads = other.diskreads.load();
+		diskwrites = other.diskwrites.load();
+		victimWrites = other.victimWrites.load();
+		cleanerWrites = other.cleanerWrites.load();
+		readaheadHits = other.readaheadHits.load();
+		readaheadWasted = other.readaheadWasted.load();
+		recentGhostHits = other.recentGhostHits.load();
+		frequentGhostHits = other.frequentGhostHits.load();
+		adaptiveTarget = other.adaptiveTarget.load();
+		return *this;
   }
 };
 
 
 /**
-* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+* @brief A range of pages of a file to be loaded into the buffer pool in the background, see BufMgr::prefetchPages()
 */
-class BufMgr 
+struct PrefetchRequest
+{
+	/**
+   * File the pages belong to
+	 */
+  File* file;
+
+	/**
+   * First page of the range
+	 */
+  PageId first;
+
+	/**
+   * Number of pages in the range
+	 */
+  std::uint32_t count;
+};
+
+
+/**
+* @brief Access pattern of a file seen by the buffer manager, used to decide how far to read ahead
+*/
+struct ReadaheadState
+{
+	/**
+   * Page which was last read from disk or first used after being read ahead, Page::INVALID_NUMBER before the first
+	 */
+  PageId lastPage;
+
+	/**
+   * Next page pointer of lastPage
+	 */
+  PageId nextPage;
+
+	/**
+   * Number of pages read ahead the last time, 0 after a random access
+	 */
+  std::uint32_t window;
+
+	/**
+   * Pages below this one have already been asked for
+	 */
+  PageId end;
+
+	/**
+   * First page of the last window read ahead; using it starts reading the next window
+	 */
+  PageId trigger;
+};
+
+
+/**
+* @brief Access strategy for pages which are read or written once, like in a scan or a bulk load
+*
+* Pages a thread reads or allocates through a strategy are kept in a small ring of frames which the thread recycles,
+* instead of pushing the rest of the buffer pool out. Such pages are loaded without their reference bit, so the clock
+* replaces them first. A page of the ring which another thread used in the meantime
+* stays in the buffer pool, and a new frame takes its place in the ring. Reads through a strategy do not read ahead,
+* since readahead loads its pages into the rest of the buffer pool.
+*
+* A strategy is used by one thread at a time, with one buffer manager.
+*/
+class BufStrategy {
+
+	friend class BufMgr;
+
+ public:
+	/**
+   * Kinds of access
+	 */
+  enum Type {
+    /**
+     * Pages are read once. A page modified in the meantime is not written back to reuse its frame, the frame leaves the ring.
+     */
+    BULK_READ,
+
+    /**
+     * Pages are written once. A dirty page is written back when its frame comes round again.
+     */
+    BULK_WRITE
+  };
+
+	/**
+   * Default number of frames of a BULK_READ ring
+	 */
+  static constexpr std::uint32_t BULK_READ_FRAMES = 32;
+
+	/**
+   * Default number of frames of a BULK_WRITE ring, larger so writes of dirty pages are not waited for as often
+	 */
+  static constexpr std::uint32_t BULK_WRITE_FRAMES = 128;
+
+	/**
+   * Constructor of BufStrategy class
+	 *
+	 * @param type  	Kind of access
+	 * @param frames	Number of frames of the ring, 0 for the default of the type. The buffer manager uses at most an
+	 *              	eighth of its frames, and at least one frame of every shard.
+	 */
+  BufStrategy(Type type, std::uint32_t frames = 0)
+	{
+		this->type = type;
+		this->frames = (frames != 0) ? frames : (type == BULK_READ) ? BULK_READ_FRAMES : BULK_WRITE_FRAMES;
+		owner = NULL;
+  }
+
+ private:
+	/**
+   * Kind of access
+	 */
+  Type type;
+
+	/**
+   * Number of frames of the ring asked for
+	 */
+  std::uint32_t frames;
+
+	/**
+   * Buffer manager the rings belong to, NULL before the strategy is first used
+	 */
+  const BufMgr* owner;
+
+	/**
+   * Frames of the ring in every shard, in the order they are recycled
+	 */
+  std::vector<std::vector<FrameId> > rings;
+
+	/**
+   * Position in the ring of every shard of the frame to recycle next
+	 */
+  std::vector<std::uint32_t> next;
+};
+
+
+/**
+* @brief Entry of the circular list of the CLOCK-Pro replacement policy
+*
+* The list of a shard holds its resident pages, hot or cold, and the pages which were replaced while cold and in
+* their test period (non-resident test pages). The entry of a resident page is the one of its frame; entries of
+* non-resident pages are taken from a pool of the shard.
+*/
+struct ClockProEntry
 {
+	/**
+   * State of the page of an entry
+	 */
+  enum State {
+    /**
+     * The entry is not on the list
+     */
+    UNLINKED,
+
+    /**
+     * Resident page which was used again while it was cold and in its test period
+     */
+    HOT,
+
+    /**
+     * Resident page replaced first, unless it was used again since the cold hand last passed it
+     */
+    COLD,
+
+    /**
+     * Page which was replaced while it was cold and in its test period
+     */
+    TEST
+  };
+
+	/**
+   * State of the page
+	 */
+  State state;
+
+	/**
+   * True if the page is cold and in its test period; always true for a TEST entry
+	 */
+  bool inTest;
+
+	/**
+   * File the page belongs to
+	 */
+  const File* file;
+
+	/**
+   * Page number of the page in the file
+	 */
+  PageId pageNo;
+
+	/**
+   * Previous entry of the list, BufDesc::INVALID_FRAME if the entry is not on it
+	 */
+  std::uint32_t prev;
+
+	/**
+   * Next entry of the list, the one the hands move to, BufDesc::INVALID_FRAME if the entry is not on it
+	 */
+  std::uint32_t next;
+};
+
+
+/**
+* @brief One partition of the buffer pool
+*
+* A shard owns a contiguous range of frames together with the page table, latches, clock hand and statistics of the
+* pages routed to it. Threads working on pages of different shards never share a latch.
+*/
+class BufShard {
+
+	friend class BufMgr;
+
  private:
 	/**
-   * Current position of clockhand in our buffer pool
+   * First frame of the buffer pool owned by this shard
+	 */
+  FrameId firstFrame;
+
+	/**
+   * Number of frames owned by this shard
+	 */
+  std::uint32_t numBufs;
+
+	/**
+   * Hash table mapping (File, page) to frame, for the pages of this shard
+	 */
+  BufHashTbl *hashTable;
+
+	/**
+   * Latch protecting hashTable and the file, pageNo and valid fields of the frames of this shard
+	 */
+  std::shared_mutex tableLatch;
+
+	/**
+   * First frame of the list of frames of this shard holding pages of a file, for every file with such pages.
+   * Protected by tableLatch, like hashTable.
+	 */
+  std::unordered_map<const File*, FrameId> fileFrames;
+
+	/**
+   * Latch protecting the free list, the clock hand and the reference bits, and the CLOCK-Pro list and hands
+	 */
+  std::mutex policyLatch;
+
+	/**
+   * Top of the list of empty frames, which allocBuf() hands out before replacing any page
+	 */
+  FrameId freeHead;
+
+	/**
+   * Number of frames on the free list
+	 */
+  std::uint32_t numFree;
+
+	/**
+   * Current position of clockhand in the frames of this shard
 	 */
   FrameId clockHand;
 
+	/**
+   * Entries of the CLOCK-Pro list: first one per frame of the shard, by frame number, then as many for
+   * non-resident test pages (CLOCK-Pro policy)
+	 */
+  std::vector<ClockProEntry> proEntries;
+
+	/**
+   * Entries for non-resident test pages which are not in use (CLOCK-Pro policy)
+	 */
+  std::vector<std::uint32_t> proFreeEntries;
+
+	/**
+   * Hash table mapping every non-resident test page to its entry (CLOCK-Pro policy)
+	 */
+  BufHashTbl *proTestTable;
+
+	/**
+   * Entry the hot hand looks at next; new pages are linked in just behind it. BufDesc::INVALID_FRAME while the
+   * list is empty (CLOCK-Pro policy)
+	 */
+  std::uint32_t proHandHot;
+
+	/**
+   * Entry the cold hand looks at next, for a victim (CLOCK-Pro policy)
+	 */
+  std::uint32_t proHandCold;
+
+	/**
+   * Entry the test hand looks at next, to end test periods (CLOCK-Pro policy)
+	 */
+  std::uint32_t proHandTest;
+
+	/**
+   * Number of hot pages on the list (CLOCK-Pro policy)
+	 */
+  std::uint32_t proHot;
+
+	/**
+   * Number of resident cold pages on the list (CLOCK-Pro policy)
+	 */
+  std::uint32_t proCold;
+
+	/**
+   * Number of non-resident test pages on the list, at most numBufs (CLOCK-Pro policy)
+	 */
+  std::uint32_t proTest;
+
+	/**
+   * Number of frames the CLOCK-Pro policy gives to cold pages; the hot hand runs while there are more than
+   * numBufs - proColdTarget hot pages. Grows when a test page is read again, shrinks when a test period ends
+   * without reuse. Read without the policy latch by BufMgr::getBufStats().
+	 */
+  std::atomic<std::uint32_t> proColdTarget;
+
+	/**
+   * Number of frames of this shard the prefetcher has claimed, or is claiming, for pages it has not read yet
+	 */
+  std::atomic<std::uint32_t> prefetchClaims;
+
+	/**
+   * Number of times the prefetcher started claiming or released a frame of this shard
+	 */
+  std::atomic<std::uint64_t> prefetchEvents;
+
+	/**
+   * Buffer pool usage statistics of this shard
+	 */
+  BufStats bufStats;
+};
+
+
+/**
+* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file
+*
+* All public methods may be called concurrently from several threads. The page table is protected by its own
+* shared/exclusive latch, so lookups of resident pages run in parallel, and every frame has its own latch and an atomic
+* pin count, so pinned pages can be used by several threads at once. When several threads miss on the same page, only
+* the first one reads it from disk; the others wait on the frame latch for that read to finish.
+*
+* A frame latch may be waited for before the page table latch is taken, never while it is held (then it is only
+* tried). The replacement policy latch is never held together with any other latch.
+*
+* The pool may be split into several shards (see BufShard). Every page is routed to one shard by a hash of
+* (file, page number) and is only ever cached in a frame of that shard, so a shard can run out of frames while
+* others still have some.
+*
+* An optional background cleaner (see startCleaner()) writes back dirty pages before they are chosen for
+* replacement, so that a thread missing on a page rarely has to write another page first.
+*
+* Pages can also be loaded ahead of use by a background prefetcher (see prefetchPages()). It publishes the pages
+* it reads in the page table like readPage() does, so a thread asking for such a page waits for that read instead
+* of issuing its own. readPage() hands sequential access to a file to the prefetcher on its own: once it sees pages
+* read in order (by page number or by following next page pointers) it reads ahead in windows which double from
+* READAHEAD_MIN up to READAHEAD_MAX pages while the access stays sequential, and stops at the first random access.
+*
+* Scans and bulk loads can pass a BufStrategy to readPage(), allocPage() and unPinPage(), so that the pages they go
+* through once do not replace the pages other threads keep using.
+*/
+class BufMgr 
+{
+ public:
+	/**
+   * Replacement policies the buffer manager can use
+	 */
+  enum Policy {
+    /**
+     * Replaces the first unpinned page the clock hand finds with its reference bit cleared.
+     */
+    CLOCK,
+
+    /**
+     * CLOCK-Pro: pages are hot or cold, and a cold page is in a test period for a while after it was loaded or
+     * used. A cold page used again during its test period becomes hot, and cold pages replaced during their test
+     * period stay on the list as non-resident test pages. Three hands go round the list: the cold hand looks for
+     * the victim, the hot hand turns hot pages which were not used since it last passed them cold, and the test
+     * hand ends test periods. The number of frames given to cold pages grows when a test page is read again and
+     * shrinks when a test period ends without reuse. Hits only set the reference bit of the frame, like CLOCK.
+     */
+    CLOCK_PRO
+  };
+
+	/**
+   * Number of pages read ahead once sequential access to a file is detected
+	 */
+  static constexpr std::uint32_t READAHEAD_MIN = 4;
+
+	/**
+   * Largest number of pages read ahead at once, the window stops doubling there
+	 */
+  static constexpr std::uint32_t READAHEAD_MAX = 256;
+
+ private:
 	/**
    * Number of frames in the buffer pool
 	 */
   std::uint32_t numBufs;
-	
+
 	/**
-   * Hash table mapping (File, page) to frame
+   * Number of shards the buffer pool is split into
 	 */
-  BufHashTbl *hashTable;
+  std::uint32_t numShards;
+
+	/**
+   * Replacement policy
+	 */
+  Policy policy;
+
+	/**
+   * Number of frames of every shard except the last one, which also takes the remainder
+	 */
+  std::uint32_t framesPerShard;
+
+	/**
+   * Array of the shards of the buffer pool
+	 */
+  BufShard *shards;
 
 	/**
    * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
@@ -181,34 +715,432 @@ class BufMgr
   BufDesc *bufDescTable;
 
 	/**
-   * Maintains Buffer pool usage statistics 
+   * Dense array of the state words of all frames, see BufDesc
 	 */
-  BufStats bufStats;
+  std::atomic<std::uint64_t> *frameState;
+
+	/**
+   * Memory of all frames: one contiguous, page aligned block in which frame i
+   * takes the Page::SIZE bytes at offset i * Page::SIZE
+	 */
+  char* frameArena;
 
 	/**
-   * Advance clock to next frame in the buffer pool
+   * Size of frameArena in bytes, rounded up to a whole number of huge pages
 	 */
-  void advanceClock();
+  std::size_t arenaSize;
 
 	/**
-	 * Allocate a free frame.  
+   * Shard which caches the given page.
 	 *
-	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			The shard.
+	 */
+  BufShard& pageShard(const File* file, const PageId pageNo);
+
+	/**
+   * Shard which owns the given frame.
+	 *
+	 * @param frame   	Frame number
+	 * @return  			The shard.
+	 */
+  BufShard& frameShard(FrameId frame);
+
+	/**
+   * Link a frame which was just assigned a page into the list of frames of its file.
+   * The page table latch of the shard must be held exclusively.
+	 *
+	 * @param shard   	Shard owning the frame
+	 * @param frame   	Frame to link
+	 */
+  void fileLink(BufShard& shard, FrameId frame);
+
+	/**
+   * Unlink a frame from the list of frames of its file, before its page is taken out of the buffer pool.
+   * The page table latch of the shard must be held exclusively.
+	 *
+	 * @param shard   	Shard owning the frame
+	 * @param frame   	Frame to unlink, must currently be in the list
+	 */
+  void fileUnlink(BufShard& shard, FrameId frame);
+
+	/**
+   * Collect the frames holding pages of the file, shard by shard. Takes time proportional to the number of
+   * shards and of pages of the file in the buffer pool, not to the size of the pool.
+	 *
+	 * @param file   	File object
+	 * @param frames  	Vector the frames are appended to
+	 */
+  void residentFrames(const File* file, std::vector<FrameId>& frames);
+
+	/**
+   * Put an empty frame on the free list of its shard. The policy latch of the shard must be held.
+	 *
+	 * @param shard   	Shard owning the frame
+	 * @param frame   	Frame to put on the list
+	 */
+  void freePush(BufShard& shard, FrameId frame);
+
+	/**
+   * Take an empty frame off the free list of the shard and claim it. The policy latch of the shard must be held.
+	 *
+	 * @param shard   	Shard to take the frame from
+	 * @param frame   	Frame reference, the claimed frame is returned via this variable. It holds one pin for the caller.
+	 * @return  			False if the free list is empty.
+	 */
+  bool freePop(BufShard& shard, FrameId & frame);
+
+	/**
+   * Advance clock to next frame of the shard
+	 *
+	 * @param shard   	Shard whose clock hand is advanced
+	 */
+  void advanceClock(BufShard& shard);
+
+	/**
+   * Link an entry into the CLOCK-Pro list of the shard, as the newest one. The policy latch of the shard must be held.
+	 *
+	 * @param shard   	Shard owning the entry
+	 * @param entry   	Entry to link, must not be on the list
+	 */
+  void clockProLink(BufShard& shard, std::uint32_t entry);
+
+	/**
+   * Take an entry off the CLOCK-Pro list of the shard, moving the hands pointing at it on to the next entry.
+   * The counts of the list are not changed. The policy latch of the shard must be held.
+	 *
+	 * @param shard   	Shard owning the entry
+	 * @param entry   	Entry to unlink, must be on the list
+	 */
+  void clockProUnlink(BufShard& shard, std::uint32_t entry);
+
+	/**
+   * Take the entry of a frame off the CLOCK-Pro list, if it is on it, and update the counts of the list.
+   * The policy latch of the shard must be held.
+	 *
+	 * @param shard   	Shard owning the frame
+	 * @param frame   	Frame whose entry is dropped
+	 */
+  void clockProDrop(BufShard& shard, FrameId frame);
+
+	/**
+   * End the test period of a cold page, dropping the entry if the page is not resident, and give one frame less
+   * to cold pages. The policy latch of the shard must be held.
+	 *
+	 * @param shard   	Shard owning the entry
+	 * @param entry   	Entry of a cold page in its test period
+	 */
+  void clockProEndTest(BufShard& shard, std::uint32_t entry);
+
+	/**
+   * Move the hot hand one entry on. The policy latch of the shard must be held.
+	 *
+	 * @param shard   	Shard whose hand moves
+	 * @param force   	True to turn the hot page cold even if it was used since the hand last passed it
+	 */
+  void clockProHotHand(BufShard& shard, bool force = false);
+
+	/**
+   * Run the hot hand until no more pages are hot than the cold target leaves room for. After a full turn of the list
+   * it turns hot pages cold even if they were used, since other threads may keep setting their reference bits. The
+   * policy latch of the shard must be held.
+	 *
+	 * @param shard   	Shard whose hand moves
+	 */
+  void clockProTrimHot(BufShard& shard);
+
+	/**
+   * Move the test hand one entry on. The policy latch of the shard must be held.
+	 *
+	 * @param shard   	Shard whose hand moves
+	 */
+  void clockProTestHand(BufShard& shard);
+
+	/**
+   * Move the cold hand on to the next resident cold page which may be replaced. The policy latch of the shard
+   * must be held.
+	 *
+	 * @param shard   	Shard to look at
+	 * @param frame   	Frame reference, the frame of the page is returned via this variable. It may be dirty.
+	 * @return  			False if no such page was found.
+	 */
+  bool clockProVictim(BufShard& shard, FrameId & frame);
+
+	/**
+   * Tell the replacement policy which page a frame was given. Called before the frame is unpinned for the first time.
+	 *
+	 * @param frame   	Frame which got the page
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param cold   	True if the page was read ahead or used through a strategy, so it is not known to be used
+	 */
+  void frameLoaded(FrameId frame, const File* file, const PageId pageNo, bool cold = false);
+
+	/**
+   * Tell the replacement policy that allocBuf() replaced the page in a frame.
+	 *
+	 * @param frame   	Frame which was taken
+	 * @param file   	File of the page replaced, NULL if the frame was empty
+	 * @param pageNo  Page number of the page replaced
+	 */
+  void frameReplaced(FrameId frame, const File* file, const PageId pageNo);
+
+	/**
+   * Tell the replacement policy that a frame no longer holds a page, and put it on the free list.
+	 *
+	 * @param frame   	Frame which became empty
+	 */
+  void frameFreed(FrameId frame);
+
+	/**
+   * Collect the frames of the shard in the order the replacement policy would consider them for replacement.
+	 * Frames may be pinned, dirty or empty.
+	 *
+	 * @param shard   	Shard to look at
+	 * @param count   	Maximum number of frames to collect
+	 * @param frames  	Vector the frames are appended to
+	 */
+  void nextVictims(BufShard& shard, std::uint32_t count, std::vector<FrameId>& frames);
+
+	/**
+	 * Allocate a free frame of the given shard.
+	 *
+	 * @param shard   	Shard to take the frame from
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable.
+	 *                  The frame is empty, not in the page table and holds one pin for the caller.
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  void allocBuf(BufShard& shard, FrameId & frame);
+
+	/**
+	 * Allocate a free frame of the given shard like allocBuf(), but if every frame is pinned and some of them only
+	 * by the prefetcher, wait for those to be released instead of giving up.
+	 *
+	 * @param shard   	Shard to take the frame from
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable.
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
 	 */
-  void allocBuf(FrameId & frame);
+  void allocBufWaiting(BufShard& shard, FrameId & frame);
+
+	/**
+	 * Allocate a frame of the given shard for a page read or allocated through a strategy, recycling a frame of its
+	 * ring if possible.
+	 *
+	 * @param strategy	Strategy the page is used through
+	 * @param shard   	Shard to take the frame from
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable.
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  void allocStrategyBuf(BufStrategy& strategy, BufShard& shard, FrameId & frame);
+
+	/**
+	 * Give a frame handed out by allocBuf() back to the buffer pool, when the page meant for it could not be loaded.
+	 *
+	 * @param frame   	Frame to release
+	 */
+  void releaseBuf(FrameId frame);
+
+	/**
+	 * Write the page in the frame back to its file if it is dirty.
+	 *
+	 * @param frame   	Frame to write
+	 * @param written 	Set to true if the page was written, false if it was clean
+	 * @return  			False if the frame is being loaded or evicted by another thread and was skipped, true otherwise.
+	 */
+  bool writeBack(FrameId frame, bool & written);
+
+	/**
+	 * Write all dirty pages of the file back at once, in the order of their page numbers, so that pages which
+	 * are next to each other on disk are written with a single call. Frames which are being loaded or evicted by
+	 * another thread are skipped.
+	 *
+	 * @param file   	File whose pages are written
+	 * @param frames 	Frames whose pages were written are appended to this vector
+   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool, nothing is written then
+   * @throws BadBufferException If any frame allocated to the file is found to be invalid, nothing is written then
+	 */
+  void writeBackFile(const File* file, std::vector<FrameId>& frames);
+
+	/**
+	 * Remove the page in the frame from the buffer pool and claim the frame for the caller, provided the page is
+	 * neither pinned nor dirty and no other thread is doing I/O on the frame.
+	 *
+	 * @param frame   	Frame to evict
+	 * @param file   	If not NULL, the file of the page evicted is returned via this pointer, NULL if the frame was empty
+	 * @param pageNo  If not NULL, the page number of the page evicted is returned via this pointer
+	 * @return  			True if the frame was claimed (it is then empty and holds one pin), false otherwise.
+	 */
+  bool evictFrame(FrameId frame, const File** file = NULL, PageId* pageNo = NULL);
+
+	/**
+	 * Background cleaner thread, only running between startCleaner() and stopCleaner()
+	 */
+  std::thread cleaner;
+
+	/**
+	 * Latch protecting cleanerStop, also used to wait on cleanerWake
+	 */
+  std::mutex cleanerLatch;
+
+	/**
+	 * Wakes the cleaner up before its interval is over, when a frame was taken by a replacement
+	 */
+  std::condition_variable cleanerWake;
+
+	/**
+	 * Set to tell the cleaner to exit
+	 */
+  bool cleanerStop;
+
+	/**
+	 * Number of clean frames the cleaner tries to keep ready for replacement in every shard, 0 if it is not running
+	 */
+  std::atomic<std::uint32_t> cleanTarget;
+
+	/**
+	 * Main loop of the background cleaner.
+	 */
+  void cleanerLoop();
+
+	/**
+	 * Write back dirty unpinned pages of the shard which are next in line for replacement, until the shard has
+	 * cleanTarget clean frames ready for replacement or no more candidates are found.
+	 *
+	 * @param shard   	Shard to clean
+	 */
+  void cleanShard(BufShard& shard);
+
+	/**
+	 * Background prefetcher thread, started by the first call of prefetchPages()
+	 */
+  std::thread prefetcher;
+
+	/**
+	 * Latch protecting prefetchQueue, prefetchStop, prefetchFile and readahead, also used to wait on prefetchWake
+	 */
+  std::mutex prefetchLatch;
+
+	/**
+	 * Wakes the prefetcher up when a request was queued, and flushFile() when the prefetcher finished a request
+	 */
+  std::condition_variable prefetchWake;
+
+	/**
+	 * Ranges of pages waiting to be prefetched, oldest first
+	 */
+  std::deque<PrefetchRequest> prefetchQueue;
+
+	/**
+	 * Set to tell the prefetcher to exit
+	 */
+  bool prefetchStop;
+
+	/**
+	 * File of the request the prefetcher is working on, NULL if it is idle
+	 */
+  const File* prefetchFile;
+
+	/**
+	 * Access pattern of every file read through readPage() since it was last flushed
+	 */
+  std::unordered_map<const File*, ReadaheadState> readahead;
+
+	/**
+	 * Whether readPage() reads ahead, see setReadahead()
+	 */
+  std::atomic<bool> readaheadEnabled;
+
+	/**
+	 * Handle of the File close hook which drops the prefetch requests of closed files
+	 */
+  int closeHook;
+
+	/**
+	 * Queue a prefetch request, starting the prefetcher if it is not running yet. The prefetch latch must be held.
+	 *
+	 * @param file   	File object
+	 * @param first  	First page to load
+	 * @param count  	Number of pages to load
+	 */
+  void queuePrefetch(File* file, const PageId first, const std::uint32_t count);
+
+	/**
+	 * Note a page read from disk or used for the first time after being read ahead, and read further ahead if the
+	 * file is being read sequentially.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param nextPageNo	Next page pointer of the page
+	 * @param miss   	True if the page had to be read from disk, false if it had been read ahead
+	 */
+  void noteSequential(File* file, const PageId pageNo, const PageId nextPageNo, const bool miss);
+
+	/**
+	 * Main loop of the background prefetcher.
+	 */
+  void prefetchLoop();
+
+	/**
+	 * Stop the background prefetcher and wait for it to exit. Requests still queued are dropped.
+	 */
+  void stopPrefetcher();
+
+	/**
+	 * Drop the queued prefetch requests for the file and wait until the prefetcher is no longer reading its pages.
+	 * Called by flushFile() and, through a File close hook, whenever a File object is closed.
+	 *
+	 * @param file   	File object
+	 */
+  void cancelPrefetch(const File* file);
+
+	/**
+	 * Check whether the page is in the buffer pool.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			True if the page is in the page table, also if it is still being read in.
+	 */
+  bool isResident(const File* file, const PageId pageNo);
+
+	/**
+	 * Load consecutive pages, none of which was in the buffer pool when they were looked up, into unpinned frames.
+	 * Pages loaded by another thread in the meantime are skipped.
+	 *
+	 * @param file   	File object
+	 * @param first  	First page to load
+	 * @param count  	Number of pages to load, at most File::MAX_IO_PAGES
+	 * @return  			False if not enough frames could be claimed for all the pages.
+	 */
+  bool prefetchRun(File* file, const PageId first, const std::uint32_t count);
+
+	/**
+	 * Read consecutive pages into frames which were published in the page table with IO_IN_PROGRESS set and
+	 * are latched exclusively, then make them available unpinned. Pages which can not be read are taken out of the
+	 * buffer pool again.
+	 *
+	 * @param file   	File object
+	 * @param first  	Page held by the first frame
+	 * @param frames 	Frames holding the pages first, first + 1, ...
+	 */
+  void loadFrames(File* file, const PageId first, const std::vector<FrameId>& frames);
 
  public:
 	/**
-   * Actual buffer pool from which frames are allocated
+   * Actual buffer pool from which frames are allocated. Every Page is a view
+   * over the memory of its frame in frameArena
 	 */
   Page* bufPool;
 
 	/**
    * Constructor of BufMgr class
+	 *
+	 * @param bufs   	Number of frames in the buffer pool
+	 * @param shards  Number of shards the buffer pool is split into, at least 1 and at most bufs
+	 * @param policy  Replacement policy
 	 */
-  BufMgr(std::uint32_t bufs);
-	
+  BufMgr(std::uint32_t bufs, std::uint32_t shards = 1, Policy policy = CLOCK);
+
 	/**
    * Destructor of BufMgr class
 	 */
@@ -222,18 +1154,20 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
 	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param strategy	Access strategy for a page which is only used once, NULL for normal access
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  void readPage(File* file, const PageId PageNo, Page*& page, BufStrategy* strategy = NULL);
 
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
 	 *
 	 * @param file   	File object
 	 * @param PageNo  Page number
-	 * @param dirty		True if the page to be unpinned needs to be marked dirty	
+	 * @param dirty		True if the page to be unpinned needs to be marked dirty
+	 * @param strategy	Access strategy the page was pinned with, NULL for normal access
    * @throws  PageNotPinnedException If the page is not already pinned
 	 */
-  void unPinPage(File* file, const PageId PageNo, const bool dirty);
+  void unPinPage(File* file, const PageId PageNo, const bool dirty, BufStrategy* strategy = NULL);
 
 	/**
 	 * Allocates a new, empty page in the file and returns the Page object.
@@ -242,16 +1176,18 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
 	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 * @param strategy	Access strategy for a page which is only written once, NULL for normal access
 	 */
-  void allocPage(File* file, PageId &PageNo, Page*& page); 
+  void allocPage(File* file, PageId &PageNo, Page*& page, BufStrategy* strategy = NULL);
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
+	 * Writes out all dirty pages of the file to disk, sorted by page number and with adjacent pages written
+	 * together, followed by the header of the file.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
 	 * Otherwise Error returned.
 	 *
 	 * @param file   	File object
-   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
+   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool
    * @throws BadBufferException If any frame allocated to the file is found to be invalid
 	 */
   void flushFile(const File* file);
@@ -266,25 +1202,64 @@ class BufMgr
   void disposePage(File* file, const PageId PageNo);
 
 	/**
-   * Print member variable values. 
+	 * Load a range of pages of the file into the buffer pool in the background, without pinning them. Returns
+	 * right away. Pages already in the buffer pool or not currently used in the file are skipped, and pages which
+	 * are next to each other are read together. A readPage() of a page which is still being loaded waits for that
+	 * load to finish. Loading stops early if every frame of a shard is pinned.
+	 *
+	 * flushFile() and closing the File object drop the requests for the file which have not been carried out yet.
+	 *
+	 * @param file   	File object
+	 * @param first  	First page to load
+	 * @param count  	Number of pages to load
+	 */
+  void prefetchPages(File* file, const PageId first, const std::uint32_t count);
+
+	/**
+	 * Turn reading ahead on sequential access in readPage() on or off; it is on by default. Requests which are
+	 * already queued, and explicit prefetchPages() calls, are not affected.
+	 *
+	 * @param enabled  Whether to read ahead
+	 */
+  void setReadahead(bool enabled);
+
+	/**
+	 * Start the background cleaner. It wakes up regularly and whenever a page was replaced, and writes back dirty,
+	 * unpinned pages which are next in line for replacement. If the cleaner is already running only its target changes.
+	 *
+	 * @param target  Number of clean frames (empty, or holding an unpinned clean page) to keep ready for replacement
+	 *                in every shard
+	 */
+  void startCleaner(std::uint32_t target);
+
+	/**
+	 * Stop the background cleaner and wait for it to exit. Does nothing if it is not running.
+	 */
+  void stopCleaner();
+
+	/**
+   * Print member variable values.
 	 */
   void  printSelf();
 
 	/**
-   * Get buffer pool usage statistics
+   * Get buffer pool usage statistics, summed over all shards
 	 */
-  BufStats & getBufStats()
-  {
-		return bufStats;
-  }
+  BufStats getBufStats();
 
 	/**
-   * Clear buffer pool usage statistics
+   * Clear buffer pool usage statistics of all shards
 	 */
-  void clearBufStats() 
-  {
-		bufStats.clear();
-  }
+  void clearBufStats();
+
+	/**
+   * Count the pages of the file held in the buffer pool. Only looks at the frames of the file.
+	 *
+	 * @param file   	File object
+	 * @param residentPages	Number of pages of the file in the buffer pool, returned via this reference
+	 * @param dirtyPages	Number of those pages which are dirty, returned via this reference
+	 */
+  void getFileStats(const File* file, std::uint32_t& residentPages, std::uint32_t& dirtyPages);
 };
 
 }
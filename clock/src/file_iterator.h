@@ -39,6 +39,7 @@ class FileIterator {
   FileIterator(File* file)
       : file_(file) {
     assert(file_ != NULL);
+    std::lock_guard<std::recursive_mutex> lock(*file_->latch_);
     const FileHeader& header = file_->readHeader();
     current_page_number_ = header.first_used_page;
   }
@@ -60,6 +61,7 @@ class FileIterator {
    */
 	inline FileIterator& operator++() {
     assert(file_ != NULL);
+    std::lock_guard<std::recursive_mutex> lock(*file_->latch_);
     const PageHeader& header = file_->readPageHeader(current_page_number_);
     current_page_number_ = header.next_page_number;
 
@@ -72,6 +74,7 @@ class FileIterator {
 		FileIterator tmp = *this;   // copy ourselves
 
     assert(file_ != NULL);
+    std::lock_guard<std::recursive_mutex> lock(*file_->latch_);
     const PageHeader& header = file_->readPageHeader(current_page_number_);
     current_page_number_ = header.next_page_number;
 
@@ -2,16 +2,26 @@
 #include <stdlib.h>
 //#include <stdio.h>
 #include <cstring>
+#include <cstdint>
 #include <memory>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <fstream>
 #include "page.h"
 #include "buffer.h"
 #include "file_iterator.h"
 #include "page_iterator.h"
+#include "exceptions/file_format_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/invalid_page_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/hash_not_found_exception.h"
+#include "bufHashTbl.h"
 
 #define PRINT_ERROR(str) \
 { \
@@ -40,6 +50,24 @@ void test7();
 void test8();
 void test9();
 void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+void test26();
+void test27();
+void test28();
 void testBufMgr();
 
 int main() 
@@ -79,12 +107,15 @@ int main()
     for (FileIterator iter = new_file.begin();
          iter != new_file.end();
          ++iter) {
+      // Keep a copy of the page alive while iterating over its records; the
+      // page iterator only holds a pointer to it.
+      Page curr_page = *iter;
       // Iterate through all records on the page.
-      for (PageIterator page_iter = (*iter).begin();
-           page_iter != (*iter).end();
+      for (PageIterator page_iter = curr_page.begin();
+           page_iter != curr_page.end();
            ++page_iter) {
         std::cout << "Found record: " << *page_iter
-            << " on page " << (*iter).page_number() << "\n";
+            << " on page " << curr_page.page_number() << "\n";
       }
     }
 
@@ -156,6 +187,24 @@ void testBufMgr()
 	test8();
 	test9();
 	test10();
+	test11();
+	test12();
+	test13();
+	test14();
+	test15();
+	test16();
+	test17();
+	test18();
+	test19();
+	test20();
+	test21();
+	test22();
+	test23();
+	test24();
+	test25();
+	test26();
+	test27();
+	test28();
 
 	//Close files before deleting them
 	file1.~File();
@@ -463,3 +512,1367 @@ void test10()
 	std::cout << "Test 10 passed" << "\n";
 
 }
+
+void test11()
+{
+	// Read the same pages from several threads at once; every page must be read from disk exactly once
+	const std::string& filename = "test.6";
+	const PageId numPages = num/2;
+	const int numThreads = 8;
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		File file6 = File::create(filename);
+		BufMgr* sharedBufMgr = new BufMgr(num);
+		PageId pages[numPages];
+		RecordId rids[numPages];
+
+		for (i = 0; i < numPages; i++) {
+			sharedBufMgr->allocPage(&file6, pages[i], page);
+			sprintf((char*)tmpbuf, "test.6 Page %d %7.1f", pages[i], (float)pages[i]);
+			rids[i] = page->insertRecord(tmpbuf);
+			sharedBufMgr->unPinPage(&file6, pages[i], true);
+		}
+		// writes the pages to disk and drops them from the buffer pool
+		sharedBufMgr->flushFile(&file6);
+		sharedBufMgr->clearBufStats();
+
+		std::atomic<bool> mismatch(false);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; t++) {
+			threads.push_back(std::thread([&, t]() {
+				char expected[100];
+				Page* threadPage;
+				for (PageId j = 0; j < numPages; j++) {
+					// every thread starts at a different page, so reads of a page race with each other
+					const PageId k = (j + t) % numPages;
+					sharedBufMgr->readPage(&file6, pages[k], threadPage);
+					sprintf(expected, "test.6 Page %d %7.1f", pages[k], (float)pages[k]);
+					if (strncmp(threadPage->getRecord(rids[k]).c_str(), expected, strlen(expected)) != 0)
+						mismatch = true;
+					sharedBufMgr->unPinPage(&file6, pages[k], false);
+				}
+			}));
+		}
+		for (int t = 0; t < numThreads; t++)
+			threads[t].join();
+
+		if (mismatch)
+		{
+			PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+		}
+		if (sharedBufMgr->getBufStats().diskreads != (int) numPages)
+		{
+			PRINT_ERROR("ERROR :: Every page should have been read from disk exactly once.");
+		}
+		delete sharedBufMgr;
+	}
+	File::remove(filename);
+
+	std::cout << "Test 11 passed" << "\n";
+}
+
+void test12()
+{
+	// A buffer pool split into shards must behave like a single pool as seen from outside
+	const std::string& filename = "test.7";
+	const PageId numPages = num/2;
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		File file7 = File::create(filename);
+		BufMgr* shardedBufMgr = new BufMgr(num, 4);
+		PageId pages[numPages];
+		RecordId rids[numPages];
+
+		for (i = 0; i < numPages; i++) {
+			shardedBufMgr->allocPage(&file7, pages[i], page);
+			sprintf((char*)tmpbuf, "test.7 Page %d %7.1f", pages[i], (float)pages[i]);
+			rids[i] = page->insertRecord(tmpbuf);
+			shardedBufMgr->unPinPage(&file7, pages[i], true);
+		}
+
+		// flushing with a page pinned in any shard must fail
+		shardedBufMgr->readPage(&file7, pages[numPages - 1], page);
+		try
+		{
+			shardedBufMgr->flushFile(&file7);
+			PRINT_ERROR("ERROR :: Pages pinned for file being flushed. Exception should have been thrown before execution reaches this point.");
+		}
+		catch(const PagePinnedException&)
+		{
+		}
+		shardedBufMgr->unPinPage(&file7, pages[numPages - 1], false);
+
+		// every page of every shard is written back and dropped
+		shardedBufMgr->flushFile(&file7);
+		if (shardedBufMgr->getBufStats().diskwrites != (int) numPages)
+		{
+			PRINT_ERROR("ERROR :: Every page should have been written to disk exactly once.");
+		}
+
+		for (i = 0; i < numPages; i++) {
+			shardedBufMgr->readPage(&file7, pages[i], page);
+			sprintf((char*)tmpbuf, "test.7 Page %d %7.1f", pages[i], (float)pages[i]);
+			if(strncmp(page->getRecord(rids[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			shardedBufMgr->unPinPage(&file7, pages[i], false);
+		}
+
+		// the statistics of all shards add up
+		BufStats stats = shardedBufMgr->getBufStats();
+		if (stats.accesses != (int) (2 * numPages + 1) || stats.diskreads != (int) (2 * numPages))
+		{
+			PRINT_ERROR("ERROR :: Buffer statistics of the shards do not add up.");
+		}
+		shardedBufMgr->clearBufStats();
+		if (shardedBufMgr->getBufStats().accesses != 0)
+		{
+			PRINT_ERROR("ERROR :: Buffer statistics of all shards should have been cleared.");
+		}
+		delete shardedBufMgr;
+	}
+	File::remove(filename);
+
+	std::cout << "Test 12 passed" << "\n";
+}
+
+void test13()
+{
+	// Frames freed by disposePage must be reused before any resident page is replaced
+	const std::string& filename = "test.8";
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		File file8 = File::create(filename);
+		BufMgr* freeListBufMgr = new BufMgr(num);
+		PageId pages[num];
+
+		// fill the whole buffer pool with dirty pages
+		for (i = 0; i < num; i++) {
+			freeListBufMgr->allocPage(&file8, pages[i], page);
+			sprintf((char*)tmpbuf, "test.8 Page %d %7.1f", pages[i], (float)pages[i]);
+			page->insertRecord(tmpbuf);
+			freeListBufMgr->unPinPage(&file8, pages[i], true);
+		}
+
+		for (i = 0; i < num/2; i++)
+			freeListBufMgr->disposePage(&file8, pages[i]);
+		freeListBufMgr->clearBufStats();
+
+		for (i = 0; i < num/2; i++) {
+			freeListBufMgr->allocPage(&file8, pages[i], page);
+			freeListBufMgr->unPinPage(&file8, pages[i], false);
+		}
+		// the pages which were not disposed are all still in the buffer pool
+		for (i = num/2; i < num; i++) {
+			freeListBufMgr->readPage(&file8, pages[i], page);
+			freeListBufMgr->unPinPage(&file8, pages[i], false);
+		}
+
+		if (freeListBufMgr->getBufStats().diskwrites != 0 || freeListBufMgr->getBufStats().diskreads != (int) (num/2))
+		{
+			PRINT_ERROR("ERROR :: Freed frames should have been used before replacing any page.");
+		}
+		delete freeListBufMgr;
+	}
+	File::remove(filename);
+
+	std::cout << "Test 13 passed" << "\n";
+}
+
+void test14()
+{
+	// With the background cleaner running, replacing pages must not have to write any of them
+	const std::string& filename = "test.9";
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		File file9 = File::create(filename);
+		BufMgr* cleanerBufMgr = new BufMgr(num);
+		PageId pages[2 * num];
+		RecordId rids[2 * num];
+
+		cleanerBufMgr->startCleaner(num);
+		for (i = 0; i < num; i++) {
+			cleanerBufMgr->allocPage(&file9, pages[i], page);
+			sprintf((char*)tmpbuf, "test.9 Page %d %7.1f", pages[i], (float)pages[i]);
+			rids[i] = page->insertRecord(tmpbuf);
+			cleanerBufMgr->unPinPage(&file9, pages[i], true);
+		}
+
+		// gives the cleaner up to ten seconds to write back the whole buffer pool
+		for (int wait = 0; wait < 1000 && cleanerBufMgr->getBufStats().cleanerWrites < (int) num; wait++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		if (cleanerBufMgr->getBufStats().cleanerWrites != (int) num)
+		{
+			PRINT_ERROR("ERROR :: The cleaner should have written back every dirty page.");
+		}
+
+		for (i = num; i < 2 * num; i++) {
+			cleanerBufMgr->allocPage(&file9, pages[i], page);
+			sprintf((char*)tmpbuf, "test.9 Page %d %7.1f", pages[i], (float)pages[i]);
+			rids[i] = page->insertRecord(tmpbuf);
+			cleanerBufMgr->unPinPage(&file9, pages[i], true);
+		}
+		if (cleanerBufMgr->getBufStats().victimWrites != 0)
+		{
+			PRINT_ERROR("ERROR :: No page should have been written back when it was replaced.");
+		}
+
+		// the pages written by the cleaner are read back from disk
+		for (i = 0; i < 2 * num; i++) {
+			cleanerBufMgr->readPage(&file9, pages[i], page);
+			sprintf((char*)tmpbuf, "test.9 Page %d %7.1f", pages[i], (float)pages[i]);
+			if(strncmp(page->getRecord(rids[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			cleanerBufMgr->unPinPage(&file9, pages[i], false);
+		}
+
+		cleanerBufMgr->stopCleaner();
+		cleanerBufMgr->flushFile(&file9);
+		delete cleanerBufMgr;
+	}
+	File::remove(filename);
+
+	std::cout << "Test 14 passed" << "\n";
+}
+
+void test15()
+{
+	// Pages of a file opened with positional I/O go through the buffer pool like any other
+	const std::string& filename = "test.10";
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		File file10 = File::create(filename, File::POSITIONAL_IO);
+		if (file10.backend() != File::POSITIONAL_IO)
+		{
+			PRINT_ERROR("ERROR :: The file should use positional I/O.");
+		}
+		BufMgr* pioBufMgr = new BufMgr(num);
+		PageId pages[2 * num];
+		RecordId rids[2 * num];
+
+		for (i = 0; i < 2 * num; i++) {
+			pioBufMgr->allocPage(&file10, pages[i], page);
+			sprintf((char*)tmpbuf, "test.10 Page %d %7.1f", pages[i], (float)pages[i]);
+			rids[i] = page->insertRecord(tmpbuf);
+			pioBufMgr->unPinPage(&file10, pages[i], true);
+		}
+		pioBufMgr->flushFile(&file10);
+
+		// opening the file again shares the descriptor, whatever backend is asked for
+		File again = File::open(filename);
+		if (again.backend() != File::POSITIONAL_IO)
+		{
+			PRINT_ERROR("ERROR :: An open file should keep its backend.");
+		}
+		for (i = 0; i < 2 * num; i++) {
+			Page copy = again.readPage(pages[i]);
+			sprintf((char*)tmpbuf, "test.10 Page %d %7.1f", pages[i], (float)pages[i]);
+			if(strncmp(copy.getRecord(rids[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+		}
+
+		delete pioBufMgr;
+	}
+	File::remove(filename);
+
+	std::cout << "Test 15 passed" << "\n";
+}
+
+void test16()
+{
+	// The file header is kept in memory and written back when the file is closed
+	const std::string& filename = "test.11";
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	PageId pages[num];
+	{
+		File file11 = File::create(filename);
+		for (i = 0; i < num; i++)
+			pages[i] = file11.allocatePage().page_number();
+		for (i = 0; i < num; i += 2)
+			file11.deletePage(pages[i]);
+	}
+
+	{
+		File file11 = File::open(filename);
+		unsigned int used = 0;
+		for (FileIterator iter = file11.begin(); iter != file11.end(); ++iter)
+			used++;
+		if (used != num / 2)
+		{
+			PRINT_ERROR("ERROR :: The header written on close does not match the pages of the file.");
+		}
+		// the deleted pages are reused before the file grows
+		for (i = 0; i < num; i += 2)
+			file11.allocatePage();
+		try
+		{
+			file11.readPage(pages[num - 1] + 1);
+			PRINT_ERROR("ERROR :: No more pages should have been added to the file.");
+		}
+		catch(const InvalidPageException&)
+		{
+		}
+	}
+	File::remove(filename);
+
+	std::cout << "Test 16 passed" << "\n";
+}
+
+void test17()
+{
+	// Reading a page into an existing page replaces all of its contents
+	const std::string& filename = "test.12";
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		File file12 = File::create(filename);
+		Page first = file12.allocatePage();
+		RecordId rid = first.insertRecord("test.12 first page");
+		file12.writePage(first);
+		Page second = file12.allocatePage();
+		second.insertRecord("test.12 second page");
+		second.insertRecord("test.12 second record");
+		file12.writePage(second);
+
+		Page frame = second;
+		file12.readPage(first.page_number(), frame);
+		if (frame.page_number() != first.page_number() || frame.getRecord(rid) != "test.12 first page" ||
+		    frame.getFreeSpace() != first.getFreeSpace())
+		{
+			PRINT_ERROR("ERROR :: The page read into an existing page does not match.");
+		}
+
+		file12.deletePage(second.page_number());
+		try
+		{
+			file12.readPage(second.page_number(), frame);
+			PRINT_ERROR("ERROR :: A deleted page should not be read.");
+		}
+		catch(const InvalidPageException&)
+		{
+		}
+	}
+	File::remove(filename);
+
+	std::cout << "Test 17 passed" << "\n";
+}
+
+void test18()
+{
+	// Pages in the buffer pool are views over their frames: copies are independent, assignments write to the frame
+	const std::string& filename = "test.13";
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		File file13 = File::create(filename);
+		BufMgr* viewBufMgr = new BufMgr(num);
+		PageId pageNo;
+		viewBufMgr->allocPage(&file13, pageNo, page);
+		RecordId rid = page->insertRecord("test.13 frame");
+
+		Page copy = *page;
+		copy.updateRecord(rid, "test.13 copy");
+		if (page->getRecord(rid) != "test.13 frame")
+		{
+			PRINT_ERROR("ERROR :: Changing a copy of a page should not change the frame.");
+		}
+
+		*page = copy;
+		viewBufMgr->unPinPage(&file13, pageNo, true);
+		viewBufMgr->flushFile(&file13);
+		if (file13.readPage(pageNo).getRecord(rid) != "test.13 copy")
+		{
+			PRINT_ERROR("ERROR :: Assigning to a page in the buffer pool should change the frame.");
+		}
+		delete viewBufMgr;
+	}
+	File::remove(filename);
+
+	std::cout << "Test 18 passed" << "\n";
+}
+
+void test19()
+{
+	// Files in the format without an allocation map have to be migrated before they can be opened
+	const std::string& filename = "test.14";
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		// version 1 file with pages 1 and 3 in use and page 2 free
+		std::ofstream old_file(filename, std::ios::out | std::ios::binary);
+		PageId old_header[4] = {4 /* num_pages */, 1 /* first_used_page */, 1 /* num_free_pages */, 2 /* first_free_page */};
+		old_file.write((const char*)old_header, sizeof(old_header));
+		for (PageId pageNo = 1; pageNo <= 3; pageNo++) {
+			PageHeader header = {0, (std::uint16_t)Page::DATA_SIZE, 0, 0, pageNo == 2 ? Page::INVALID_NUMBER : pageNo,
+			                     pageNo == 1 ? 3 : Page::INVALID_NUMBER};
+			std::string data(Page::DATA_SIZE, '\0');
+			old_file.write((const char*)&header, sizeof(header));
+			old_file.write(data.data(), data.size());
+		}
+	}
+
+	try
+	{
+		File file14 = File::open(filename);
+		PRINT_ERROR("ERROR :: A file in the old format should not be opened.");
+	}
+	catch(const FileFormatException&)
+	{
+	}
+
+	File::migrate(filename);
+	{
+		File file14 = File::open(filename);
+		PageId expected[2] = {1, 3};
+		int used = 0;
+		for (FileIterator iter = file14.begin(); iter != file14.end(); ++iter)
+			if (used >= 2 || (*iter).page_number() != expected[used++])
+				PRINT_ERROR("ERROR :: The used pages did not survive the migration.");
+		if (used != 2)
+		{
+			PRINT_ERROR("ERROR :: The used pages did not survive the migration.");
+		}
+
+		// the free page is reused and goes between the two used pages
+		if (file14.allocatePage().page_number() != 2)
+		{
+			PRINT_ERROR("ERROR :: The free page did not survive the migration.");
+		}
+		used = 0;
+		for (FileIterator iter = file14.begin(); iter != file14.end(); ++iter)
+			if ((*iter).page_number() != (PageId)++used)
+				PRINT_ERROR("ERROR :: The used list is out of order.");
+		if (used != 3)
+		{
+			PRINT_ERROR("ERROR :: The used list is missing pages.");
+		}
+	}
+	File::remove(filename);
+
+	// a version 1 file which ends before its last page is not replaced by a partial copy
+	{
+		std::ofstream old_file(filename, std::ios::out | std::ios::binary);
+		PageId old_header[4] = {4 /* num_pages */, 1 /* first_used_page */, 0 /* num_free_pages */, 0 /* first_free_page */};
+		old_file.write((const char*)old_header, sizeof(old_header));
+		std::string data(Page::SIZE, '\0');
+		old_file.write(data.data(), data.size());
+	}
+	try
+	{
+		File::migrate(filename);
+		PRINT_ERROR("ERROR :: A truncated file should not have been migrated.");
+	}
+	catch(const FileIOException&)
+	{
+	}
+	File::remove(filename + ".migrating");
+	File::remove(filename);
+
+	std::cout << "Test 19 passed" << "\n";
+}
+
+void test20()
+{
+	// Pages written back with an outdated next page pointer keep the used list intact
+	const std::string& filename = "test.15";
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	File::setVerifyWrites(true);
+	{
+		File file15 = File::create(filename);
+		BufMgr* listBufMgr = new BufMgr(num);
+		PageId pages[num];
+		Page* pagePtrs[num];
+
+		for (i = 0; i < num; i++)
+			listBufMgr->allocPage(&file15, pages[i], pagePtrs[i]);
+		// keeps a copy of a page before it is disposed of
+		Page disposed = *pagePtrs[1];
+		// the neighbours of the disposed pages still point to them in the buffer pool
+		for (i = 1; i < num; i += 2) {
+			listBufMgr->unPinPage(&file15, pages[i], false);
+			listBufMgr->disposePage(&file15, pages[i]);
+		}
+		for (i = 0; i < num; i += 2)
+			listBufMgr->unPinPage(&file15, pages[i], true);
+		listBufMgr->flushFile(&file15);
+		delete listBufMgr;
+
+		unsigned int used = 0;
+		for (FileIterator iter = file15.begin(); iter != file15.end(); ++iter)
+		{
+			if ((*iter).page_number() != pages[2 * used++])
+				PRINT_ERROR("ERROR :: The used list does not match the used pages.");
+		}
+		if (used != num / 2)
+		{
+			PRINT_ERROR("ERROR :: The used list does not match the used pages.");
+		}
+
+		try
+		{
+			file15.writePage(disposed);
+			PRINT_ERROR("ERROR :: A deleted page should not be written.");
+		}
+		catch(const InvalidPageException&)
+		{
+		}
+	}
+	File::setVerifyWrites(false);
+	File::remove(filename);
+
+	std::cout << "Test 20 passed" << "\n";
+}
+
+void test21()
+{
+	// Pages written with deferred flushing are all there once the file is synced
+	const std::string& filename = "test.16";
+	const File::Durability modes[] = {File::FLUSH_ON_CHECKPOINT, File::SYNC_ON_REQUEST};
+
+	for (int m = 0; m < 2; m++)
+	{
+		try
+		{
+			File::remove(filename);
+		}
+		catch(const FileNotFoundException&)
+		{
+		}
+
+		PageId pages[2 * num];
+		RecordId rids[2 * num];
+		{
+			File file16 = File::create(filename);
+			file16.setDurability(modes[m]);
+			File other = File::open(filename);
+			if (other.durability() != modes[m])
+			{
+				PRINT_ERROR("ERROR :: The durability mode should be shared by all objects for a file.");
+			}
+
+			BufMgr* loadBufMgr = new BufMgr(num);
+			for (i = 0; i < 2 * num; i++) {
+				loadBufMgr->allocPage(&file16, pages[i], page);
+				sprintf((char*)tmpbuf, "test.16 Page %d %7.1f", pages[i], (float)pages[i]);
+				rids[i] = page->insertRecord(tmpbuf);
+				loadBufMgr->unPinPage(&file16, pages[i], true);
+			}
+			loadBufMgr->flushFile(&file16);
+			file16.sync();
+			delete loadBufMgr;
+		}
+
+		{
+			File file16 = File::open(filename);
+			if (file16.durability() != File::FLUSH_EACH_WRITE)
+			{
+				PRINT_ERROR("ERROR :: A reopened file should flush each write.");
+			}
+			for (i = 0; i < 2 * num; i++) {
+				sprintf((char*)tmpbuf, "test.16 Page %d %7.1f", pages[i], (float)pages[i]);
+				if(strncmp(file16.readPage(pages[i]).getRecord(rids[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+				{
+					PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+				}
+			}
+		}
+		File::remove(filename);
+	}
+
+	std::cout << "Test 21 passed" << "\n";
+}
+
+void test22()
+{
+	// Flushing writes back pages dirtied in any order and still takes them out of the buffer pool
+	const std::string& filename = "test.17";
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		File file17 = File::create(filename, File::POSITIONAL_IO);
+		PageId pages[num];
+		RecordId rids[num];
+		for (i = 0; i < num; i++)
+			pages[i] = file17.allocatePage().page_number();
+
+		BufMgr* flushBufMgr = new BufMgr(num);
+		// reads the pages back to front, so frame order and page order are reversed
+		for (int j = num - 1; j >= 0; j--) {
+			flushBufMgr->readPage(&file17, pages[j], page);
+			sprintf((char*)tmpbuf, "test.17 Page %d %7.1f", pages[j], (float)pages[j]);
+			rids[j] = page->insertRecord(tmpbuf);
+			// leaves every third page clean
+			flushBufMgr->unPinPage(&file17, pages[j], j % 3 != 0);
+		}
+		flushBufMgr->flushFile(&file17);
+		BufStats stats = flushBufMgr->getBufStats();
+		if (stats.diskwrites != (int) (num - (num + 2) / 3))
+		{
+			PRINT_ERROR("ERROR :: Every dirty page should have been written once.");
+		}
+
+		// the written pages have left the buffer pool and are read again
+		for (i = 0; i < num; i++) {
+			if (i % 3 == 0)
+				continue;
+			flushBufMgr->readPage(&file17, pages[i], page);
+			sprintf((char*)tmpbuf, "test.17 Page %d %7.1f", pages[i], (float)pages[i]);
+			if(strncmp(page->getRecord(rids[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			flushBufMgr->unPinPage(&file17, pages[i], false);
+		}
+		if (flushBufMgr->getBufStats().diskreads != stats.diskreads + (int) (num - (num + 2) / 3))
+		{
+			PRINT_ERROR("ERROR :: The written pages should have been taken out of the buffer pool.");
+		}
+		delete flushBufMgr;
+	}
+	File::remove(filename);
+
+	std::cout << "Test 22 passed" << "\n";
+}
+
+void test23()
+{
+	// The buffer manager keeps track of the pages of every file, also when they are spread over several shards
+	const std::string& filename = "test.18";
+	const std::string& otherFilename = "test.18b";
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+	try
+	{
+		File::remove(otherFilename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		File file18 = File::create(filename);
+		File other = File::create(otherFilename);
+		BufMgr* fileBufMgr = new BufMgr(num, 4);
+		std::uint32_t resident, dirty;
+
+		fileBufMgr->getFileStats(&file18, resident, dirty);
+		if (resident != 0 || dirty != 0)
+		{
+			PRINT_ERROR("ERROR :: A new file should have no pages in the buffer pool.");
+		}
+
+		PageId pages[20];
+		for (i = 0; i < 20; i++) {
+			fileBufMgr->allocPage(&file18, pages[i], page);
+			// leaves every fourth page clean
+			fileBufMgr->unPinPage(&file18, pages[i], i % 4 != 0);
+		}
+		for (i = 0; i < 7; i++) {
+			fileBufMgr->allocPage(&other, pageno1, page);
+			fileBufMgr->unPinPage(&other, pageno1, true);
+		}
+
+		fileBufMgr->getFileStats(&file18, resident, dirty);
+		if (resident != 20 || dirty != 15)
+		{
+			PRINT_ERROR("ERROR :: Wrong number of resident or dirty pages.");
+		}
+
+		// disposing of a dirty page takes it out of both counts
+		fileBufMgr->disposePage(&file18, pages[1]);
+		fileBufMgr->getFileStats(&file18, resident, dirty);
+		if (resident != 19 || dirty != 14)
+		{
+			PRINT_ERROR("ERROR :: A disposed page should not be counted.");
+		}
+
+		// flushing one file leaves the pages of the other one alone
+		fileBufMgr->flushFile(&file18);
+		if (fileBufMgr->getBufStats().diskwrites != 14)
+		{
+			PRINT_ERROR("ERROR :: Only the dirty pages of the flushed file should have been written.");
+		}
+		// the written pages have left the buffer pool, the clean ones are still there
+		fileBufMgr->getFileStats(&file18, resident, dirty);
+		if (resident != 5 || dirty != 0)
+		{
+			PRINT_ERROR("ERROR :: A flushed file should have only clean pages in the buffer pool.");
+		}
+		fileBufMgr->getFileStats(&other, resident, dirty);
+		if (resident != 7 || dirty != 7)
+		{
+			PRINT_ERROR("ERROR :: The pages of the other file should still be in the buffer pool.");
+		}
+
+		// pages read back are counted again; they are read out of order, so nothing is read ahead
+		const PageId readBack[] = {3, 5, 2, 4};
+		for (i = 0; i < 4; i++) {
+			fileBufMgr->readPage(&file18, pages[readBack[i]], page);
+			fileBufMgr->unPinPage(&file18, pages[readBack[i]], readBack[i] == 2);
+		}
+		fileBufMgr->getFileStats(&file18, resident, dirty);
+		if (resident != 8 || dirty != 1)
+		{
+			PRINT_ERROR("ERROR :: Pages read back should be counted as resident.");
+		}
+
+		fileBufMgr->flushFile(&file18);
+		fileBufMgr->flushFile(&other);
+		delete fileBufMgr;
+	}
+	File::remove(filename);
+	File::remove(otherFilename);
+
+	std::cout << "Test 23 passed" << "\n";
+}
+
+void test24()
+{
+	// Prefetched pages are loaded in the background, and reading them never reads them a second time
+	const std::string& filename = "test.19";
+	const PageId count = 300;
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		File file19 = File::create(filename);
+		PageId pages[count];
+		RecordId rids[count];
+		for (i = 0; i < count; i++) {
+			Page newPage = file19.allocatePage();
+			pages[i] = newPage.page_number();
+			sprintf((char*)tmpbuf, "test.19 Page %d %7.1f", pages[i], (float)pages[i]);
+			rids[i] = newPage.insertRecord(tmpbuf);
+			file19.writePage(newPage);
+		}
+		// a deleted page in the middle of the range is skipped
+		file19.deletePage(pages[150]);
+
+		BufMgr* prefetchBufMgr = new BufMgr(2 * count, 4);
+		prefetchBufMgr->prefetchPages(&file19, pages[0], count);
+		// a page counts as read once its load is done, while it is resident as soon as its load starts
+		for (int wait = 0; wait < 1000 && prefetchBufMgr->getBufStats().diskreads < (int) count - 1; wait++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		std::uint32_t resident, dirty;
+		prefetchBufMgr->getFileStats(&file19, resident, dirty);
+		BufStats stats = prefetchBufMgr->getBufStats();
+		if (resident != count - 1 || dirty != 0 || stats.diskreads != (int) count - 1 || stats.accesses != 0)
+		{
+			PRINT_ERROR("ERROR :: Every used page should have been prefetched once, without being accessed.");
+		}
+
+		// the prefetched pages are unpinned and hold the contents on disk
+		for (i = 0; i < count; i++) {
+			if (i == 150)
+				continue;
+			prefetchBufMgr->readPage(&file19, pages[i], page);
+			sprintf((char*)tmpbuf, "test.19 Page %d %7.1f", pages[i], (float)pages[i]);
+			if(strncmp(page->getRecord(rids[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			prefetchBufMgr->unPinPage(&file19, pages[i], false);
+		}
+		if (prefetchBufMgr->getBufStats().diskreads != (int) count - 1)
+		{
+			PRINT_ERROR("ERROR :: Prefetched pages should not have been read again.");
+		}
+		prefetchBufMgr->flushFile(&file19);
+		delete prefetchBufMgr;
+
+		// pages read while they are being prefetched are read from disk only once, whoever gets there first
+		prefetchBufMgr = new BufMgr(2 * count, 4);
+		prefetchBufMgr->prefetchPages(&file19, pages[0], count);
+		for (i = 0; i < count; i++) {
+			if (i == 150)
+				continue;
+			prefetchBufMgr->readPage(&file19, pages[i], page);
+			sprintf((char*)tmpbuf, "test.19 Page %d %7.1f", pages[i], (float)pages[i]);
+			if(strncmp(page->getRecord(rids[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			prefetchBufMgr->unPinPage(&file19, pages[i], false);
+		}
+		prefetchBufMgr->flushFile(&file19);
+		if (prefetchBufMgr->getBufStats().diskreads != (int) count - 1)
+		{
+			PRINT_ERROR("ERROR :: Every page should have been read once.");
+		}
+		delete prefetchBufMgr;
+	}
+	File::remove(filename);
+
+	std::cout << "Test 24 passed" << "\n";
+}
+
+void test25()
+{
+	// Sequential reads are followed by readahead, random ones are not
+	const std::string& filename = "test.20";
+	const PageId count = 200;
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		File file20 = File::create(filename);
+		for (i = 0; i < count; i++)
+			file20.allocatePage();
+		// the scan below follows the next page pointers over the gaps
+		for (i = 10; i <= count; i += 10)
+			file20.deletePage(i);
+		const int used = count - count / 10;
+
+		BufMgr* raBufMgr = new BufMgr(2 * count);
+		// the first page alone does not read ahead, the page after it reads the next READAHEAD_MIN pages ahead
+		raBufMgr->readPage(&file20, 1, page);
+		raBufMgr->unPinPage(&file20, 1, false);
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		if (raBufMgr->getBufStats().diskreads != 1)
+		{
+			PRINT_ERROR("ERROR :: Reading the first page should not have read ahead.");
+		}
+		raBufMgr->readPage(&file20, 2, page);
+		raBufMgr->unPinPage(&file20, 2, false);
+		for (int wait = 0; wait < 1000 && raBufMgr->getBufStats().diskreads < 2 + (int) BufMgr::READAHEAD_MIN; wait++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		for (i = 3; i <= 2 + BufMgr::READAHEAD_MIN; i++) {
+			raBufMgr->readPage(&file20, i, page);
+			raBufMgr->unPinPage(&file20, i, false);
+		}
+		if (raBufMgr->getBufStats().readaheadHits != (int) BufMgr::READAHEAD_MIN)
+		{
+			PRINT_ERROR("ERROR :: The pages after the first one should have been read ahead.");
+		}
+
+		// whether the prefetcher or the scan gets to a page first, every page is read once
+		PageId pageNo = 2 + BufMgr::READAHEAD_MIN;
+		int scanned = BufMgr::READAHEAD_MIN + 2;
+		raBufMgr->readPage(&file20, pageNo, page);
+		pageNo = page->next_page_number();
+		raBufMgr->unPinPage(&file20, 2 + BufMgr::READAHEAD_MIN, false);
+		while (pageNo != Page::INVALID_NUMBER) {
+			raBufMgr->readPage(&file20, pageNo, page);
+			const PageId nextPageNo = page->next_page_number();
+			raBufMgr->unPinPage(&file20, pageNo, false);
+			pageNo = nextPageNo;
+			scanned++;
+		}
+		raBufMgr->flushFile(&file20);
+		BufStats stats = raBufMgr->getBufStats();
+		if (scanned != used || stats.diskreads != used || stats.readaheadWasted != 0)
+		{
+			PRINT_ERROR("ERROR :: Every used page should have been read once.");
+		}
+		delete raBufMgr;
+
+		// random reads do not read ahead
+		raBufMgr = new BufMgr(2 * count);
+		int reads = 0;
+		for (pageNo = 3; pageNo < count; pageNo += 7) {
+			if (pageNo % 10 == 0)
+				continue;
+			raBufMgr->readPage(&file20, pageNo, page);
+			raBufMgr->unPinPage(&file20, pageNo, false);
+			reads++;
+		}
+		raBufMgr->flushFile(&file20);
+		stats = raBufMgr->getBufStats();
+		if (stats.diskreads != reads || stats.readaheadHits != 0)
+		{
+			PRINT_ERROR("ERROR :: Random reads should not have been followed by readahead.");
+		}
+		delete raBufMgr;
+
+		// pages read ahead and then pushed out unused are counted as wasted
+		raBufMgr = new BufMgr(40);
+		for (i = 1; i <= 2; i++) {
+			raBufMgr->readPage(&file20, i, page);
+			raBufMgr->unPinPage(&file20, i, false);
+		}
+		for (int wait = 0; wait < 1000 && raBufMgr->getBufStats().diskreads < 2 + (int) BufMgr::READAHEAD_MIN; wait++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		for (pageNo = 61, reads = 0; reads < 40; pageNo += 3) {
+			if (pageNo % 10 == 0)
+				continue;
+			reads++;
+			raBufMgr->readPage(&file20, pageNo, page);
+			raBufMgr->unPinPage(&file20, pageNo, false);
+		}
+		if (raBufMgr->getBufStats().readaheadWasted != (int) BufMgr::READAHEAD_MIN)
+		{
+			PRINT_ERROR("ERROR :: The pages read ahead should have been counted as wasted.");
+		}
+		raBufMgr->flushFile(&file20);
+		delete raBufMgr;
+
+		// with readahead turned off a sequential scan reads every page itself
+		raBufMgr = new BufMgr(2 * count);
+		raBufMgr->setReadahead(false);
+		for (pageNo = 1, reads = 0; pageNo <= count; pageNo++) {
+			if (pageNo % 10 == 0)
+				continue;
+			raBufMgr->readPage(&file20, pageNo, page);
+			raBufMgr->unPinPage(&file20, pageNo, false);
+			reads++;
+		}
+		raBufMgr->flushFile(&file20);
+		stats = raBufMgr->getBufStats();
+		if (stats.diskreads != reads || stats.readaheadHits != 0)
+		{
+			PRINT_ERROR("ERROR :: Reads should not have been followed by readahead once it was turned off.");
+		}
+		delete raBufMgr;
+
+		// closing a File object without flushFile() drops its queued prefetch requests and readahead, the prefetcher
+		// does not use it anymore
+		raBufMgr = new BufMgr(2 * count);
+		{
+			File reader = File::open(filename);
+			for (pageNo = 1; pageNo < count / 2; pageNo++) {
+				if (pageNo % 10 == 0)
+					continue;
+				raBufMgr->readPage(&reader, pageNo, page);
+				raBufMgr->unPinPage(&reader, pageNo, false);
+			}
+			// one request per page, so that the prefetcher is still busy with them when the file is closed
+			for (pageNo = count; pageNo >= count / 2; pageNo--)
+				raBufMgr->prefetchPages(&reader, pageNo, 1);
+		}
+		reads = raBufMgr->getBufStats().diskreads;
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		if (raBufMgr->getBufStats().diskreads != reads)
+		{
+			PRINT_ERROR("ERROR :: Readahead should have stopped when the file was closed.");
+		}
+		delete raBufMgr;
+
+		// the window follows the list of used pages over a gap, instead of asking for the deleted pages in it
+		for (pageNo = 3; pageNo < 10; pageNo++)
+			file20.deletePage(pageNo);
+		raBufMgr = new BufMgr(2 * count);
+		for (pageNo = 1; pageNo <= 2; pageNo++) {
+			raBufMgr->readPage(&file20, pageNo, page);
+			raBufMgr->unPinPage(&file20, pageNo, false);
+		}
+		for (int wait = 0; wait < 1000 && raBufMgr->getBufStats().diskreads < 2 + (int) BufMgr::READAHEAD_MIN; wait++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		for (pageNo = 11; pageNo <= 10 + BufMgr::READAHEAD_MIN; pageNo++) {
+			raBufMgr->readPage(&file20, pageNo, page);
+			raBufMgr->unPinPage(&file20, pageNo, false);
+		}
+		if (raBufMgr->getBufStats().readaheadHits != (int) BufMgr::READAHEAD_MIN)
+		{
+			PRINT_ERROR("ERROR :: The used pages after the gap should have been read ahead.");
+		}
+		raBufMgr->flushFile(&file20);
+		delete raBufMgr;
+	}
+	File::remove(filename);
+
+	std::cout << "Test 25 passed" << "\n";
+}
+
+void test26()
+{
+	// A scan or a bulk load through a strategy does not push the pages other threads use out of the buffer pool
+	const std::string& filename = "test.21";
+	const std::uint32_t frames = 100;
+	const PageId hot = 20;
+	const PageId scan = 10 * frames;
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		File file21 = File::create(filename);
+		for (i = 0; i < hot + scan; i++)
+			file21.allocatePage();
+
+		BufMgr* ringBufMgr = new BufMgr(frames);
+		// the pages used without a strategy are read from the last one down, so that no readahead gets in,
+		// while the scans through a strategy run forward, since they do not read ahead
+		for (i = hot; i > 0; i--) {
+			ringBufMgr->readPage(&file21, i, page);
+			ringBufMgr->unPinPage(&file21, i, false);
+		}
+
+		BufStrategy bulkRead(BufStrategy::BULK_READ);
+		for (i = hot + 1; i <= hot + scan; i++) {
+			ringBufMgr->readPage(&file21, i, page, &bulkRead);
+			ringBufMgr->unPinPage(&file21, i, false, &bulkRead);
+		}
+		std::uint32_t resident, dirty;
+		ringBufMgr->getFileStats(&file21, resident, dirty);
+		if (resident > hot + frames / 8 || ringBufMgr->getBufStats().readaheadHits != 0)
+		{
+			PRINT_ERROR("ERROR :: The scan should only have used the frames of its ring.");
+		}
+		int reads = ringBufMgr->getBufStats().diskreads;
+		for (i = hot; i > 0; i--) {
+			ringBufMgr->readPage(&file21, i, page);
+			ringBufMgr->unPinPage(&file21, i, false);
+		}
+		if (ringBufMgr->getBufStats().diskreads != reads)
+		{
+			PRINT_ERROR("ERROR :: The pages used before the scan should have stayed in the buffer pool.");
+		}
+
+		// a bulk load writes its pages back to reuse their frames
+		BufStrategy bulkWrite(BufStrategy::BULK_WRITE);
+		std::vector<PageId> loaded(scan);
+		std::vector<RecordId> loadedRid(scan);
+		for (i = 0; i < scan; i++) {
+			ringBufMgr->allocPage(&file21, loaded[i], page, &bulkWrite);
+			sprintf((char*)tmpbuf, "test.21 Page %d %7.1f", loaded[i], (float)loaded[i]);
+			loadedRid[i] = page->insertRecord(tmpbuf);
+			ringBufMgr->unPinPage(&file21, loaded[i], true, &bulkWrite);
+		}
+		ringBufMgr->getFileStats(&file21, resident, dirty);
+		if (resident > hot + 2 * (frames / 8) || ringBufMgr->getBufStats().victimWrites < (int) (scan - frames / 8))
+		{
+			PRINT_ERROR("ERROR :: The bulk load should have written its pages back to reuse the frames of its ring.");
+		}
+		ringBufMgr->flushFile(&file21);
+		for (i = 0; i < scan; i++) {
+			ringBufMgr->readPage(&file21, loaded[i], page, &bulkRead);
+			sprintf((char*)tmpbuf, "test.21 Page %d %7.1f", loaded[i], (float)loaded[i]);
+			if (strncmp(page->getRecord(loadedRid[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			ringBufMgr->unPinPage(&file21, loaded[i], false, &bulkRead);
+		}
+		reads = ringBufMgr->getBufStats().diskreads;
+		for (i = hot; i > 0; i--) {
+			ringBufMgr->readPage(&file21, i, page);
+			ringBufMgr->unPinPage(&file21, i, false);
+		}
+		if (ringBufMgr->getBufStats().diskreads != reads)
+		{
+			PRINT_ERROR("ERROR :: The pages used before the bulk load should have stayed in the buffer pool.");
+		}
+
+		// without a strategy the same scan replaces them
+		for (i = hot + scan; i > hot; i--) {
+			ringBufMgr->readPage(&file21, i, page);
+			ringBufMgr->unPinPage(&file21, i, false);
+		}
+		reads = ringBufMgr->getBufStats().diskreads;
+		for (i = hot; i > 0; i--) {
+			ringBufMgr->readPage(&file21, i, page);
+			ringBufMgr->unPinPage(&file21, i, false);
+		}
+		if (ringBufMgr->getBufStats().diskreads != reads + (int) hot)
+		{
+			PRINT_ERROR("ERROR :: A scan without a strategy should have replaced the other pages.");
+		}
+		delete ringBufMgr;
+	}
+	File::remove(filename);
+
+	std::cout << "Test 26 passed" << "\n";
+}
+
+void test27()
+{
+	// CLOCK-Pro keeps pages used again during their test period through a scan, and gives cold pages more frames
+	// when pages come back while they are remembered as test pages
+	const std::string& filename = "test.22";
+	const PageId filePages = 200;
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException&)
+	{
+	}
+
+	{
+		File file22 = File::create(filename);
+		std::vector<RecordId> rids(filePages + 1);
+		for (i = 1; i <= filePages; i++) {
+			Page newPage = file22.allocatePage();
+			sprintf((char*)tmpbuf, "test.22 Page %d %7.1f", newPage.page_number(), (float)newPage.page_number());
+			rids[newPage.page_number()] = newPage.insertRecord(tmpbuf);
+			file22.writePage(newPage);
+		}
+
+		// pages are read from the last one down throughout, so that no readahead gets in
+		BufMgr* proBufMgr = new BufMgr(10, 1, BufMgr::CLOCK_PRO);
+		for (int round = 0; round < 2; round++) {
+			for (i = 3; i > 0; i--) {
+				proBufMgr->readPage(&file22, i, page);
+				proBufMgr->unPinPage(&file22, i, false);
+			}
+		}
+		for (i = 150; i > 50; i--) {
+			proBufMgr->readPage(&file22, i, page);
+			proBufMgr->unPinPage(&file22, i, false);
+		}
+		int reads = proBufMgr->getBufStats().diskreads;
+		for (i = 3; i > 0; i--) {
+			proBufMgr->readPage(&file22, i, page);
+			proBufMgr->unPinPage(&file22, i, false);
+		}
+		if (proBufMgr->getBufStats().diskreads != reads)
+		{
+			PRINT_ERROR("ERROR :: Pages used again during their test period should have outlived a scan under CLOCK-Pro.");
+		}
+		delete proBufMgr;
+
+		// pages read again soon after they were replaced during their test period give cold pages more frames
+		proBufMgr = new BufMgr(10, 1, BufMgr::CLOCK_PRO);
+		const int initialTarget = proBufMgr->getBufStats().adaptiveTarget;
+		for (i = 12; i > 0; i--) {
+			proBufMgr->readPage(&file22, i, page);
+			proBufMgr->unPinPage(&file22, i, false);
+		}
+		for (i = 12; i > 9; i--) {
+			proBufMgr->readPage(&file22, i, page);
+			proBufMgr->unPinPage(&file22, i, false);
+		}
+		if (proBufMgr->getBufStats().recentGhostHits != 3 || proBufMgr->getBufStats().adaptiveTarget <= initialTarget)
+		{
+			PRINT_ERROR("ERROR :: Test pages read again should have given cold pages more frames.");
+		}
+		delete proBufMgr;
+
+		// with every frame pinned there is nothing to replace
+		proBufMgr = new BufMgr(3, 1, BufMgr::CLOCK_PRO);
+		for (i = 3; i > 0; i--)
+			proBufMgr->readPage(&file22, i, page);
+		try
+		{
+			proBufMgr->readPage(&file22, 4, page);
+			PRINT_ERROR("ERROR :: No more frames left for allocation. Exception should have been thrown before execution reaches this point.");
+		}
+		catch(const BufferExceededException&)
+		{
+		}
+		for (i = 3; i > 0; i--)
+			proBufMgr->unPinPage(&file22, i, false);
+		delete proBufMgr;
+
+		// the hands run under the policy latch of a shard while hits only set reference bits, so several threads
+		// can share the buffer pool as with the clock
+		BufMgr* sharedBufMgr = new BufMgr(16, 2, BufMgr::CLOCK_PRO);
+		const int numThreads = 4;
+		std::atomic<bool> mismatch(false);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; t++) {
+			threads.push_back(std::thread([&, t]() {
+				char expected[100];
+				Page* threadPage;
+				for (PageId j = 0; j < 2000; j++) {
+					// every other read goes to a few hot pages, the others walk down the file
+					const PageId k = (j % 2 == 0) ? 1 + (j / 2 + t) % 4 : filePages - (j * 7 + t) % (filePages - 4);
+					sharedBufMgr->readPage(&file22, k, threadPage);
+					sprintf(expected, "test.22 Page %d %7.1f", k, (float)k);
+					if (strncmp(threadPage->getRecord(rids[k]).c_str(), expected, strlen(expected)) != 0)
+						mismatch = true;
+					sharedBufMgr->unPinPage(&file22, k, false);
+				}
+			}));
+		}
+		for (int t = 0; t < numThreads; t++)
+			threads[t].join();
+
+		if (mismatch)
+		{
+			PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+		}
+		delete sharedBufMgr;
+	}
+	File::remove(filename);
+
+	std::cout << "Test 27 passed" << "\n";
+}
+
+// slot BufHashTbl::hash() gives (file, pageNo) in a table with the given mask; kept in step with it so
+// that test28 can pick keys which collide
+std::size_t homeSlot(const File* file, const PageId pageNo, const std::size_t mask)
+{
+	std::uint64_t key = (std::uint64_t) (std::uintptr_t) file;
+	key ^= (std::uint64_t) pageNo * 0x9E3779B97F4A7C15ULL;
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDULL;
+	key ^= key >> 33;
+	key *= 0xC4CEB9FE1A85EC53ULL;
+	key ^= key >> 33;
+	return (std::size_t) key & mask;
+}
+
+void test28()
+{
+	// removing an entry from the middle of a probe cluster must leave the rest of the cluster reachable,
+	// also when the cluster wraps around the end of the table. A table for 4 entries has 8 slots, and
+	// keys with home slots 6, 7, 7 and 0 inserted in that order fill slots 6, 7, 0 and 1.
+	const std::size_t mask = 7;
+	const std::size_t homes[] = {6, 7, 7, 0};
+	PageId keys[4];
+	PageId next = 1;
+	for (int k = 0; k < 4; k++) {
+		while (homeSlot(file1ptr, next, mask) != homes[k])
+			next++;
+		keys[k] = next++;
+	}
+
+	FrameId frameNo;
+	for (int victim = 0; victim < 4; victim++) {
+		BufHashTbl hashTable(4);
+		for (int k = 0; k < 4; k++)
+			hashTable.insert(file1ptr, keys[k], k);
+
+		// take out the victim, then the entries after it in turn, so that every removal happens with
+		// entries left behind it in the cluster
+		for (int removed = victim; removed < 4; removed++) {
+			hashTable.remove(file1ptr, keys[removed]);
+			if (hashTable.find(file1ptr, keys[removed], frameNo))
+			{
+				PRINT_ERROR("ERROR :: A removed key should not be found in the hash table anymore.");
+			}
+			for (int k = 0; k < 4; k++) {
+				if (k >= victim && k <= removed)
+					continue;
+				if (!hashTable.find(file1ptr, keys[k], frameNo) || frameNo != (FrameId) k)
+				{
+					PRINT_ERROR("ERROR :: A key left in a probe cluster should still be found after a removal.");
+				}
+			}
+		}
+
+		// the freed slots take the keys back, and a key which is not there is reported as such
+		for (int k = victim; k < 4; k++)
+			hashTable.insert(file1ptr, keys[k], k);
+		for (int k = 0; k < 4; k++) {
+			if (!hashTable.find(file1ptr, keys[k], frameNo) || frameNo != (FrameId) k)
+			{
+				PRINT_ERROR("ERROR :: Keys inserted again after their removal should be found.");
+			}
+		}
+		try
+		{
+			hashTable.remove(file1ptr, next);
+			PRINT_ERROR("ERROR :: No exception thrown when removing a key which is not in the hash table.");
+		}
+		catch(const HashNotFoundException&)
+		{
+		}
+	}
+
+	std::cout << "Test 28 passed" << "\n";
+}
@@ -0,0 +1,39 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ Converts database files to the current on-disk format (see
+ File::FORMAT_VERSION). Files which are already current are left alone.
+
+ Build with "make tools" and run ./migrate_file <file>...
+*/
+
+#include <iostream>
+#include "file.h"
+#include "exceptions/badgerdb_exception.h"
+
+using namespace badgerdb;
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <file>...\n";
+    return 2;
+  }
+
+  int failed = 0;
+  for (int i = 1; i < argc; i++) {
+    try {
+      File::migrate(argv[i]);
+      std::cout << argv[i] << ": format version " << File::FORMAT_VERSION << "\n";
+    } catch (const BadgerDbException& e) {
+      std::cerr << argv[i] << ": " << e.message() << "\n";
+      failed = 1;
+    }
+  }
+  return failed;
+}
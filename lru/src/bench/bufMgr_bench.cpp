@@ -0,0 +1,107 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ Throughput of BufMgr::readPage + unPinPage on a working set that is
+ fully cached, for an increasing number of threads and of shards the
+ buffer pool is split into.
+
+ Build with "make bench" and run ./bufmgr_bench [max threads] [max shards]
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include "buffer.h"
+#include "exceptions/file_not_found_exception.h"
+
+using namespace badgerdb;
+
+namespace {
+
+const std::uint32_t POOL_FRAMES = 4096;
+const PageId WORKING_SET = 2048;
+const std::uint64_t OPS_PER_THREAD = 1000000;
+
+double runThreads(BufMgr& bufMgr, File& file, const std::vector<PageId>& pages, int numThreads) {
+  std::atomic<bool> start(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < numThreads; t++) {
+    threads.push_back(std::thread([&, t]() {
+      std::uint64_t seed = 88172645463325252ULL + t;
+      Page* page;
+      while (!start)
+        std::this_thread::yield();
+      for (std::uint64_t i = 0; i < OPS_PER_THREAD; i++) {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        const PageId pageNo = pages[seed % pages.size()];
+        bufMgr.readPage(&file, pageNo, page);
+        bufMgr.unPinPage(&file, pageNo, false);
+      }
+    }));
+  }
+
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+  start = true;
+  for (int t = 0; t < numThreads; t++)
+    threads[t].join();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  return numThreads * OPS_PER_THREAD / elapsed.count();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  int maxThreads = argc > 1 ? std::atoi(argv[1]) : 32;
+  int maxShards = argc > 2 ? std::atoi(argv[2]) : 64;
+  const std::string filename = "bench.db";
+
+  try {
+    File::remove(filename);
+  } catch (const FileNotFoundException&) {
+  }
+
+  {
+    File file = File::create(filename);
+    std::vector<PageId> pages(WORKING_SET);
+    Page* page;
+    for (PageId i = 0; i < WORKING_SET; i++) {
+      Page newPage = file.allocatePage();
+      pages[i] = newPage.page_number();
+    }
+
+    std::cout << " shards  threads     ops/s  speedup\n";
+    std::vector<double> unsharded;
+    for (int shards = 1; shards <= maxShards; shards *= 2) {
+      BufMgr bufMgr(POOL_FRAMES, shards);
+      // bring the working set into the buffer pool
+      for (PageId i = 0; i < WORKING_SET; i++) {
+        bufMgr.readPage(&file, pages[i], page);
+        bufMgr.unPinPage(&file, pages[i], false);
+      }
+
+      int run = 0;
+      for (int threads = 1; threads <= maxThreads; threads *= 2, run++) {
+        double throughput = runThreads(bufMgr, file, pages, threads);
+        if (shards == 1)
+          unsharded.push_back(throughput);
+        // speedup over the unsharded pool with the same number of threads
+        std::cout << std::setw(7) << shards << std::setw(9) << threads << std::setw(10) << std::fixed
+                  << std::setprecision(0) << throughput << std::setw(9) << std::setprecision(2)
+                  << throughput / unsharded[run] << "\n";
+      }
+    }
+  }
+
+  File::remove(filename);
+  return 0;
+}
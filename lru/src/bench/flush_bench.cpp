@@ -0,0 +1,76 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ Time BufMgr::flushFile takes to write back a buffer pool full of dirty
+ pages which were read in random order, so that frame order and page order
+ have nothing in common, followed by File::sync to get them to disk.
+
+ Build with "make bench" and run ./flush_bench [pages]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include "buffer.h"
+#include "exceptions/file_not_found_exception.h"
+
+using namespace badgerdb;
+
+int main(int argc, char* argv[])
+{
+  PageId numPages = argc > 1 ? std::atoi(argv[1]) : 100000;
+  const std::string filename = "bench.db";
+  const char* names[] = {"fstream", "pread"};
+  const File::IoBackend backends[] = {File::STREAM_IO, File::POSITIONAL_IO};
+  std::mt19937 random(42);
+
+  std::cout << "backend     pages  flush s   sync s   MB/s\n";
+  for (int b = 0; b < 2; b++) {
+    try {
+      File::remove(filename);
+    } catch (const FileNotFoundException&) {
+    }
+
+    {
+      File file = File::create(filename, backends[b]);
+      std::vector<PageId> pages(numPages);
+      for (PageId i = 0; i < numPages; i++)
+        pages[i] = file.allocatePage().page_number();
+      file.sync();
+      std::shuffle(pages.begin(), pages.end(), random);
+
+      BufMgr bufMgr(numPages);
+      Page* page;
+      for (PageId i = 0; i < numPages; i++) {
+        bufMgr.readPage(&file, pages[i], page);
+        page->insertRecord("dirty");
+        bufMgr.unPinPage(&file, pages[i], true);
+      }
+
+      typedef std::chrono::steady_clock Clock;
+      Clock::time_point begin = Clock::now();
+      bufMgr.flushFile(&file);
+      Clock::time_point flushed = Clock::now();
+      file.sync();
+      Clock::time_point synced = Clock::now();
+      std::chrono::duration<double> flush = flushed - begin;
+      std::chrono::duration<double> sync = synced - flushed;
+      std::cout << std::setw(7) << names[b] << std::setw(10) << numPages << std::fixed << std::setprecision(3)
+                << std::setw(9) << flush.count() << std::setw(9) << sync.count() << std::setprecision(0)
+                << std::setw(7) << numPages * (double) Page::SIZE / (1 << 20) / (flush.count() + sync.count())
+                << "\n";
+    }
+  }
+
+  File::remove(filename);
+  return 0;
+}
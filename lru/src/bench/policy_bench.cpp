@@ -0,0 +1,123 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ Hit ratio and throughput of the replacement policies on a few access
+ traces over a file sixteen times the size of the buffer pool:
+
+ - point:  random reads, 90 % of them to a hot set of half the pool
+ - mixed:  the point reads, with a scan of twice the pool after every
+           2000 of them
+ - shift:  the hot set moves to another part of the file every 20000
+           reads, with scans of the whole pool in between
+ - loop:   the same scan of one and a half times the pool, over and over
+
+ Scans run from the last page down, so no readahead runs in the
+ background and the hit ratio only depends on the policy.
+
+ Build with "make bench" and run ./policy_bench [pool frames] [accesses]
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include "buffer.h"
+#include "exceptions/file_not_found_exception.h"
+
+using namespace badgerdb;
+
+namespace {
+
+/*
+ Builds the page numbers a trace reads, in order.
+*/
+std::vector<PageId> makeTrace(int kind, std::uint32_t frames, PageId filePages, std::uint64_t accesses) {
+  std::vector<PageId> trace;
+  std::uint64_t seed = 88172645463325252ULL;
+  const PageId hot = frames / 2;
+  PageId hotBase = 1;
+  std::uint64_t points = 0;
+
+  while (trace.size() < accesses) {
+    if (kind == 3) {
+      for (PageId p = frames * 3 / 2; p > 0 && trace.size() < accesses; p--)
+        trace.push_back(p);
+      continue;
+    }
+
+    seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+    if (seed % 10 != 0)
+      trace.push_back(hotBase + (seed >> 8) % hot);
+    else
+      trace.push_back(1 + (seed >> 8) % (filePages - 1));
+    points++;
+
+    if (kind == 1 && points % 2000 == 0) {
+      const PageId start = 1 + (seed >> 20) % (filePages - 2 * frames);
+      for (PageId p = start + 2 * frames; p > start; p--)
+        trace.push_back(p);
+    }
+    if (kind == 2 && points % 20000 == 0) {
+      hotBase = 1 + (hotBase + 4 * frames) % (filePages - hot - 1);
+      const PageId start = 1 + (seed >> 20) % (filePages - frames);
+      for (PageId p = start + frames; p > start; p--)
+        trace.push_back(p);
+    }
+  }
+  trace.resize(accesses);
+  return trace;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  std::uint32_t frames = argc > 1 ? std::atoi(argv[1]) : 1024;
+  std::uint64_t accesses = argc > 2 ? std::atoll(argv[2]) : 400000;
+  const PageId filePages = 16 * frames;
+  const std::string filename = "bench.db";
+  const char* traces[] = {"point", "mixed", "shift", "loop"};
+  const char* names[] = {"LRU", "LRU-K", "ARC", "2Q"};
+  const BufMgr::Policy policies[] = {BufMgr::LRU, BufMgr::LRU_K, BufMgr::ARC, BufMgr::TWO_Q};
+  const int numPolicies = sizeof(policies) / sizeof(policies[0]);
+
+  try {
+    File::remove(filename);
+  } catch (const FileNotFoundException&) {
+  }
+
+  {
+    File file = File::create(filename);
+    for (PageId i = 0; i < filePages; i++)
+      file.allocatePage();
+
+    std::cout << "pool " << frames << " frames, file " << filePages << " pages, " << accesses << " accesses\n";
+    std::cout << "trace   policy   hit ratio     ops/s\n";
+    for (int t = 0; t < 4; t++) {
+      std::vector<PageId> trace = makeTrace(t, frames, filePages, accesses);
+      for (int p = 0; p < numPolicies; p++) {
+        BufMgr bufMgr(frames, 1, policies[p]);
+        Page* page;
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < trace.size(); i++) {
+          bufMgr.readPage(&file, trace[i], page);
+          bufMgr.unPinPage(&file, trace[i], false);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        const BufStats stats = bufMgr.getBufStats();
+        std::cout << std::left << std::setw(8) << traces[t] << std::setw(9) << names[p] << std::right << std::fixed
+                  << std::setw(8) << std::setprecision(1) << 100.0 * (stats.accesses - stats.diskreads) / stats.accesses
+                  << " %" << std::setw(10) << std::setprecision(0) << trace.size() / elapsed.count() << "\n";
+      }
+    }
+  }
+
+  File::remove(filename);
+  return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+ Hit ratio of random reads of a small working set ("OLTP" reads) while
+ a scan reads, or a bulk load writes, a file ten times the size of the
+ buffer pool, with and without a BufStrategy. One OLTP read follows
+ every page the scan goes through.
+
+ The scan runs forward. Without a strategy it reads ahead in the
+ background, so an OLTP read counts as a miss when it adds a page of the
+ working set to the buffer pool rather than by the disk reads around it.
+
+ Build with "make bench" and run ./scan_bench [pool frames] [working set pages]
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include "buffer.h"
+#include "exceptions/file_not_found_exception.h"
+
+using namespace badgerdb;
+
+namespace {
+
+struct Result {
+  double hitRatio;
+  double seconds;
+  int writes;
+};
+
+Result run(File& hotFile, File& scanFile, std::uint32_t frames, PageId hot, PageId scan,
+           bool load, BufStrategy* strategy) {
+  BufMgr bufMgr(frames);
+  Page* page;
+  // bring the working set into the buffer pool
+  for (PageId i = 1; i <= hot; i++) {
+    bufMgr.readPage(&hotFile, i, page);
+    bufMgr.unPinPage(&hotFile, i, false);
+  }
+  bufMgr.clearBufStats();
+
+  std::uint64_t seed = 88172645463325252ULL;
+  int misses = 0;
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+  for (PageId n = 0; n < scan; n++) {
+    if (load) {
+      PageId pageNo;
+      bufMgr.allocPage(&scanFile, pageNo, page, strategy);
+      bufMgr.unPinPage(&scanFile, pageNo, true, strategy);
+    } else {
+      bufMgr.readPage(&scanFile, n + 1, page, strategy);
+      bufMgr.unPinPage(&scanFile, n + 1, false, strategy);
+    }
+
+    seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+    const PageId pageNo = 1 + seed % hot;
+    std::uint32_t before, after, dirty;
+    bufMgr.getFileStats(&hotFile, before, dirty);
+    bufMgr.readPage(&hotFile, pageNo, page);
+    bufMgr.unPinPage(&hotFile, pageNo, false);
+    bufMgr.getFileStats(&hotFile, after, dirty);
+    misses += after > before;
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+  Result result;
+  result.hitRatio = 1.0 - (double) misses / scan;
+  result.seconds = elapsed.count();
+  result.writes = bufMgr.getBufStats().diskwrites;
+  return result;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  std::uint32_t frames = argc > 1 ? std::atoi(argv[1]) : 1024;
+  PageId hot = argc > 2 ? std::atoi(argv[2]) : frames / 2;
+  const PageId scan = 10 * frames;
+  const std::string hotName = "bench.db";
+  const std::string scanName = "bench_scan.db";
+
+  for (int f = 0; f < 2; f++) {
+    try {
+      File::remove(f == 0 ? hotName : scanName);
+    } catch (const FileNotFoundException&) {
+    }
+  }
+
+  {
+    File hotFile = File::create(hotName);
+    File scanFile = File::create(scanName);
+    for (PageId i = 0; i < hot; i++)
+      hotFile.allocatePage();
+    for (PageId i = 0; i < scan; i++)
+      scanFile.allocatePage();
+
+    std::cout << "pool " << frames << " frames, working set " << hot << " pages, " << scan << " pages scanned\n";
+    std::cout << "access  strategy    OLTP hits  writes  seconds\n";
+    for (int load = 0; load < 2; load++) {
+      for (int s = 0; s < 2; s++) {
+        BufStrategy strategy(load ? BufStrategy::BULK_WRITE : BufStrategy::BULK_READ);
+        Result result = run(hotFile, scanFile, frames, hot, scan, load, s ? &strategy : NULL);
+        std::cout << std::left << std::setw(8) << (load ? "load" : "scan")
+                  << std::setw(12) << (s == 0 ? "none" : load ? "BULK_WRITE" : "BULK_READ")
+                  << std::right << std::fixed << std::setw(8) << std::setprecision(1) << 100 * result.hitRatio << " %"
+                  << std::setw(8) << result.writes << std::setw(9) << std::setprecision(3) << result.seconds << "\n";
+      }
+    }
+  }
+
+  File::remove(hotName);
+  File::remove(scanName);
+  return 0;
+}
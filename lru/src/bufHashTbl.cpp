@@ -7,6 +7,8 @@
 
 #include <memory>
 #include <iostream>
+#include <cstdint>
+#include <cstdlib>
 #include "buffer.h"
 #include "bufHashTbl.h"
 #include "exceptions/hash_already_present_exception.h"
@@ -15,91 +17,105 @@
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo) {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+std::size_t BufHashTbl::hash(const File* file, const PageId pageNo) const {
+  // mix all bits of the file pointer and the page number (murmur3 finalizer),
+  // so that consecutive pages of one file and pages of different files spread
+  // evenly over the table
+  std::uint64_t key = (std::uint64_t) (std::uintptr_t) file;
+  key ^= (std::uint64_t) pageNo * 0x9E3779B97F4A7C15ULL;
+  key ^= key >> 33;
+  key *= 0xFF51AFD7ED558CCDULL;
+  key ^= key >> 33;
+  key *= 0xC4CEB9FE1A85EC53ULL;
+  key ^= key >> 33;
+  return (std::size_t) key & mask;
 }
 
-BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
+std::size_t BufHashTbl::probe(const File* file, const PageId pageNo) const {
+  std::size_t index = hash(file, pageNo);
+  while (ht[index].file != NULL &&
+         (ht[index].file != file || ht[index].pageNo != pageNo))
+    index = (index + 1) & mask;
+  return index;
+}
+
+BufHashTbl::BufHashTbl(const std::size_t maxEntries)
+	: maxEntries(maxEntries), numEntries(0)
 {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  // smallest power of two which keeps the load factor at or below 1/2
+  HTSIZE = 8;
+  while (HTSIZE < maxEntries * 2)
+    HTSIZE *= 2;
+  mask = HTSIZE - 1;
+
+  // allocate all the slots up front, aligned so that a slot never straddles
+  // two cache lines
+  void* mem = NULL;
+  if (posix_memalign(&mem, 64, HTSIZE * sizeof(hashBucket)) != 0)
+    throw HashTableException();
+  ht = static_cast<hashBucket*>(mem);
+  for (std::size_t i = 0; i < HTSIZE; i++) {
+    ht[i].file = NULL;
+    ht[i].pageNo = Page::INVALID_NUMBER;
+    ht[i].frameNo = 0;
+  }
 }
 
 BufHashTbl::~BufHashTbl() {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
-  }
-  delete [] ht;
+  free(ht);
 }
 
 void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo) {
-  int index = hash(file, pageNo);
+  std::size_t index = probe(file, pageNo);
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
-  }
+  if (ht[index].file != NULL)
+    throw HashAlreadyPresentException(ht[index].file->filename(), ht[index].pageNo, ht[index].frameNo);
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-  	throw HashTableException();
+  if (numEntries >= maxEntries)
+    throw HashTableException();
 
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+  ht[index].file = file;
+  ht[index].pageNo = pageNo;
+  ht[index].frameNo = frameNo;
+  numEntries++;
 }
 
 void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
-    }
-    tmpBuc = tmpBuc->next;
-  }
-  throw HashNotFoundException(file->filename(), pageNo);
+  if (!find(file, pageNo, frameNo))
+    throw HashNotFoundException(file->filename(), pageNo);
 }
 
-void BufHashTbl::remove(const File* file, const PageId pageNo) {
-
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
+bool BufHashTbl::find(const File* file, const PageId pageNo, FrameId &frameNo) const {
+  std::size_t index = probe(file, pageNo);
+  if (ht[index].file == NULL)
+    return false;
+  frameNo = ht[index].frameNo; // return frameNo by reference
+  return true;
+}
 
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
-      if(prevBuc) 
-	 prevBuc->next = tmpBuc->next;
-      else
-	 ht[index] = tmpBuc->next;
+void BufHashTbl::remove(const File* file, const PageId pageNo) {
 
-      delete tmpBuc;
-      return;
-    }
-    else {
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
+  std::size_t hole = probe(file, pageNo);
+  if (ht[hole].file == NULL)
+    throw HashNotFoundException(file->filename(), pageNo);
+
+  // backward shift deletion: pull later entries of the cluster into the hole
+  // whenever the hole lies between their home slot and their current slot
+  std::size_t index = hole;
+  for (;;) {
+    index = (index + 1) & mask;
+    if (ht[index].file == NULL)
+      break;
+    std::size_t home = hash(ht[index].file, ht[index].pageNo);
+    if (((index - home) & mask) >= ((index - hole) & mask)) {
+      ht[hole] = ht[index];
+      hole = index;
     }
   }
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  ht[hole].file = NULL;
+  ht[hole].pageNo = Page::INVALID_NUMBER;
+  numEntries--;
 }
 
 }
@@ -7,18 +7,22 @@
 
 #pragma once
 
+#include <cstddef>
 #include "file.h"
 
 namespace badgerdb {
 
 /**
 * @brief Declarations for buffer pool hash table
+*
+* One slot of the open-addressing table. Slots are 16 bytes, so four of them
+* share a 64 byte cache line.
 */
 struct hashBucket {
 	/**
-	 * pointer a file object (more on this below)
+	 * pointer a file object (more on this below), NULL if the slot is empty
 	 */
-	File *file;
+	const File *file;
 
 	/**
 	 * page number within a file
@@ -29,30 +33,48 @@ struct hashBucket {
 	 * frame number of page in the buffer pool
 	 */
 	FrameId frameNo;
-
-	/**
-	 * Next node in the hash table
-	 */
-	hashBucket*   next;
 };
 
 
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
+* The table uses open addressing with linear probing over a single array of
+* slots which is allocated once, aligned to a cache line, and sized from the
+* number of frames in the buffer pool so the load factor stays at or below 1/2.
+* Inserting and removing entries never allocates or frees memory. Removal
+* uses backward shift deletion, so no tombstones are left behind and probe
+* sequences stay short no matter how many pages were evicted.
+*
 * @warning This class is not threadsafe.
 */
 class BufHashTbl
 {
  private:
 	/**
-	 *	Size of Hash Table
+	 *	Size of Hash Table (number of slots, always a power of two)
+	 */
+  std::size_t HTSIZE;
+
+	/**
+	 *	HTSIZE - 1, used to wrap slot indices
 	 */
-  int HTSIZE;
+  std::size_t mask;
+
+	/**
+	 *	Maximum number of entries the table accepts
+	 */
+  std::size_t maxEntries;
+
+	/**
+	 *	Number of entries currently in the table
+	 */
+  std::size_t numEntries;
+
 	/**
 	 * Actual Hash table object
 	 */
-  hashBucket**  ht;
+  hashBucket*  ht;
 
 	/**
 	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
@@ -61,19 +83,30 @@ class BufHashTbl
 	 * @param pageNo  Page number in the file
 	 * @return  			Hash value.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  std::size_t hash(const File* file, const PageId pageNo) const;
+
+	/**
+	 * returns the slot holding (file, pageNo), or the empty slot that ends its probe sequence
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			Slot index.
+	 */
+  std::size_t probe(const File* file, const PageId pageNo) const;
 
  public:
 	/**
    * Constructor of BufHashTbl class
+	 *
+	 * @param maxEntries	Maximum number of entries kept in the table, normally the number of buffer frames
 	 */
-	BufHashTbl(const int htSize);  // constructor
+	BufHashTbl(const std::size_t maxEntries);  // constructor
 
 	/**
    * Destructor of BufHashTbl class
 	 */
   ~BufHashTbl(); // destructor
-	
+
 	/**
    * Insert entry into hash table mapping (file, pageNo) to frameNo.
 	 *
@@ -81,7 +114,7 @@ class BufHashTbl
 	 * @param pageNo 	Page number in the file
 	 * @param frameNo Frame number assigned to that page of the file
    * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as running of memory
+   * @throws  HashTableException if the table already holds the maximum number of entries
 	 */
   void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
@@ -92,18 +125,30 @@ class BufHashTbl
 	 * @param file  	File object
 	 * @param pageNo	Page number in the file
 	 * @param frameNo Frame number reference
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+   * @throws HashNotFoundException if the page entry is not found in the hash table
 	 */
   void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
 
+	/**
+   * Check if (file, pageNo) is currently in the buffer pool (ie. in
+   * the hash table) without throwing. This is the variant to use on the
+   * buffer manager's hit/miss path, where a miss is not an error.
+	 *
+	 * @param file  	File object
+	 * @param pageNo	Page number in the file
+	 * @param frameNo Frame number reference, only set if the entry is found
+	 * @return  			True if the page entry was found, false otherwise.
+	 */
+  bool find(const File* file, const PageId pageNo, FrameId &frameNo) const;
+
 	/**
    * Delete entry (file,pageNo) from hash table.
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+   * @throws HashNotFoundException if the page entry is not found in the hash table
 	 */
-  void remove(const File* file, const PageId pageNo);  
+  void remove(const File* file, const PageId pageNo);
 };
 
 }
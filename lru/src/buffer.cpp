@@ -5,8 +5,12 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <new>
 #include <iostream>
+#include <sys/mman.h>
 #include "buffer.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
@@ -16,21 +20,61 @@
 
 namespace badgerdb {
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
+BufMgr::BufMgr(std::uint32_t bufs, std::uint32_t shards, Policy policy)
+	: numBufs(bufs), policy(policy), cleanerStop(false), cleanTarget(0), prefetchStop(false), prefetchFile(NULL), readaheadEnabled(true) {
 	bufDescTable = new BufDesc[bufs];
+	frameState = new std::atomic<std::uint64_t>[bufs];
 
   for (FrameId i = 0; i < bufs; i++) {
   	bufDescTable[i].frameNo = i;
-  	bufDescTable[i].valid = false;
+  	bufDescTable[i].state = &frameState[i];
+  	bufDescTable[i].Clear();
   }
 
-  bufPool = new Page[bufs];
+  //the frames live in one anonymous mapping, which the kernel only backs with memory once a
+  //frame is used; it is rounded up to 2 MB so that it can be put on huge pages
+  const std::size_t hugePage = 2 * 1024 * 1024;
+  arenaSize = ((std::size_t) bufs * Page::SIZE + hugePage - 1) / hugePage * hugePage;
+  void* arena = mmap(NULL, arenaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (arena == MAP_FAILED)
+    throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+  madvise(arena, arenaSize, MADV_HUGEPAGE);
+#endif
+  frameArena = static_cast<char*>(arena);
 
-  int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+  //every page of the pool is a view over its frame
+  bufPool = static_cast<Page*>(::operator new(bufs * sizeof(Page)));
+  for (FrameId i = 0; i < bufs; i++)
+    new (&bufPool[i]) Page(frameArena + (std::size_t) i * Page::SIZE);
 
-  clockHand = bufs - 1;
+  //every shard needs at least one frame
+  numShards = std::max(1u, std::min(shards, bufs));
+  framesPerShard = bufs / numShards;
+  this->shards = new BufShard[numShards];
+  for (std::uint32_t s = 0; s < numShards; s++) {
+  	BufShard& shard = this->shards[s];
+  	shard.firstFrame = s * framesPerShard;
+  	shard.numBufs = (s == numShards - 1) ? bufs - shard.firstFrame : framesPerShard;
+  	shard.hashTable = new BufHashTbl (shard.numBufs);  // allocate the buffer hash table, one entry per frame
+  	shard.prefetchClaims = 0;
+  	shard.prefetchEvents = 0;
+
+  	shard.lru.head = shard.lru.tail = BufDesc::INVALID_FRAME;
+  	shard.lru.pages = 0;
+  	shard.lruFrequent.head = shard.lruFrequent.tail = BufDesc::INVALID_FRAME;
+  	shard.lruFrequent.pages = 0;
+  	shard.arcTarget = 0;
+  	shard.refClock = 0;
+  	//every frame starts out empty, so every frame goes on the free list, the lowest frame on top
+  	shard.freeHead = BufDesc::INVALID_FRAME;
+  	shard.numFree = 0;
+  	for (FrameId i = shard.firstFrame + shard.numBufs; i-- > shard.firstFrame; )
+  		freePush(shard, i);
+  }
+  setTwoQSizes(TWOQ_IN_FRACTION, TWOQ_OUT_FRACTION);
+  //pages of a File object which is closed are not read ahead anymore, since the prefetcher would use it after it is gone
+  closeHook = File::addCloseHook([this](const File* file) { cancelPrefetch(file); });
 }
 
 /*
@@ -38,135 +82,1117 @@ BufMgr::BufMgr(std::uint32_t bufs)
  allocated for buf description and the hashtable.
 */
 BufMgr::~BufMgr() {
+  File::removeCloseHook(closeHook);
+  stopPrefetcher();
+  stopCleaner();
+  //writes the dirty pages back file by file, sorted by page number
+  std::vector<FrameId> dirty;
   for(FrameId i =0; i<numBufs;i++){
-    if(bufDescTable[i].dirty == true)
-      bufDescTable[i].file->writePage(bufPool[i]);
+    if(frameState[i] & BufDesc::DIRTY)
+      dirty.push_back(i);
+    }
+  std::sort(dirty.begin(), dirty.end(), [this](FrameId a, FrameId b) {
+    return bufDescTable[a].file < bufDescTable[b].file;
+  });
+  std::vector<const Page*> pages;
+  for(std::size_t i = 0; i < dirty.size(); i++){
+    pages.push_back(&bufPool[dirty[i]]);
+    if(i + 1 == dirty.size() || bufDescTable[dirty[i + 1]].file != bufDescTable[dirty[i]].file){
+      bufDescTable[dirty[i]].file->writePages(pages.data(), pages.size());
+      pages.clear();
+    }
+  }
+  delete[] bufDescTable;
+  delete[] frameState;
+  for (FrameId i = 0; i < numBufs; i++)
+    bufPool[i].~Page();
+  ::operator delete(bufPool);
+  munmap(frameArena, arenaSize);
+  for (std::uint32_t s = 0; s < numShards; s++)
+    delete shards[s].hashTable;
+  delete[] shards;
+}
+
+/*
+ Pages are spread over the shards by a multiplicative hash of the
+ file pointer and the page number. The high bits are used, so the
+ choice of shard does not correlate with the slot the page gets
+ in the hash table of the shard.
+*/
+BufShard& BufMgr::pageShard(const File* file, const PageId pageNo) {
+    if(numShards==1)
+        return shards[0];
+    std::uint64_t key=(std::uint64_t)(std::uintptr_t)file ^ ((std::uint64_t)pageNo << 32 | pageNo);
+    key*=0x9E3779B97F4A7C15ULL;
+    return shards[(key >> 32) % numShards];
+}
+
+BufShard& BufMgr::frameShard(FrameId frame) {
+    return shards[std::min(frame / framesPerShard, numShards - 1)];
+}
+
+/*
+ Links the frame at the front of the list of frames of its file
+ in the shard, starting the list if it is the first page of the
+ file there.
+*/
+void BufMgr::fileLink(BufShard& shard, FrameId frame) {
+    BufDesc& desc=bufDescTable[frame];
+    std::pair<std::unordered_map<const File*, FrameId>::iterator, bool> entry=
+        shard.fileFrames.insert(std::make_pair((const File*) desc.file,frame));
+
+    desc.filePrev=BufDesc::INVALID_FRAME;
+    desc.fileNext=BufDesc::INVALID_FRAME;
+    if(!entry.second){
+        desc.fileNext=entry.first->second;
+        bufDescTable[desc.fileNext].filePrev=frame;
+        entry.first->second=frame;
+    }
+}
+
+/*
+ Takes the frame out of the list of frames of its file in
+ constant time. The list is dropped once it is empty, so the
+ shard keeps no entry for a file without pages in it.
+*/
+void BufMgr::fileUnlink(BufShard& shard, FrameId frame) {
+    BufDesc& desc=bufDescTable[frame];
+
+    if(desc.filePrev!=BufDesc::INVALID_FRAME)
+        bufDescTable[desc.filePrev].fileNext=desc.fileNext;
+    else if(desc.fileNext!=BufDesc::INVALID_FRAME)
+        shard.fileFrames[desc.file]=desc.fileNext;
+    else
+        shard.fileFrames.erase(desc.file);
+    if(desc.fileNext!=BufDesc::INVALID_FRAME)
+        bufDescTable[desc.fileNext].filePrev=desc.filePrev;
+    desc.filePrev=desc.fileNext=BufDesc::INVALID_FRAME;
+}
+
+void BufMgr::residentFrames(const File* file, std::vector<FrameId>& frames) {
+    for(std::uint32_t s=0;s<numShards;s++){
+        std::shared_lock<std::shared_mutex> tableLock(shards[s].tableLatch);
+        std::unordered_map<const File*, FrameId>::const_iterator entry=shards[s].fileFrames.find(file);
+        if(entry==shards[s].fileFrames.end())
+            continue;
+        for(FrameId i=entry->second;i!=BufDesc::INVALID_FRAME;i=bufDescTable[i].fileNext)
+            frames.push_back(i);
+    }
+}
+
+/*
+ Pushes the empty frame on the free list of its shard, unless
+ it is on the list already.
+*/
+void BufMgr::freePush(BufShard& shard, FrameId frame) {
+    BufDesc& desc=bufDescTable[frame];
+
+    if(desc.onFreeList)
+        return;
+    desc.freeNext=shard.freeHead;
+    shard.freeHead=frame;
+    desc.onFreeList=true;
+    shard.numFree++;
+}
+
+/*
+ Pops frames off the free list of the shard until one can be
+ claimed. A frame on the list may have been claimed by an
+ eviction in the meantime; such entries are simply dropped.
+*/
+bool BufMgr::freePop(BufShard& shard, FrameId & frame) {
+    while(shard.freeHead!=BufDesc::INVALID_FRAME){
+        FrameId candidate=shard.freeHead;
+        BufDesc& desc=bufDescTable[candidate];
+        shard.freeHead=desc.freeNext;
+        desc.freeNext=BufDesc::INVALID_FRAME;
+        desc.onFreeList=false;
+        shard.numFree--;
+
+        std::uint64_t empty=0;
+        if(frameState[candidate].compare_exchange_strong(empty,1)){
+            frame=candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ Unlinks the frame from its LRU list in constant time.
+*/
+void BufMgr::lruRemove(FrameId frame) {
+    BufDesc& desc=bufDescTable[frame];
+    FrameList& list=*desc.lruList;
+
+    if(desc.lruPrev!=BufDesc::INVALID_FRAME)
+        bufDescTable[desc.lruPrev].lruNext=desc.lruNext;
+    else
+        list.head=desc.lruNext;
+
+    if(desc.lruNext!=BufDesc::INVALID_FRAME)
+        bufDescTable[desc.lruNext].lruPrev=desc.lruPrev;
+    else
+        list.tail=desc.lruPrev;
+
+    desc.lruPrev=desc.lruNext=BufDesc::INVALID_FRAME;
+    desc.inLru=false;
+}
+
+/*
+ Links the frame at the most recently used end of its LRU list.
+*/
+void BufMgr::lruPushBack(FrameId frame) {
+    BufDesc& desc=bufDescTable[frame];
+    FrameList& list=*desc.lruList;
+
+    desc.lruPrev=list.tail;
+    desc.lruNext=BufDesc::INVALID_FRAME;
+    if(list.tail!=BufDesc::INVALID_FRAME)
+        bufDescTable[list.tail].lruNext=frame;
+    else
+        list.head=frame;
+    list.tail=frame;
+    desc.inLru=true;
+}
+
+/*
+ Links the frame at the least recently used end of its LRU list.
+*/
+void BufMgr::lruPushFront(FrameId frame) {
+    BufDesc& desc=bufDescTable[frame];
+    FrameList& list=*desc.lruList;
+
+    desc.lruPrev=BufDesc::INVALID_FRAME;
+    desc.lruNext=list.head;
+    if(list.head!=BufDesc::INVALID_FRAME)
+        bufDescTable[list.head].lruPrev=frame;
+    else
+        list.tail=frame;
+    list.head=frame;
+    desc.inLru=true;
+}
+
+/*
+ The page counts of the lists include pinned frames, so they are
+ kept up to date here rather than when frames are linked.
+*/
+void BufMgr::lruSetList(FrameId frame, FrameList* list) {
+    BufDesc& desc=bufDescTable[frame];
+    if(desc.inLru)
+        lruRemove(frame);
+    if(desc.lruList!=NULL)
+        desc.lruList->pages--;
+    desc.lruList=list;
+    if(list!=NULL)
+        list->pages++;
+}
+
+/*
+ The key of a frame in the LRU-K order is fixed while it is in
+ there; its reference times only change while it is out.
+*/
+void BufMgr::lruKInsert(BufShard& shard, FrameId frame) {
+    BufDesc& desc=bufDescTable[frame];
+    shard.lruKOrder.insert(std::make_tuple(desc.refTimes[BufDesc::LRU_K-1],desc.refTimes[0],frame));
+    desc.inLruK=true;
+}
+
+void BufMgr::lruKRemove(BufShard& shard, FrameId frame) {
+    BufDesc& desc=bufDescTable[frame];
+    shard.lruKOrder.erase(std::make_tuple(desc.refTimes[BufDesc::LRU_K-1],desc.refTimes[0],frame));
+    desc.inLruK=false;
+}
+
+/*
+ A page remembered by ARC goes straight to the list of pages used
+ more than once. A hit in B1 means T1 was too short to keep the
+ page, so the target of T1 grows; a hit in B2 shrinks it. The step
+ is larger the smaller the ghost list hit is compared to the other.
+*/
+void BufMgr::arcLoaded(BufShard& shard, FrameId frame, const File* file, const PageId pageNo) {
+    const std::uint32_t recent=shard.arcRecentGhosts.size();
+    const std::uint32_t frequent=shard.arcFrequentGhosts.size();
+    std::uint32_t target=shard.arcTarget;
+
+    if(shard.arcRecentGhosts.erase(file,pageNo)){
+        target=std::min(shard.numBufs,target+std::max(1u,frequent/recent));
+        shard.bufStats.recentGhostHits++;
+        lruSetList(frame,&shard.lruFrequent);
+    }else if(shard.arcFrequentGhosts.erase(file,pageNo)){
+        const std::uint32_t step=std::max(1u,recent/frequent);
+        target=(target>step) ? target-step : 0;
+        shard.bufStats.frequentGhostHits++;
+        lruSetList(frame,&shard.lruFrequent);
+    }else{
+        lruSetList(frame,&shard.lru);
+    }
+    shard.arcTarget=target;
+    //a page read ahead has not been used yet, its first use does not count as a second one
+    bufDescTable[frame].arcUnused=(frameState[frame] & BufDesc::PREFETCHED)!=0;
+    arcTrim(shard);
+}
+
+/*
+ ARC remembers no more pages used once, resident or not, than the
+ shard has frames, and no more pages in all than twice that.
+*/
+void BufMgr::arcTrim(BufShard& shard) {
+    while(shard.arcRecentGhosts.size()>0 && shard.lru.pages+shard.arcRecentGhosts.size()>shard.numBufs)
+        shard.arcRecentGhosts.popFront();
+    while(shard.lru.pages+shard.lruFrequent.pages+shard.arcRecentGhosts.size()+shard.arcFrequentGhosts.size()
+          >2*shard.numBufs){
+        if(shard.arcFrequentGhosts.size()>0)
+            shard.arcFrequentGhosts.popFront();
+        else
+            shard.arcRecentGhosts.popFront();
     }
-  free(bufDescTable);
-  delete[] bufPool;
-  free(hashTable);
 }
 
 /*
- Increment the clockhand within the circular buffer pool .
+ A pinned page can not be replaced, so it leaves the LRU list,
+ unless it is in the FIFO queue of 2Q. Under ARC a page of T1 used again moves to T2, unless it was read
+ ahead and this is its first use, or only a strategy used it.
 */
-void BufMgr::advanceClock() {
-    clockHand++;
-    clockHand=clockHand%numBufs;
+void BufMgr::framePinned(FrameId frame) {
+    BufShard& shard=frameShard(frame);
+    BufDesc& desc=bufDescTable[frame];
+    std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+    //2Q leaves the pages of its FIFO queue in place, so hits do not change their order
+    if(desc.inLru && !(policy==TWO_Q && desc.lruList==&shard.lru))
+        lruRemove(frame);
+    if(desc.inLruK)
+        lruKRemove(shard,frame);
+    if(policy==ARC && desc.lruList==&shard.lru){
+        if(desc.arcUnused)
+            desc.arcUnused=false;
+        else if(frameState[frame] & BufDesc::REFBIT)
+            lruSetList(frame,&shard.lruFrequent);
+    }
+}
+
+/*
+ Once the last pin is released the page becomes the most recently
+ used candidate for replacement of its list, or the least recently
+ used one if only a scan needed it. Empty frames are kept on the
+ free list instead.
+
+ 2Q links a page of its FIFO queue only when it is not linked
+ yet, which keeps the queue in load order.
+
+ LRU-K records the release as a reference of the page, so pins
+ which overlap count as one. Pages read ahead and not used yet
+ are not referenced, and pages only a scan used lose their
+ reference times, so they go first.
+
+ The pin is dropped before the policy latch is taken, so by then
+ the frame may be pinned again, or even replaced and loaded with
+ another page. Whoever holds it now links it when done with it.
+*/
+void BufMgr::frameUnpinned(FrameId frame, bool cold) {
+    BufShard& shard=frameShard(frame);
+    BufDesc& desc=bufDescTable[frame];
+    std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+    const std::uint64_t state=frameState[frame];
+    //pinned again, or replaced and not loaded yet, in which case frameLoaded() has not picked its list
+    if(BufDesc::pinCount(state)>0 || (policy!=LRU_K && (state & BufDesc::VALID) && desc.lruList==NULL))
+        return;
+    //a page of the FIFO queue of 2Q which is still linked keeps its place
+    if(policy==TWO_Q && desc.inLru && desc.lruList==&shard.lru && (state & BufDesc::VALID))
+        return;
+    if(desc.inLru)
+        lruRemove(frame);
+    if(desc.inLruK)
+        lruKRemove(shard,frame);
+    if(!(state & BufDesc::VALID))
+        return;
+    cold=cold && !(state & BufDesc::REFBIT);
+    if(policy==LRU_K){
+        if(cold){
+            for(std::uint32_t k=0;k<BufDesc::LRU_K;k++)
+                desc.refTimes[k]=0;
+        }else if(!(state & BufDesc::PREFETCHED)){
+            for(std::uint32_t k=BufDesc::LRU_K-1;k>0;k--)
+                desc.refTimes[k]=desc.refTimes[k-1];
+            desc.refTimes[0]=++shard.refClock;
+        }
+        lruKInsert(shard,frame);
+        return;
+    }
+    if(cold)
+        lruPushFront(frame);
+    else
+        lruPushBack(frame);
+}
+
+/*
+ The empty frame leaves the LRU list and goes on the free list,
+ so it is reused before any page is replaced.
+*/
+void BufMgr::frameFreed(FrameId frame) {
+    BufShard& shard=frameShard(frame);
+    std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+    lruSetList(frame,NULL);
+    if(bufDescTable[frame].inLruK)
+        lruKRemove(shard,frame);
+    freePush(shard,frame);
+}
+
+/*
+ LRU, ARC and 2Q put the page on one of their lists. A page read again
+ soon after it was replaced gets its reference times back under
+ LRU-K, so it is not mistaken for a page used only once.
+*/
+void BufMgr::frameLoaded(FrameId frame, const File* file, const PageId pageNo) {
+    BufShard& shard=frameShard(frame);
+    BufDesc& desc=bufDescTable[frame];
+    std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+    //a frame recycled by a strategy may still be listed for its last page
+    lruSetList(frame,NULL);
+    if(desc.inLruK)
+        lruKRemove(shard,frame);
+
+    switch(policy){
+    case LRU:
+        lruSetList(frame,&shard.lru);
+        break;
+    case LRU_K:
+    {
+        std::vector<std::uint64_t>* history=shard.lruKHistory.find(file,pageNo);
+        for(std::uint32_t k=0;k<BufDesc::LRU_K;k++)
+            desc.refTimes[k]=(history!=NULL) ? (*history)[k] : 0;
+        if(history!=NULL)
+            shard.lruKHistory.erase(file,pageNo);
+        break;
+    }
+    case ARC:
+        arcLoaded(shard,frame,file,pageNo);
+        break;
+    case TWO_Q:
+        //only a page read again while A1out remembers it is used often enough for Am
+        if(shard.twoQGhosts.erase(file,pageNo)){
+            shard.bufStats.recentGhostHits++;
+            lruSetList(frame,&shard.lruFrequent);
+        }else{
+            lruSetList(frame,&shard.lru);
+        }
+        break;
+    }
+}
+
+/*
+ LRU-K keeps the reference times of the page replaced, dropping
+ the oldest pages it remembers once it has one per frame. ARC
+ remembers the page in the ghost list of the list it was in, and
+ 2Q remembers the pages replaced from its FIFO queue.
+*/
+void BufMgr::frameReplaced(FrameId frame, const File* file, const PageId pageNo) {
+    BufShard& shard=frameShard(frame);
+    BufDesc& desc=bufDescTable[frame];
+    std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+    if(policy==LRU_K && file!=NULL && desc.refTimes[0]!=0){
+        //a page which was never used is not worth remembering
+        shard.lruKHistory.pushBack(file,pageNo,std::vector<std::uint64_t>(desc.refTimes,desc.refTimes+BufDesc::LRU_K));
+        while(shard.lruKHistory.size()>shard.numBufs)
+            shard.lruKHistory.popFront();
+    }
+    if(policy==ARC && file!=NULL){
+        if(desc.lruList==&shard.lru)
+            shard.arcRecentGhosts.pushBack(file,pageNo,true);
+        else if(desc.lruList==&shard.lruFrequent)
+            shard.arcFrequentGhosts.pushBack(file,pageNo,true);
+    }
+    if(policy==TWO_Q && file!=NULL && desc.lruList==&shard.lru){
+        shard.twoQGhosts.pushBack(file,pageNo,true);
+        while(shard.twoQGhosts.size()>shard.twoQOutLimit)
+            shard.twoQGhosts.popFront();
+    }
+    lruSetList(frame,NULL);
+    if(policy==ARC)
+        arcTrim(shard);
+}
+
+/*
+ The LRU lists are in replacement order, starting at their heads,
+ and so is the LRU-K order. ARC replaces from T1 first while T1 is
+ longer than its target, and from T2 first otherwise; 2Q does the
+ same with A1in, Am and the size set for A1in.
+*/
+void BufMgr::nextVictims(BufShard& shard, std::uint32_t count, std::vector<FrameId>& frames) {
+    std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+    if(policy==LRU_K){
+        for(std::set<std::tuple<std::uint64_t, std::uint64_t, FrameId> >::const_iterator it=shard.lruKOrder.begin();
+            it!=shard.lruKOrder.end() && count>0; ++it, count--)
+            frames.push_back(std::get<2>(*it));
+        return;
+    }
+    const FrameList* lists[2]={&shard.lru,&shard.lruFrequent};
+    const std::uint32_t target=(policy==TWO_Q) ? shard.twoQInLimit : shard.arcTarget.load();
+    if(shard.lru.pages<=target)
+        std::swap(lists[0],lists[1]);
+    for(int l=0;l<2;l++){
+        for(FrameId frame=lists[l]->head; frame!=BufDesc::INVALID_FRAME && count>0; frame=bufDescTable[frame].lruNext, count--)
+            frames.push_back(frame);
+    }
+}
+
+/*
+ LRU takes the head of its list. LRU-K takes the frame whose
+ LRU_K-th most recent reference is the oldest, which is first in
+ its order, in logarithmic time. ARC takes the head of T1 while T1
+ is longer than its target, and the head of T2 otherwise; pinned
+ pages are not linked, so if all of one list is pinned the other
+ one gives the victim. 2Q does the same with A1in, Am and the size
+ set for A1in. A1in keeps pinned pages linked, so its head may be
+ pinned; allocBuf then skips it and it goes to the back of A1in
+ once it is unpinned.
+*/
+bool BufMgr::takeVictim(BufShard& shard, FrameId & frame) {
+    if(policy==LRU_K){
+        if(shard.lruKOrder.empty())
+            return false;
+        frame=std::get<2>(*shard.lruKOrder.begin());
+        lruKRemove(shard,frame);
+        return true;
+    }
+    const FrameList* list=&shard.lru;
+    const std::uint32_t target=(policy==TWO_Q) ? shard.twoQInLimit : shard.arcTarget.load();
+    if(shard.lruFrequent.head!=BufDesc::INVALID_FRAME
+       && (shard.lru.head==BufDesc::INVALID_FRAME || shard.lru.pages<=target))
+        list=&shard.lruFrequent;
+    if(list->head==BufDesc::INVALID_FRAME)
+        return false;
+    frame=list->head;
+    lruRemove(frame);
+    return true;
+}
 
+/*
+ The sizes are kept per shard, in frames of the shard, and only
+ read under its policy latch.
+*/
+void BufMgr::setTwoQSizes(double inFraction, double outFraction) {
+    for(std::uint32_t s=0;s<numShards;s++){
+        BufShard& shard=shards[s];
+        std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+        shard.twoQInLimit=(std::uint32_t)(std::max(0.0,inFraction)*shard.numBufs);
+        shard.twoQOutLimit=(std::uint32_t)(std::max(0.0,outFraction)*shard.numBufs);
+        while(shard.twoQGhosts.size()>shard.twoQOutLimit)
+            shard.twoQGhosts.popFront();
+    }
 }
 
 /*
  This function allocates a new frame in the buffer pool
  for the page to be read. The method used to allocate
- a new frame is the clock algorithm.
-*/
-void BufMgr::allocBuf(FrameId & frame) {
-
-	//variable that shows us if the buffer is full or has empty position
-    FrameId filledFrames=0;
-    //access of every position of the buffer
-    for(FrameId i=0; i<numBufs;i++)
-    {
-        //if the position is filled increases the filledFrames variable and increases the page's counter
-        if(bufDescTable[i].valid==true)
-        {
-            bufDescTable[i].counter++;
-            filledFrames++;
-        }
-    }
-
-    //variable that shows us the counter of the least recently used page in the buffer
-    int max=-1;
-    //contains the clockHand of the least recently used page
-    FrameId maxFrame=0;
-    //variable that will be used to access the buffer when it is filled
-    FrameId bufCount=0;
-
-    //checking whether the buffer is filled or not
-    if (filledFrames<numBufs){
-        //if the buffer has empty positions it accesses every buffer position
-        //until it find the first empty position and assigns it to the frame variable
-
-        //increase filledFrames because we will fill another buffer position
-        filledFrames++;
-        //variable that will show us the first empty position
-        FrameId z=0;
-        bool flag=false;
-        //accessing all of the positions to find the first one, if it does not find any
-        //increases the z variable to search further into the buffer
-        while (!flag){
-            if (bufDescTable[z].valid==false){
-                frame=z;
-                flag=true;
-            }
-            else
-                z++;
-        }
-    }
-    else {
-        //if the buffer does not have any empty positions we use the LRU algorithm to
-        //find a possible candidate
-
-        //access of all the buffer positions
-        while ((bufCount<2*numBufs)&&(max==-1))
-        {
-            //using the advanceClock to go to the next buffer frame
-            advanceClock();
-
-            //checking the requirements to find a possible candidate for replacement
-            if(bufDescTable[clockHand].valid==true)
-            {
-                if(bufDescTable[clockHand].refbit==false)
-                {
-                    if(bufDescTable[clockHand].pinCnt==0)
-                    {
-                        //if the page is modified it is written in the disk
-                        if(bufDescTable[clockHand].dirty==true){
-
-                            bufDescTable[clockHand].file->writePage(bufPool[clockHand]);
-                            bufDescTable[clockHand].dirty=false;
-
-                            //if the page currently being checked has not been used more
-                            //recently than the current max page it replaces it as the
-                            //least recently used page
-                            if (bufDescTable[clockHand].counter>max){
-                                max=bufDescTable[clockHand].counter;
-                                maxFrame=clockHand;
-                            }
-                        }else{
-                            //same as before
-                            if (bufDescTable[clockHand].counter>max){
-                                max=bufDescTable[clockHand].counter;
-                                maxFrame=clockHand;
-                            }
-                        }
-                    }
-                }
-                else{
-                    //changes the refbit from true to false
-                    bufDescTable[clockHand].refbit=false;
-                }
-            }
-
-            //increase the bufCount after the current page has been checked
-            bufCount++;
-
-            //if no page for replacement has been found a BufferExceededException is thrown
-            if (bufCount==2*numBufs && max==-1){
-               throw BufferExceededException();
-            }
-        }
-
-        //in case a page has been found its frame is assigned to the frame variable
-        //and it is removed from the hash table and its bufDescTable position is cleared
-
-        frame=maxFrame;
-        hashTable->remove(bufDescTable[maxFrame].file,bufDescTable[maxFrame].pageNo);
-        bufDescTable[maxFrame].Clear();
-
-   }
+ a new frame is the LRU algorithm, or the other policy the
+ buffer manager was given.
+
+ Empty frames are taken from the free list first. Otherwise
+ the LRU list holds the pages that are not pinned, ordered
+ from least to most recently used, and allocation takes the head.
+*/
+void BufMgr::allocBuf(BufShard& shard, FrameId & frame) {
+
+    for(;;){
+        FrameId victim;
+        {
+            std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+            //an empty frame needs neither a write nor an eviction
+            if(freePop(shard,frame)){
+                return;
+            }
+            //if every frame is pinned there is no candidate for replacement,
+            //otherwise the head of the list is the least recently used page
+            if(!takeVictim(shard,victim)){
+                throw BufferExceededException();
+            }
+        }
+
+        //another thread pinned the page after it was linked, it is linked again when that pin is released
+        if(BufDesc::pinCount(frameState[victim])>0)
+            continue;
+
+        //if the page is modified it is written in the disk
+        bool written;
+        writeBack(victim,written);
+        if(written)
+            shard.bufStats.victimWrites++;
+
+        //the page is removed from the hash table and its bufDescTable position is cleared
+        const File* replacedFile;
+        PageId replacedPage;
+        if(evictFrame(victim,&replacedFile,&replacedPage)){
+            frame=victim;
+            frameReplaced(victim,replacedFile,replacedPage);
+            //lets the cleaner prepare the next victims
+            if(cleanTarget>0)
+                cleanerWake.notify_one();
+            return;
+        }
+
+        //the page was pinned or modified again in the meantime, so it stays in the buffer pool
+        if(BufDesc::pinCount(frameState[victim])==0)
+            frameUnpinned(victim);
+    }
+
+}
+
+/*
+ Gives back a frame that allocBuf handed out but that did
+ not receive a page.
+*/
+void BufMgr::releaseBuf(FrameId frame) {
+    frameState[frame]=0;
+    frameFreed(frame);
+}
+
+/*
+ Frames the prefetcher claimed are only held until their pages
+ are read, so a thread which finds every frame of the shard
+ pinned waits for those before it gives up. It only gives up
+ if the prefetcher holds no frame of the shard and neither
+ claimed nor released one while allocBuf was looking.
+*/
+void BufMgr::allocBufWaiting(BufShard& shard, FrameId & frame) {
+    for(;;){
+        const std::uint64_t events=shard.prefetchEvents;
+        try{
+            allocBuf(shard,frame);
+            return;
+        }catch (BufferExceededException&){
+            if(shard.prefetchClaims==0 && shard.prefetchEvents==events)
+                throw;
+        }
+        std::this_thread::yield();
+    }
+}
+
+/*
+ Recycles the frames of the ring of the strategy in turn. A frame
+ is only taken back while it holds a page nobody but a strategy
+ used; otherwise, and until the ring is full, a frame is allocated
+ as usual and takes that place in the ring. A recycled frame is
+ left in the replacement order, allocBuf skips it while it is pinned.
+*/
+void BufMgr::allocStrategyBuf(BufStrategy& strategy, BufShard& shard, FrameId & frame) {
+    //the rings are set up on first use, and again if the strategy was used with another buffer manager
+    if(strategy.owner!=this){
+        strategy.owner=this;
+        strategy.rings.assign(numShards,std::vector<FrameId>());
+        strategy.next.assign(numShards,0);
+    }
+    const std::uint32_t s=&shard-shards;
+    const std::uint32_t ringSize=std::max<std::uint32_t>(1,std::min(strategy.frames,numBufs/8)/numShards);
+    std::vector<FrameId>& ring=strategy.rings[s];
+    if(ring.size()<ringSize){
+        allocBufWaiting(shard,frame);
+        ring.push_back(frame);
+        return;
+    }
+
+    FrameId& slot=ring[strategy.next[s]];
+    strategy.next[s]=(strategy.next[s]+1)%ringSize;
+    const std::uint64_t state=frameState[slot];
+    //a page another thread used stays in the buffer pool, and so does a page modified during a bulk read
+    bool reuse=!(state & BufDesc::REFBIT) &&
+               (!(state & BufDesc::DIRTY) || strategy.type==BufStrategy::BULK_WRITE);
+    if(reuse && (state & BufDesc::DIRTY)){
+        bool written;
+        reuse=writeBack(slot,written);
+        if(written)
+            shard.bufStats.victimWrites++;
+    }
+    if(reuse && evictFrame(slot)){
+        frame=slot;
+        return;
+    }
+    allocBufWaiting(shard,frame);
+    slot=frame;
+}
+
+/*
+ Writes the page held by the frame to its file if it is dirty.
+ The frame latch is held shared while writing, so the frame
+ can not be evicted or reloaded underneath the write.
+*/
+bool BufMgr::writeBack(FrameId frame, bool & written) {
+    BufShard& shard=frameShard(frame);
+    BufDesc& desc=bufDescTable[frame];
+    File* file;
+    written=false;
+    {
+        std::shared_lock<std::shared_mutex> tableLock(shard.tableLatch);
+        std::uint64_t state=frameState[frame];
+        if(!(state & BufDesc::VALID) || !(state & BufDesc::DIRTY))
+            return true;
+        //the frame is being loaded, evicted or disposed by another thread
+        if(!desc.latch.try_lock_shared())
+            return false;
+        file=desc.file;
+    }
+
+    //the dirty bit is cleared before writing, so a modification made while
+    //the write is in progress marks the page dirty again
+    frameState[frame].fetch_and(~BufDesc::DIRTY);
+    try{
+        file->writePage(bufPool[frame]);
+    }catch (...){
+        frameState[frame].fetch_or(BufDesc::DIRTY);
+        desc.latch.unlock_shared();
+        throw;
+    }
+    shard.bufStats.diskwrites++;
+    desc.latch.unlock_shared();
+    written=true;
+    return true;
+}
+
+/*
+ Writes all dirty pages of a file back with one call to the file,
+ which sorts and coalesces them. Every frame of the file is
+ checked before anything is written; the frames written are
+ latched shared until the write is done.
+*/
+void BufMgr::writeBackFile(const File* file, std::vector<FrameId>& frames) {
+    std::vector<FrameId> latched;
+    std::vector<const Page*> pages;
+    File* target=NULL;
+    std::vector<FrameId> resident;
+    residentFrames(file,resident);
+    try{
+        for(std::size_t r=0;r<resident.size();r++)
+        {
+            const FrameId i=resident[r];
+            BufDesc& desc=bufDescTable[i];
+            std::shared_lock<std::shared_mutex> tableLock(frameShard(i).tableLatch);
+            if (desc.file!=file)
+                continue;
+            std::uint64_t state=frameState[i];
+            if (BufDesc::pinCount(state)>0){
+                throw PagePinnedException(file->filename(),desc.pageNo,desc.frameNo);
+            }
+            if (!(state & BufDesc::VALID)){
+                throw BadBufferException(i,(state & BufDesc::DIRTY)!=0,false,(state & BufDesc::REFBIT)!=0);
+            }
+            //the frame is being loaded, evicted or disposed by another thread
+            if(!(state & BufDesc::DIRTY) || !desc.latch.try_lock_shared())
+                continue;
+            latched.push_back(i);
+            pages.push_back(&bufPool[i]);
+            target=desc.file;
+        }
+
+        //the dirty bits are cleared before writing, so a modification made while
+        //the write is in progress marks the page dirty again
+        for(std::size_t i=0;i<latched.size();i++)
+            frameState[latched[i]].fetch_and(~BufDesc::DIRTY);
+        if(target!=NULL){
+            try{
+                target->writePages(pages.data(),pages.size());
+            }catch (...){
+                for(std::size_t i=0;i<latched.size();i++)
+                    frameState[latched[i]].fetch_or(BufDesc::DIRTY);
+                throw;
+            }
+        }
+    }catch (...){
+        for(std::size_t i=0;i<latched.size();i++)
+            bufDescTable[latched[i]].latch.unlock_shared();
+        throw;
+    }
+
+    for(std::size_t i=0;i<latched.size();i++){
+        frameShard(latched[i]).bufStats.diskwrites++;
+        bufDescTable[latched[i]].latch.unlock_shared();
+    }
+    frames.insert(frames.end(),latched.begin(),latched.end());
+}
+
+/*
+ Removes the page held by the frame from the buffer pool and
+ claims the empty frame for the caller. Pins are only ever
+ taken while the page table latch is held, so holding it
+ exclusively guarantees nobody pins the page meanwhile.
+*/
+bool BufMgr::evictFrame(FrameId frame, const File** file, PageId* pageNo) {
+    BufShard& shard=frameShard(frame);
+    BufDesc& desc=bufDescTable[frame];
+    std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+
+    //a single compare-and-swap checks that the page is neither pinned nor dirty and pins it
+    std::uint64_t state=frameState[frame];
+    if((state & (BufDesc::PIN_MASK | BufDesc::DIRTY | BufDesc::IO_IN_PROGRESS)) != 0 ||
+       !frameState[frame].compare_exchange_strong(state,state+1))
+        return false;
+    //another thread is writing the page back
+    if(!desc.latch.try_lock()){
+        frameState[frame].fetch_sub(1);
+        return false;
+    }
+
+    if(file!=NULL)
+        *file=(state & BufDesc::VALID) ? desc.file : NULL;
+    if(pageNo!=NULL)
+        *pageNo=desc.pageNo;
+    if(state & BufDesc::VALID){
+        shard.hashTable->remove(desc.file,desc.pageNo);
+        fileUnlink(shard,frame);
+    }
+    if(state & BufDesc::PREFETCHED)
+        shard.bufStats.readaheadWasted++;
+    desc.Clear();
+    frameState[frame]=1;
+    desc.latch.unlock();
+    return true;
+}
+
+/*
+ Writes back the dirty pages the replacement policy would take
+ next, until enough clean frames are waiting. The frames are
+ collected under the policy latch and written after it is
+ released, like allocBuf does.
+*/
+void BufMgr::cleanShard(BufShard& shard) {
+    const std::uint32_t target=std::min(cleanTarget.load(),shard.numBufs);
+    std::uint32_t clean;
+    {
+        std::lock_guard<std::mutex> policyLock(shard.policyLatch);
+        clean=shard.numFree;
+    }
+    if(clean>=target)
+        return;
+
+    //looks at twice as many frames as needed, so a few pinned pages in line do not hold the cleaner up
+    std::vector<FrameId> frames;
+    nextVictims(shard,std::min(shard.numBufs,2*target),frames);
+
+    for(std::size_t i=0;i<frames.size() && clean<target;i++){
+        std::uint64_t state=frameState[frames[i]];
+        //empty frames are already counted through the free list and pinned pages can not be replaced
+        if(!(state & BufDesc::VALID) || BufDesc::pinCount(state)>0)
+            continue;
+        if(state & BufDesc::DIRTY){
+            bool written;
+            try{
+                if(!writeBack(frames[i],written))
+                    continue;
+            }catch (...){
+                //the page stays dirty, whoever replaces it runs into the error again and gets the exception
+                continue;
+            }
+            if(written)
+                shard.bufStats.cleanerWrites++;
+        }
+        clean++;
+    }
+}
+
+void BufMgr::cleanerLoop() {
+    std::unique_lock<std::mutex> cleanerLock(cleanerLatch);
+    while(!cleanerStop){
+        cleanerLock.unlock();
+        for(std::uint32_t s=0;s<numShards;s++)
+            cleanShard(shards[s]);
+        cleanerLock.lock();
+        if(!cleanerStop)
+            cleanerWake.wait_for(cleanerLock,std::chrono::milliseconds(10));
+    }
+}
+
+void BufMgr::startCleaner(std::uint32_t target) {
+    std::lock_guard<std::mutex> cleanerLock(cleanerLatch);
+    cleanTarget=target;
+    if(!cleaner.joinable()){
+        cleanerStop=false;
+        cleaner=std::thread(&BufMgr::cleanerLoop,this);
+    }
+    cleanerWake.notify_one();
+}
+
+void BufMgr::stopCleaner() {
+    {
+        std::lock_guard<std::mutex> cleanerLock(cleanerLatch);
+        if(!cleaner.joinable())
+            return;
+        cleanerStop=true;
+        cleanTarget=0;
+    }
+    cleanerWake.notify_one();
+    cleaner.join();
+}
+
+void BufMgr::prefetchPages(File* file, const PageId first, const std::uint32_t count) {
+    if(count==0)
+        return;
+    std::lock_guard<std::mutex> prefetchLock(prefetchLatch);
+    queuePrefetch(file,first,count);
+}
+
+void BufMgr::queuePrefetch(File* file, const PageId first, const std::uint32_t count) {
+    if(!prefetcher.joinable()){
+        prefetchStop=false;
+        prefetcher=std::thread(&BufMgr::prefetchLoop,this);
+    }
+    PrefetchRequest request={file,first,count};
+    prefetchQueue.push_back(request);
+    //flushFile() waits on the same condition variable, so everybody is woken up
+    prefetchWake.notify_all();
+}
+
+/*
+ Carries out the prefetch requests one after the other. The
+ pages of a request which are not in the buffer pool yet are
+ loaded in runs of consecutive pages, each run with one read.
+ Runs are kept short compared to the buffer pool, since all
+ frames of a run are claimed before it is read.
+*/
+void BufMgr::prefetchLoop() {
+    const std::uint32_t maxRun=std::max<std::uint32_t>(1,std::min<std::uint32_t>(File::MAX_IO_PAGES,numBufs/8));
+    std::unique_lock<std::mutex> prefetchLock(prefetchLatch);
+    for(;;){
+        while(!prefetchStop && prefetchQueue.empty())
+            prefetchWake.wait(prefetchLock);
+        if(prefetchStop)
+            return;
+        PrefetchRequest request=prefetchQueue.front();
+        prefetchQueue.pop_front();
+        prefetchFile=request.file;
+        prefetchLock.unlock();
+
+        //pages past the end of the file are not looked at
+        const std::uint64_t end=std::min<std::uint64_t>((std::uint64_t)request.first+request.count,request.file->pageLimit());
+        std::uint64_t pageNo=request.first;
+        while(pageNo<end){
+            if(isResident(request.file,pageNo)){
+                pageNo++;
+                continue;
+            }
+            std::uint32_t run=1;
+            while(pageNo+run<end && run<maxRun && !isResident(request.file,pageNo+run))
+                run++;
+            //the buffer pool is full of pinned pages, the rest of the request is dropped
+            if(!prefetchRun(request.file,pageNo,run))
+                break;
+            pageNo+=run;
+        }
+
+        prefetchLock.lock();
+        prefetchFile=NULL;
+        prefetchWake.notify_all();
+    }
+}
+
+void BufMgr::stopPrefetcher() {
+    {
+        std::lock_guard<std::mutex> prefetchLock(prefetchLatch);
+        if(!prefetcher.joinable())
+            return;
+        prefetchStop=true;
+        prefetchQueue.clear();
+    }
+    prefetchWake.notify_all();
+    prefetcher.join();
+}
+
+void BufMgr::cancelPrefetch(const File* file) {
+    std::unique_lock<std::mutex> prefetchLock(prefetchLatch);
+    for(std::deque<PrefetchRequest>::iterator it=prefetchQueue.begin();it!=prefetchQueue.end();){
+        if(it->file==file)
+            it=prefetchQueue.erase(it);
+        else
+            ++it;
+    }
+    while(prefetchFile==file)
+        prefetchWake.wait(prefetchLock);
+    readahead.erase(file);
+}
+
+/*
+ Reads ahead while a file is read sequentially. A page read from
+ disk right after the page noted last, or the page that one
+ points to, opens a window of READAHEAD_MIN pages; any other page
+ read from disk closes it again; the first page read from a file
+ has nothing before it and is not taken as sequential. Using the
+ first page of the last window for the first time reads the next
+ window, twice as large, so one window is on its way while the
+ pages before it are used. A window counts the used pages that
+ follow in the list of used pages, so pages deleted from the file
+ are neither read nor counted.
+*/
+void BufMgr::noteSequential(File* file, const PageId pageNo, const PageId nextPageNo, const bool miss) {
+    if(!readaheadEnabled)
+        return;
+    //the window is kept small enough not to push the whole buffer pool out
+    const std::uint32_t maxWindow=std::max<std::uint32_t>(1,std::min<std::uint32_t>(READAHEAD_MAX,numBufs/4));
+    std::lock_guard<std::mutex> prefetchLock(prefetchLatch);
+    ReadaheadState& state=readahead.emplace(file,ReadaheadState()).first->second;
+    //a new state has no page noted yet, page 1 does not follow it
+    const bool sequential=state.lastPage!=Page::INVALID_NUMBER &&
+                          (pageNo==state.lastPage+1 || pageNo==state.nextPage);
+    state.lastPage=pageNo;
+    state.nextPage=nextPageNo;
+
+    if(miss){
+        //random access backs off
+        if(!sequential){
+            state.window=0;
+            state.end=0;
+            return;
+        }
+        //the page was already asked for, the prefetcher just did not get to it yet
+        if(pageNo<state.end)
+            return;
+        state.window=std::min(READAHEAD_MIN,maxWindow);
+    }else{
+        if(state.window==0 || pageNo<state.trigger)
+            return;
+        state.window=std::min(2*state.window,maxWindow);
+    }
+
+    //the window holds the used pages the scan reaches by following the next page numbers, which skip deleted pages
+    const std::vector<PageId> pages=file->usedPagesAfter(std::max<PageId>(pageNo+1,state.end)-1,state.window);
+    if(pages.empty())
+        return;
+    //pages with consecutive numbers are asked for together, so that they are read together
+    std::size_t runStart=0;
+    for(std::size_t i=1;i<=pages.size();i++){
+        if(i==pages.size() || pages[i]!=pages[i-1]+1){
+            queuePrefetch(file,pages[runStart],i-runStart);
+            runStart=i;
+        }
+    }
+    state.trigger=pages.front();
+    state.end=pages.back()+1;
+}
+
+void BufMgr::setReadahead(bool enabled) {
+    std::lock_guard<std::mutex> prefetchLock(prefetchLatch);
+    readaheadEnabled=enabled;
+    //access patterns seen so far are forgotten, so a window does not pick up where it stopped
+    readahead.clear();
+}
 
+bool BufMgr::isResident(const File* file, const PageId pageNo) {
+    BufShard& shard=pageShard(file,pageNo);
+    std::shared_lock<std::shared_mutex> tableLock(shard.tableLatch);
+    FrameId frame;
+    return shard.hashTable->find(file,pageNo,frame);
+}
+
+/*
+ Claims a frame for every page of the run, publishes the pages
+ in the page table with their frame latches held exclusively,
+ like readPage does, and reads them. All frames are claimed
+ before the first one is latched, since allocBuf takes the
+ policy latch, which is never held together with a frame latch.
+*/
+bool BufMgr::prefetchRun(File* file, const PageId first, const std::uint32_t count) {
+    std::vector<FrameId> frames;
+    for(std::uint32_t i=0;i<count;i++){
+        BufShard& shard=pageShard(file,first+i);
+        FrameId frame;
+        //counted before the frame is claimed, so no thread gives up on the shard while it is being claimed
+        shard.prefetchClaims++;
+        shard.prefetchEvents++;
+        try{
+            allocBuf(shard,frame);
+        }catch (...){
+            shard.prefetchClaims--;
+            shard.prefetchEvents++;
+            break;
+        }
+        frames.push_back(frame);
+    }
+
+    //a page another thread loaded in the meantime splits the run, the pages before it are read right away
+    std::vector<FrameId> batch;
+    std::vector<FrameId> spare;
+    PageId batchFirst=first;
+    for(std::size_t i=0;i<frames.size();i++){
+        const PageId pageNo=first+i;
+        BufShard& shard=pageShard(file,pageNo);
+        BufDesc& desc=bufDescTable[frames[i]];
+        desc.latch.lock();
+        std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+        FrameId other;
+        if(shard.hashTable->find(file,pageNo,other)){
+            tableLock.unlock();
+            desc.latch.unlock();
+            spare.push_back(frames[i]);
+            if(!batch.empty())
+                loadFrames(file,batchFirst,batch);
+            batch.clear();
+            batchFirst=pageNo+1;
+            continue;
+        }
+        shard.hashTable->insert(file,pageNo,frames[i]);
+        desc.Set(file,pageNo,BufDesc::IO_IN_PROGRESS);
+        fileLink(shard,frames[i]);
+        batch.push_back(frames[i]);
+    }
+    if(!batch.empty())
+        loadFrames(file,batchFirst,batch);
+
+    for(std::size_t i=0;i<spare.size();i++){
+        releaseBuf(spare[i]);
+        frameShard(spare[i]).prefetchClaims--;
+        frameShard(spare[i]).prefetchEvents++;
+    }
+    return frames.size()==count;
+}
+
+void BufMgr::loadFrames(File* file, const PageId first, const std::vector<FrameId>& frames) {
+    std::vector<Page*> pages;
+    for(std::size_t i=0;i<frames.size();i++)
+        pages.push_back(&bufPool[frames[i]]);
+    std::vector<bool> loaded(frames.size(),true);
+    try{
+        file->readPages(first,pages.data(),pages.size());
+    }catch (...){
+        //a page which can not be read, like a deleted one, does not keep the others out
+        for(std::size_t i=0;i<frames.size();i++){
+            try{
+                file->readPages(first+i,&pages[i],1);
+            }catch (...){
+                loaded[i]=false;
+            }
+        }
+    }
+
+    for(std::size_t i=0;i<frames.size();i++){
+        const FrameId frame=frames[i];
+        BufShard& shard=frameShard(frame);
+        BufDesc& desc=bufDescTable[frame];
+        if(loaded[i]){
+            shard.bufStats.diskreads++;
+            //nobody has asked for the page yet, so it does not count as referenced
+            std::uint64_t state=frameState[frame];
+            while(!frameState[frame].compare_exchange_weak(state,
+                      (state & ~(BufDesc::IO_IN_PROGRESS | BufDesc::REFBIT)) | BufDesc::PREFETCHED)){
+            }
+        }else{
+            std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+            shard.hashTable->remove(file,first+i);
+            fileUnlink(shard,frame);
+            desc.Clear();
+        }
+        desc.latch.unlock();
+    }
+
+    //the frames are handed to the replacement policy once none of them is latched any more,
+    //the pin taken by allocBuf is dropped
+    for(std::size_t i=0;i<frames.size();i++){
+        if(!loaded[i]){
+            frameFreed(frames[i]);
+        }else{
+            frameLoaded(frames[i],file,first+i);
+            if(BufDesc::pinCount(frameState[frames[i]].fetch_sub(1))==1)
+                frameUnpinned(frames[i]);
+        }
+        frameShard(frames[i]).prefetchClaims--;
+        frameShard(frames[i]).prefetchEvents++;
+    }
 }
 
 /*
@@ -175,41 +1201,107 @@ void BufMgr::allocBuf(FrameId & frame) {
  a frame in the bufpool by calling allocBuf function and
  returns the Page.
 */
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page) {
-
-	FrameId frameID;
-    // looks for the page in the hash table, if it exists, sets the page reference bit and
-    //increases the pinCnt and also makes the variable page equal to the page that's in the
-    //specific frame in the buffer
-    try{
-        hashTable->lookup(file,pageNo,frameID);
-
-        bufDescTable[frameID].refbit=true;
-        bufDescTable[frameID].pinCnt++;
-        page=&bufPool[frameID];
-
-    }
-
- // if the page doesn't exist in the buffer pool, it reads the page from the file, allocates a frame
-    //in the buffer and sets the specific frame in the buffer pool equal to the page that was read from the file
-    //also inserts the page in the hash table and sets the bufDescTable for the specific frame
-    catch (HashNotFoundException er){
-
-        allocBuf(frameID);
-
-        bufPool[frameID]=file->readPage(pageNo);
-        page=&bufPool[frameID];
-        hashTable->insert(file,pageNo,frameID);
-        bufDescTable[frameID].Set(file,pageNo);
-
-    }
-    //increases the counter for every page in the buffer
-    for(FrameId i=0; i<numBufs;i++)
-    {
-       if(bufDescTable[i].valid==true)
-       {
-           bufDescTable[i].counter++;
-       }
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, BufStrategy* strategy) {
+
+	FrameId frameID;
+    BufShard& shard=pageShard(file,pageNo);
+    shard.bufStats.accesses++;
+
+    for(;;){
+        // looks for the page in the hash table, if it exists, sets the page reference bit and
+        //increases the pin count and also makes the variable page equal to the page that's in the
+        //specific frame in the buffer
+        bool found=false;
+        std::uint64_t state=0;
+        {
+            std::shared_lock<std::shared_mutex> tableLock(shard.tableLatch);
+            if(shard.hashTable->find(file,pageNo,frameID)){
+                found=true;
+                //pins the page and sets its reference bit in one step, unless another thread is still reading it from disk;
+                //a page used through a strategy does not count as referenced
+                const std::uint64_t refBit=(strategy==NULL) ? BufDesc::REFBIT : 0;
+                state=frameState[frameID];
+                while(!(state & BufDesc::IO_IN_PROGRESS) &&
+                      !frameState[frameID].compare_exchange_weak(state,((state+1) | refBit) & ~BufDesc::PREFETCHED)){
+                }
+            }
+        }
+
+        if(found && !(state & BufDesc::IO_IN_PROGRESS)){
+            if(BufDesc::pinCount(state)==0)
+                framePinned(frameID);
+            page=&bufPool[frameID];
+            //the first use of a page read ahead may read further ahead, unless it goes through a strategy,
+            //whose pages are not to be read into the rest of the buffer pool
+            if(state & BufDesc::PREFETCHED){
+                shard.bufStats.readaheadHits++;
+                if(strategy==NULL)
+                    noteSequential(file,pageNo,page->next_page_number(),false);
+            }
+            return;
+        }
+
+        //waits for the read of the page by the other thread to finish and looks again,
+        //the other thread holds the frame latch exclusively until then
+        if(found){
+            bufDescTable[frameID].latch.lock_shared();
+            bufDescTable[frameID].latch.unlock_shared();
+            continue;
+        }
+
+        // if the page doesn't exist in the buffer pool, it allocates a frame, reads the page from the file
+        //into the specific frame in the buffer pool
+        //and also inserts the page in the hash table and sets the bufDescTable for the specific frame
+        if(strategy!=NULL)
+            allocStrategyBuf(*strategy,shard,frameID);
+        else
+            allocBufWaiting(shard,frameID);
+        BufDesc& desc=bufDescTable[frameID];
+
+        //the page is published in the hash table before it is read, with the frame latch held
+        //exclusively, so that other threads missing on the same page wait for this read
+        desc.latch.lock();
+        {
+            std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+            FrameId other;
+            if(shard.hashTable->find(file,pageNo,other)){
+                //another thread loaded the page in the meantime
+                tableLock.unlock();
+                desc.latch.unlock();
+                releaseBuf(frameID);
+                continue;
+            }
+            shard.hashTable->insert(file,pageNo,frameID);
+            desc.Set(file,pageNo,BufDesc::IO_IN_PROGRESS);
+            fileLink(shard,frameID);
+        }
+
+        try{
+            //reads the page straight into the frame
+            file->readPage(pageNo,bufPool[frameID]);
+        }catch (...){
+            //the page can not be read, so it is taken out of the buffer pool again
+            {
+                std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+                shard.hashTable->remove(file,pageNo);
+                fileUnlink(shard,frameID);
+                desc.Clear();
+            }
+            desc.latch.unlock();
+            frameFreed(frameID);
+            throw;
+        }
+        shard.bufStats.diskreads++;
+        const std::uint64_t done=(strategy==NULL) ? BufDesc::IO_IN_PROGRESS : BufDesc::IO_IN_PROGRESS | BufDesc::REFBIT;
+        frameState[frameID].fetch_and(~done);
+        desc.latch.unlock();
+        frameLoaded(frameID,file,pageNo);
+
+        page=&bufPool[frameID];
+        //readahead loads pages outside the ring of a strategy
+        if(strategy==NULL)
+            noteSequential(file,pageNo,page->next_page_number(),true);
+        return;
     }
 
 }
@@ -219,26 +1311,35 @@ void BufMgr::readPage(File* file, const PageId pageNo, Page*& page) {
  Checks if the page is modified, then sets the dirty bit to true.
  If the page is already unpinned throws a PageNotPinned exception.
 */
-void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) {
-
-	FrameId frame;
-	 //looks for the given page in the hash table
-    hashTable->lookup(file,pageNo,frame);
-    //if the page is already unpinned then throws a PageNotPinned exception
-    if (bufDescTable[frame].pinCnt==0){
-        throw PageNotPinnedException(file->filename(),pageNo,frame);
-    }
-    //else if the page is pinned, decreases the pinCnt of the page in the bufDescTable
-    //using the frame that found in the hash table and sets the dirty bit if the given variable dirty is true
-    //if the page does not exist in the hash table it throws a HashNotFoundException
-    try {
-        bufDescTable[frame].pinCnt=bufDescTable[frame].pinCnt-1;
-        if(dirty==true)
-        {
-            bufDescTable[frame].dirty=true;
-        }
-    }catch (HashNotFoundException e){
-        throw HashNotFoundException(file->filename(),pageNo);
+void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty, BufStrategy* strategy) {
+
+	FrameId frame;
+    BufShard& shard=pageShard(file,pageNo);
+    std::uint64_t state;
+    {
+        std::shared_lock<std::shared_mutex> tableLock(shard.tableLatch);
+        //looks for the given page in the hash table
+        //if the page does not exist in the hash table it throws a HashNotFoundException
+        if(!shard.hashTable->find(file,pageNo,frame)){
+            throw HashNotFoundException(file->filename(),pageNo);
+        }
+        //if the page is already unpinned then throws a PageNotPinned exception
+        //else if the page is pinned, decreases the pin count of the page using the frame that found in the hash table
+        //and sets the dirty bit if the given variable dirty is true, both in one step
+        const std::uint64_t dirtyBit=(dirty==true) ? BufDesc::DIRTY : 0;
+        state=frameState[frame];
+        do{
+            if (BufDesc::pinCount(state)==0){
+                throw PageNotPinnedException(file->filename(),pageNo,frame);
+            }
+        }while(!frameState[frame].compare_exchange_weak(state,(state-1) | dirtyBit));
+    }
+
+    //once the last pin is released the page becomes the most recently used candidate for replacement,
+    //unless it was only used through a strategy
+    if(BufDesc::pinCount(state)==1)
+    {
+        frameUnpinned(frame,strategy!=NULL);
     }
 
 }
@@ -252,65 +1353,138 @@ void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) {
 */
 void BufMgr::flushFile(const File* file) {
 
-	//for every frame in the buffer
-        for(FrameId i=0;i<numBufs;i++)
-        {
-            //if the file of the page that is stored in i spot of the buffer equals to the given file
-            //and the page is dirty
-            //then writes that page to the corresponding file, removes that page from the hash table
-			//and clears the spot of the bufDescTable that it was stored
-            if (bufDescTable[i].file==file){
-                //if the page is pinned it throws a pin exception
-                if (bufDescTable[i].pinCnt>0){
-                    throw PagePinnedException(file->filename(),bufDescTable[i].pageNo,bufDescTable[i].frameNo);
-                }
-                //if the page is not valid it throws a bad buffer exception
-                if (!bufDescTable[i].valid){
-                    throw BadBufferException(i,bufDescTable[i].dirty,bufDescTable[i].valid,bufDescTable[i].refbit);
-                }
-                if(bufDescTable[i].dirty==true)
-                {
-                    bufDescTable[i].file->writePage(bufPool[i]);
-                    hashTable->remove(file,bufDescTable[i].pageNo);
-                    bufDescTable[i].Clear();
-                }
-            }
+        //no page of the file is loaded by the prefetcher any more once this returns
+        cancelPrefetch(file);
+
+        //writes all dirty pages of the file in one go first; the frames written are
+        //still taken out of the buffer pool below, like any other dirty frame
+        std::vector<FrameId> written;
+        writeBackFile(file,written);
+        std::sort(written.begin(),written.end());
+
+	//for every frame holding a page of the file
+        std::vector<FrameId> resident;
+        residentFrames(file,resident);
+        for(std::size_t r=0;r<resident.size();r++)
+        {
+            const FrameId i=resident[r];
+            BufDesc& desc=bufDescTable[i];
+            bool wasDirty=std::binary_search(written.begin(),written.end(),i);
+            for(;;)
+            {
+                //if the file of the page that is stored in i spot of the buffer equals to the given file
+                //and the page is dirty
+                //then writes that page to the corresponding file, removes that page from the hash table
+                //and clears the spot of the bufDescTable that it was stored
+                bool dirty;
+                {
+                    std::shared_lock<std::shared_mutex> tableLock(frameShard(i).tableLatch);
+                    if (desc.file!=file)
+                        break;
+                    std::uint64_t state=frameState[i];
+                    //if the page is pinned it throws a pin exception
+                    if (BufDesc::pinCount(state)>0){
+                        throw PagePinnedException(file->filename(),desc.pageNo,desc.frameNo);
+                    }
+                    //if the page is not valid it throws a bad buffer exception
+                    if (!(state & BufDesc::VALID)){
+                        throw BadBufferException(i,(state & BufDesc::DIRTY)!=0,false,(state & BufDesc::REFBIT)!=0);
+                    }
+                    dirty=(state & BufDesc::DIRTY)!=0 || wasDirty;
+                }
+
+                //writeBack() only writes the page if it was dirtied again in the meantime
+                bool rewritten;
+                if(dirty && writeBack(i,rewritten) && evictFrame(i))
+                {
+                    releaseBuf(i);
+                    break;
+                }
+
+                //waits for a write of the page by the cleaner to finish, so nothing writes to
+                //the file once this returns
+                desc.latch.lock();
+                desc.latch.unlock();
+                wasDirty=false;
+                if(!dirty)
+                    break;
+            }
         }
 
+        //the header of the file is only written back on a flush
+        file->flush();
 }
 
 /*
  This function allocates a new page and reads it into the buffer pool.
 */
-void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) {
-
-	FrameId frameid;
-
-	//allocates a frame of the buffer for the page to be stored
-	//if it can't find any it throws a buffer exceeded exception
-	try{
-        allocBuf(frameid);
-	}catch (BufferExceededException e){
-        throw BufferExceededException();
-	}
-
-    //allocates the page from the file that is stored and puts it in the specific frame to the buffer pool
-	bufPool[frameid]=file->allocatePage();
-
-	//makes the variable page equal to the page that was allocated earlier from the file
-    page=&bufPool[frameid];
-    //makes the variable pageNo equal to the page number that was allocated earlier from the file
-	pageNo=page->page_number();
-
-	//inserts the page in the hash table and if it can't throws a hash not found exception
-	try{
-        hashTable->insert(file,pageNo,frameid);
-	}catch (HashNotFoundException e){
-        throw HashNotFoundException(file->filename(),pageNo);
-	}
-
-	//also sets the corresponding frame in the bufDescTable with the specific file and page
+void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page, BufStrategy* strategy) {
+
+	FrameId frameid;
+
+    //the page number decides which shard the page belongs to, and the file only picks it when it allocates the page
+    if(numShards==1){
+        //with a single shard the frame is claimed first and the file builds the page right in it
+        try{
+            if(strategy!=NULL)
+                allocStrategyBuf(*strategy,shards[0],frameid);
+            else
+                allocBufWaiting(shards[0],frameid);
+        }catch (...){
+            shards[0].bufStats.accesses++;
+            throw;
+        }
+        try{
+            file->allocatePage(bufPool[frameid]);
+        }catch (...){
+            releaseBuf(frameid);
+            throw;
+        }
+        pageNo=bufPool[frameid].page_number();
+    }else{
+        //otherwise the page is built in a buffer of the thread and copied into a frame of its shard
+        static thread_local Page newPage;
+        file->allocatePage(newPage);
+        pageNo=newPage.page_number();
+        BufShard& shard=pageShard(file,pageNo);
+
+        //if no frame is left the page is given back to the file and a buffer exceeded exception is thrown
+        try{
+            if(strategy!=NULL)
+                allocStrategyBuf(*strategy,shard,frameid);
+            else
+                allocBufWaiting(shard,frameid);
+        }catch (...){
+            shard.bufStats.accesses++;
+            file->deletePage(pageNo);
+            throw;
+        }
+        bufPool[frameid]=newPage;
+    }
+    BufShard& shard=pageShard(file,pageNo);
+	//makes the variable page equal to the page that was allocated from the file
+    page=&bufPool[frameid];
+
+	//inserts the page in the hash table
+	//also sets the corresponding frame in the bufDescTable with the specific file and page
+    std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+    FrameId other;
+    if(shard.hashTable->find(file,pageNo,other)){
+        //readahead read the new page from disk since it was allocated in the file, so that copy is used
+        tableLock.unlock();
+        releaseBuf(frameid);
+        readPage(file,pageNo,page,strategy);
+        return;
+    }
+    shard.hashTable->insert(file,pageNo,frameid);
     bufDescTable[frameid].Set(file,pageNo);
+    if(strategy!=NULL)
+        frameState[frameid].fetch_and(~BufDesc::REFBIT);
+    fileLink(shard,frameid);
+    shard.bufStats.accesses++;
+    shard.bufStats.diskreads++;
+    tableLock.unlock();
+    frameLoaded(frameid,file,pageNo);
 }
 
 /* This function is used for disposing a page from the buffer pool
@@ -318,20 +1492,37 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) {
 */
 void BufMgr::disposePage(File* file, const PageId PageNo) {
 
-	FrameId frameid;
-    //it looks for the page in the hash table, if it exists it returns the frame that is stored inside
-    //else it goes to the HashNotFoundException and then deletes the page from the file in both cases
-    try{
-        hashTable->lookup(file,PageNo,frameid);
-        //deletes the page from the hash table
-        hashTable->remove(file,PageNo);
-        //it clears the frame that the deleted page was stored
-        bufDescTable[frameid].Clear();
-    }
-    catch(HashNotFoundException e){
-        //throw HashNotFoundException(file->filename(),PageNo);
-    }
-    //deletes the page from the corresponding file
+	FrameId frameid;
+    BufShard& shard=pageShard(file,PageNo);
+    bool present;
+    {
+        std::shared_lock<std::shared_mutex> tableLock(shard.tableLatch);
+        present=shard.hashTable->find(file,PageNo,frameid);
+    }
+    //it looks for the page in the hash table, if it exists it removes it from the buffer pool
+    //and then deletes the page from the file in both cases
+    if(present){
+        BufDesc& desc=bufDescTable[frameid];
+        bool cleared=false;
+        {
+            //waits for any read or write of the frame to finish
+            std::unique_lock<std::shared_mutex> frameLock(desc.latch);
+            std::unique_lock<std::shared_mutex> tableLock(shard.tableLatch);
+            FrameId current;
+            if(shard.hashTable->find(file,PageNo,current) && current==frameid){
+                //deletes the page from the hash table
+                shard.hashTable->remove(file,PageNo);
+                fileUnlink(shard,frameid);
+                //it clears the frame that the deleted page was stored
+                desc.Clear();
+                cleared=true;
+            }
+        }
+        //and puts the empty frame on the free list so it is reused first
+        if(cleared)
+            frameFreed(frameid);
+    }
+    //deletes the page from the corresponding file
     file->deletePage(PageNo);
 
 }
@@ -347,11 +1538,49 @@ void BufMgr::printSelf(void)
 		std::cout << "FrameNo:" << i << " ";
 		tmpbuf->Print();
 
-  	if (tmpbuf->valid == true)
+  	if (frameState[i] & BufDesc::VALID)
     	validFrames++;
   }
 
 	std::cout << "Total Number of Valid Frames:" << validFrames << "\n";
 }
 
+BufStats BufMgr::getBufStats()
+{
+  BufStats total;
+  for (std::uint32_t s = 0; s < numShards; s++)
+	{
+		total.accesses += shards[s].bufStats.accesses;
+		total.diskreads += shards[s].bufStats.diskreads;
+		total.diskwrites += shards[s].bufStats.diskwrites;
+		total.victimWrites += shards[s].bufStats.victimWrites;
+		total.cleanerWrites += shards[s].bufStats.cleanerWrites;
+		total.readaheadHits += shards[s].bufStats.readaheadHits;
+		total.readaheadWasted += shards[s].bufStats.readaheadWasted;
+		total.recentGhostHits += shards[s].bufStats.recentGhostHits;
+		total.frequentGhostHits += shards[s].bufStats.frequentGhostHits;
+		total.adaptiveTarget += shards[s].arcTarget;
+  }
+	return total;
+}
+
+void BufMgr::clearBufStats()
+{
+  for (std::uint32_t s = 0; s < numShards; s++)
+		shards[s].bufStats.clear();
+}
+
+void BufMgr::getFileStats(const File* file, std::uint32_t& residentPages, std::uint32_t& dirtyPages)
+{
+	std::vector<FrameId> frames;
+	residentFrames(file, frames);
+	residentPages = frames.size();
+	dirtyPages = 0;
+	for (std::size_t i = 0; i < frames.size(); i++)
+	{
+		if (frameState[frames[i]] & BufDesc::DIRTY)
+			dirtyPages++;
+	}
+}
+
 }
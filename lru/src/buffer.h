@@ -7,8 +7,20 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 #include "file.h"
 #include "bufHashTbl.h"
+#include "ghostList.h"
 
 namespace badgerdb {
 
@@ -17,22 +29,94 @@ namespace badgerdb {
 */
 class BufMgr;
 
+/**
+* @brief List of frames in replacement order, linked through the frames' BufDesc entries
+*/
+struct FrameList
+{
+	/**
+   * Least recently used frame, INVALID_FRAME if the list is empty
+	 */
+  FrameId head;
+
+	/**
+   * Most recently used frame, INVALID_FRAME if the list is empty
+	 */
+  FrameId tail;
+
+	/**
+   * Number of frames belonging to the list, including pinned ones, which are only linked in while they are unpinned
+	 */
+  std::uint32_t pages;
+};
+
+
 /**
 * @brief Class for maintaining information about buffer pool frames
+*
+* The state the buffer manager checks and changes on every access (pin count, valid, dirty and reference bits and
+* whether the page is being read in) is packed into one 64 bit atomic word per frame, so pinning or unpinning a page
+* is a single compare-and-swap. These words are kept in their own dense array owned by BufMgr; a BufDesc holds the
+* rest of the information about the frame and points to its state word.
 */
 class BufDesc {
 
 	friend class BufMgr;
 
- private:
-     int counter;
+ public:
+	/**
+   * Frame number used to terminate the free and LRU lists
+	 */
+  static const FrameId INVALID_FRAME = std::numeric_limits<FrameId>::max();
+
+	/**
+   * Bits of the state word holding the pin count
+	 */
+  static constexpr std::uint64_t PIN_MASK = 0xFFFFFFFFULL;
+
+	/**
+   * State bit set if the frame holds a page
+	 */
+  static constexpr std::uint64_t VALID = 1ULL << 32;
+
+	/**
+   * State bit set if the page is dirty
+	 */
+  static constexpr std::uint64_t DIRTY = 1ULL << 33;
+
+	/**
+   * State bit set if the page has been referenced recently
+	 */
+  static constexpr std::uint64_t REFBIT = 1ULL << 34;
+
+	/**
+   * State bit set while the page is read from disk into the frame. The page can not be pinned until the read is done.
+	 */
+  static constexpr std::uint64_t IO_IN_PROGRESS = 1ULL << 35;
+
+	/**
+   * State bit set if the page was loaded ahead of use by the prefetcher and has not been pinned since
+	 */
+  static constexpr std::uint64_t PREFETCHED = 1ULL << 36;
+
+	/**
+   * Pin count held in a state word
+	 */
+  static std::uint32_t pinCount(std::uint64_t state)
+  {
+		return (std::uint32_t) (state & PIN_MASK);
+  }
+
+ private:
 	/**
-   * Pointer to file to which corresponding frame is assigned
+   * Pointer to file to which corresponding frame is assigned.
+   * Only changes while the buffer manager holds the page table latch exclusively.
 	 */
   File* file;
 
 	/**
-   * Page within file to which corresponding frame is assigned
+   * Page within file to which corresponding frame is assigned.
+   * Only changes while the buffer manager holds the page table latch exclusively.
 	 */
   PageId pageNo;
 
@@ -42,37 +126,86 @@ class BufDesc {
   FrameId	frameNo;
 
 	/**
-   * Number of times this page has been pinned
+   * State word of the frame: pin count, valid, dirty and reference bits and the I/O in progress flag
+	 */
+  std::atomic<std::uint64_t>* state;
+
+	/**
+   * Shared/exclusive latch of the frame. Held exclusively while the page is read from disk into the frame
+   * (so other threads asking for the same page wait for that read instead of issuing their own) and shared
+   * while the frame is written back to disk.
+	 */
+  std::shared_mutex latch;
+
+	/**
+   * Next frame in the free list of the shard, INVALID_FRAME if this is the last one or not on the list
+	 */
+  FrameId freeNext;
+
+	/**
+   * True if the frame is currently on the free list
+	 */
+  bool onFreeList;
+
+	/**
+   * Previous frame holding a page of the same file in the shard, INVALID_FRAME if this is the first one or not linked
+	 */
+  FrameId filePrev;
+
+	/**
+   * Next frame holding a page of the same file in the shard, INVALID_FRAME if this is the last one or not linked
+	 */
+  FrameId fileNext;
+
+	/**
+   * Previous (less recently used) frame in the LRU list, INVALID_FRAME if this is the head or not linked
+	 */
+  FrameId lruPrev;
+
+	/**
+   * Next (more recently used) frame in the LRU list, INVALID_FRAME if this is the tail or not linked
+	 */
+  FrameId lruNext;
+
+	/**
+   * LRU list of its shard the frame belongs to, NULL if it belongs to none
+	 */
+  FrameList* lruList;
+
+	/**
+   * True if the frame is currently linked into its LRU list. Pinned frames are unlinked, except in the FIFO queue
+   * of the 2Q policy, which keeps them in place.
+	 */
+  bool inLru;
+
+	/**
+   * True if the page was read ahead and has not been used yet (ARC policy)
 	 */
-  int pinCnt;
+  bool arcUnused;
 
 	/**
-   * True if page is dirty;  false otherwise
+   * Number of past references of a page the LRU-K policy looks at
 	 */
-  bool dirty;
+  static constexpr std::uint32_t LRU_K = 2;
 
 	/**
-   * True if page is valid
+   * Times of the last LRU_K references of the page, most recent first, 0 for references it did not have (LRU-K policy)
 	 */
-  bool valid;
+  std::uint64_t refTimes[LRU_K];
 
 	/**
-   * Has this buffer frame been reference recently
+   * True if the frame is currently in the replacement order of the LRU-K policy
 	 */
-  bool refbit;
+  bool inLruK;
 
 	/**
    * Initialize buffer frame for a new user
 	 */
   void Clear()
 	{
-    pinCnt = 0;
 		file = NULL;
 		pageNo = Page::INVALID_NUMBER;
-    dirty = false;
-    refbit = false;
-		valid = false;
-		counter=-1;
+		*state = 0;
   };
 
 	/**
@@ -81,20 +214,18 @@ class BufDesc {
 	 *
 	 * @param filePtr	File object
 	 * @param pageNum	Page number in the file
+	 * @param flags		Additional state bits to set, IO_IN_PROGRESS if the page still has to be read in
 	 */
-  void Set(File* filePtr, PageId pageNum)
+  void Set(File* filePtr, PageId pageNum, std::uint64_t flags = 0)
 	{
 		file = filePtr;
     pageNo = pageNum;
-    pinCnt = 1;
-    dirty = false;
-    valid = true;
-    refbit = true;
-    counter=0;
+    *state = 1 | VALID | REFBIT | flags;
   }
 
   void Print()
 	{
+		std::uint64_t current = *state;
 		if(file)
 		{
 			std::cout << "file:" << file->filename() << " ";
@@ -103,48 +234,99 @@ class BufDesc {
 		else
 			std::cout << "file:NULL ";
 
-		std::cout << "valid:" << valid << " ";
-		std::cout << "pinCnt:" << pinCnt << " ";
-		std::cout << "dirty:" << dirty << " ";
-		std::cout << "refbit:" << refbit << "\n";
+		std::cout << "valid:" << ((current & VALID) != 0) << " ";
+		std::cout << "pinCnt:" << pinCount(current) << " ";
+		std::cout << "dirty:" << ((current & DIRTY) != 0) << " ";
+		std::cout << "refbit:" << ((current & REFBIT) != 0) << "\n";
   }
 
 	/**
-   * Constructor of BufDesc class
+   * Constructor of BufDesc class. The state word is attached by the buffer manager.
 	 */
   BufDesc()
 	{
-  	Clear();
+		file = NULL;
+		pageNo = Page::INVALID_NUMBER;
+		state = NULL;
+  	freeNext = INVALID_FRAME;
+  	onFreeList = false;
+  	filePrev = fileNext = INVALID_FRAME;
+  	lruPrev = lruNext = INVALID_FRAME;
+  	lruList = NULL;
+  	inLru = false;
+  	arcUnused = false;
+  	for (std::uint32_t k = 0; k < LRU_K; k++)
+  		refTimes[k] = 0;
+  	inLruK = false;
   }
 };
 
 
 /**
 * @brief Class to maintain statistics of buffer usage
+*
+* The counters are atomic because they are updated by every thread using the buffer manager.
 */
 struct BufStats
 {
 	/**
    * Total number of accesses to buffer pool
 	 */
-  int accesses;
+  std::atomic<int> accesses;
 
 	/**
    * Number of pages read from disk (including allocs)
 	 */
-  int diskreads;
+  std::atomic<int> diskreads;
 
 	/**
    * Number of pages written back to disk
 	 */
-  int diskwrites;
+  std::atomic<int> diskwrites;
+
+	/**
+   * Number of pages written back by a thread which needed the frame for another page (included in diskwrites)
+	 */
+  std::atomic<int> victimWrites;
+
+	/**
+   * Number of pages written back by the background cleaner (included in diskwrites)
+	 */
+  std::atomic<int> cleanerWrites;
+
+	/**
+   * Number of pages loaded ahead of use (by readahead or prefetchPages()) which were then asked for
+	 */
+  std::atomic<int> readaheadHits;
+
+	/**
+   * Number of pages loaded ahead of use which were replaced before anybody asked for them
+	 */
+  std::atomic<int> readaheadWasted;
+
+	/**
+   * Number of pages read again while the replacement policy remembered replacing them after a single use
+	 */
+  std::atomic<int> recentGhostHits;
+
+	/**
+   * Number of pages read again while the replacement policy remembered replacing them after repeated use
+	 */
+  std::atomic<int> frequentGhostHits;
+
+	/**
+   * Number of frames an adaptive replacement policy currently aims to give to pages used once, summed over the
+   * shards. Not a counter: filled in by BufMgr::getBufStats().
+	 */
+  std::atomic<int> adaptiveTarget;
 
 	/**
    * Clear all values
 	 */
   void clear()
   {
-		accesses = diskreads = diskwrites = 0;
+		accesses = diskreads = diskwrites = victimWrites = cleanerWrites = readaheadHits = readaheadWasted = 0;
+		recentGhostHits = frequentGhostHits = adaptiveTarget = 0;
   }
 
 	/**
@@ -153,141 +335,981 @@ struct BufStats
   BufStats()
   {
 		clear();
+  }
+
+	/**
+   * Copy constructor, takes a snapshot of the other statistics
+	 */
+  BufStats(const BufStats& other)
+  {
+		*this = other;
+  }
+
+	/**
+   * Assignment operator, takes a snapshot of the other statistics
+	 */
+  BufStats& operator=(const BufStats& other)
+  {
+		accesses = other.accesses.load();
+		diskreads = other.diskreads.load();
+		diskwrites = other.diskwrites.load();
+		victimWrites = other.victimWrites.load();
+		cleanerWrites = other.cleanerWrites.load();
+		readaheadHits = other.readaheadHits.load();
+		readaheadWasted = other.readaheadWasted.load();
+		recentGhostHits = other.recentGhostHits.load();
+		frequentGhostHits = other.frequentGhostHits.load();
+		adaptiveTarget = other.adaptiveTarget.load();
+		return *this;
   }
 };
 
 
 /**
-* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file
+* @brief A range of pages of a file to be loaded into the buffer pool in the background, see BufMgr::prefetchPages()
 */
-class BufMgr
+struct PrefetchRequest
+{
+	/**
+   * File the pages belong to
+	 */
+  File* file;
+
+	/**
+   * First page of the range
+	 */
+  PageId first;
+
+	/**
+   * Number of pages in the range
+	 */
+  std::uint32_t count;
+};
+
+
+/**
+* @brief Access pattern of a file seen by the buffer manager, used to decide how far to read ahead
+*/
+struct ReadaheadState
 {
+	/**
+   * Page which was last read from disk or first used after being read ahead, Page::INVALID_NUMBER before the first
+	 */
+  PageId lastPage;
+
+	/**
+   * Next page pointer of lastPage
+	 */
+  PageId nextPage;
+
+	/**
+   * Number of pages read ahead the last time, 0 after a random access
+	 */
+  std::uint32_t window;
+
+	/**
+   * Pages below this one have already been asked for
+	 */
+  PageId end;
+
+	/**
+   * First page of the last window read ahead; using it starts reading the next window
+	 */
+  PageId trigger;
+};
+
+
+/**
+* @brief Access strategy for pages which are read or written once, like in a scan or a bulk load
+*
+* Pages a thread reads or allocates through a strategy are kept in a small ring of frames which the thread recycles,
+* instead of pushing the rest of the buffer pool out. Such pages do not count as referenced and are the first
+* candidates for replacement once they are unpinned. A page of the ring which another thread used in the meantime
+* stays in the buffer pool, and a new frame takes its place in the ring. Reads through a strategy do not read ahead,
+* since readahead loads its pages into the rest of the buffer pool.
+*
+* A strategy is used by one thread at a time, with one buffer manager.
+*/
+class BufStrategy {
+
+	friend class BufMgr;
+
+ public:
+	/**
+   * Kinds of access
+	 */
+  enum Type {
+    /**
+     * Pages are read once. A page modified in the meantime is not written back to reuse its frame, the frame leaves the ring.
+     */
+    BULK_READ,
+
+    /**
+     * Pages are written once. A dirty page is written back when its frame comes round again.
+     */
+    BULK_WRITE
+  };
+
+	/**
+   * Default number of frames of a BULK_READ ring
+	 */
+  static constexpr std::uint32_t BULK_READ_FRAMES = 32;
+
+	/**
+   * Default number of frames of a BULK_WRITE ring, larger so writes of dirty pages are not waited for as often
+	 */
+  static constexpr std::uint32_t BULK_WRITE_FRAMES = 128;
+
+	/**
+   * Constructor of BufStrategy class
+	 *
+	 * @param type  	Kind of access
+	 * @param frames	Number of frames of the ring, 0 for the default of the type. The buffer manager uses at most an
+	 *              	eighth of its frames, and at least one frame of every shard.
+	 */
+  BufStrategy(Type type, std::uint32_t frames = 0)
+	{
+		this->type = type;
+		this->frames = (frames != 0) ? frames : (type == BULK_READ) ? BULK_READ_FRAMES : BULK_WRITE_FRAMES;
+		owner = NULL;
+  }
+
  private:
 	/**
-   * Current position of clockhand in our buffer pool
+   * Kind of access
 	 */
-  FrameId clockHand;
+  Type type;
 
 	/**
-   * Number of frames in the buffer pool
+   * Number of frames of the ring asked for
+	 */
+  std::uint32_t frames;
+
+	/**
+   * Buffer manager the rings belong to, NULL before the strategy is first used
+	 */
+  const BufMgr* owner;
+
+	/**
+   * Frames of the ring in every shard, in the order they are recycled
+	 */
+  std::vector<std::vector<FrameId> > rings;
+
+	/**
+   * Position in the ring of every shard of the frame to recycle next
+	 */
+  std::vector<std::uint32_t> next;
+};
+
+
+/**
+* @brief One partition of the buffer pool
+*
+* A shard owns a contiguous range of frames together with the page table, latches, LRU list and statistics of the
+* pages routed to it. Threads working on pages of different shards never share a latch.
+*/
+class BufShard {
+
+	friend class BufMgr;
+
+ private:
+	/**
+   * First frame of the buffer pool owned by this shard
+	 */
+  FrameId firstFrame;
+
+	/**
+   * Number of frames owned by this shard
 	 */
   std::uint32_t numBufs;
 
 	/**
-   * Hash table mapping (File, page) to frame
+   * Hash table mapping (File, page) to frame, for the pages of this shard
 	 */
   BufHashTbl *hashTable;
 
 	/**
-   * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
+   * Latch protecting hashTable and the file, pageNo and valid fields of the frames of this shard
 	 */
-  BufDesc *bufDescTable;
+  std::shared_mutex tableLatch;
 
 	/**
-   * Maintains Buffer pool usage statistics
+   * First frame of the list of frames of this shard holding pages of a file, for every file with such pages.
+   * Protected by tableLatch, like hashTable.
 	 */
-  BufStats bufStats;
+  std::unordered_map<const File*, FrameId> fileFrames;
 
 	/**
-   * Advance clock to next frame in the buffer pool
+   * Latch protecting the free list and the LRU list
 	 */
-  void advanceClock();
+  std::mutex policyLatch;
 
 	/**
-	 * Allocate a free frame.
-	 *
-	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
-	 * @throws BufferExceededException If no such buffer is found which can be allocated
+   * Top of the list of empty frames, which allocBuf() hands out before replacing any page
 	 */
-  void allocBuf(FrameId & frame);
+  FrameId freeHead;
 
- public:
 	/**
-   * Actual buffer pool from which frames are allocated
+   * Number of frames on the free list
 	 */
-  Page* bufPool;
+  std::uint32_t numFree;
 
 	/**
-   * Constructor of BufMgr class
+   * Frames which may be replaced, least recently used first. Under ARC only the pages used once since they were
+   * loaded (T1). Under 2Q the pages not read again since they were first read, in the order they were loaded (A1in).
 	 */
-  BufMgr(std::uint32_t bufs);
+  FrameList lru;
 
 	/**
-   * Destructor of BufMgr class
+   * Pages used more than once since they were loaded, least recently used first (ARC policy, T2; 2Q policy, Am)
 	 */
-  ~BufMgr();
+  FrameList lruFrequent;
 
 	/**
-	 * Reads the given page from the file into a frame and returns the pointer to page.
-	 * If the requested page is already present in the buffer pool pointer to that frame is returned
-	 * otherwise a new frame is allocated from the buffer pool for reading the page.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number in the file to be read
-	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+   * Pages replaced from lru (ARC policy, B1)
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  GhostList<bool> arcRecentGhosts;
 
 	/**
-	 * Unpin a page from memory since it is no longer required for it to remain in memory.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number
-	 * @param dirty		True if the page to be unpinned needs to be marked dirty
-   * @throws  PageNotPinnedException If the page is not already pinned
+   * Pages replaced from lruFrequent (ARC policy, B2)
 	 */
-  void unPinPage(File* file, const PageId PageNo, const bool dirty);
+  GhostList<bool> arcFrequentGhosts;
 
 	/**
-	 * Allocates a new, empty page in the file and returns the Page object.
-	 * The newly allocated page is also assigned a frame in the buffer pool.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
-	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+   * Number of frames the ARC policy aims to give to the pages in lru
 	 */
-  void allocPage(File* file, PageId &PageNo, Page*& page);
+  std::atomic<std::uint32_t> arcTarget;
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
-	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
-	 * Otherwise Error returned.
-	 *
-	 * @param file   	File object
-   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool
-   * @throws BadBufferException If any frame allocated to the file is found to be invalid
+   * Pages replaced from lru (2Q policy, A1out)
 	 */
-  void flushFile(const File* file);
+  GhostList<bool> twoQGhosts;
 
 	/**
-	 * Delete page from file and also from buffer pool if present.
-	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number
+   * Number of pages lru holds before the 2Q policy replaces pages from it rather than from lruFrequent (Kin)
 	 */
-  void disposePage(File* file, const PageId PageNo);
+  std::uint32_t twoQInLimit;
 
 	/**
-   * Print member variable values.
+   * Largest number of pages twoQGhosts remembers (Kout)
 	 */
-  void  printSelf();
+  std::uint32_t twoQOutLimit;
 
 	/**
-   * Get buffer pool usage statistics
+   * Frames which may be replaced, by the time of their LRU_K-th most recent reference, then of their most recent
+   * one, then frame number (LRU-K policy)
 	 */
-  BufStats & getBufStats()
-  {
-		return bufStats;
-  }
+  std::set<std::tuple<std::uint64_t, std::uint64_t, FrameId> > lruKOrder;
 
 	/**
-   * Clear buffer pool usage statistics
+   * Logical time of the shard, advanced by every reference the LRU-K policy records
 	 */
-  void clearBufStats()
-  {
-		bufStats.clear();
-  }
+  std::uint64_t refClock;
+
+	/**
+   * Reference times of pages recently replaced, given back to them if they are read again (LRU-K policy). It holds
+   * at most as many pages as the shard has frames.
+	 */
+  GhostList<std::vector<std::uint64_t> > lruKHistory;
+
+	/**
+   * Number of frames of this shard the prefetcher has claimed, or is claiming, for pages it has not read yet
+	 */
+  std::atomic<std::uint32_t> prefetchClaims;
+
+	/**
+   * Number of times the prefetcher started claiming or released a frame of this shard
+	 */
+  std::atomic<std::uint64_t> prefetchEvents;
+
+	/**
+   * Buffer pool usage statistics of this shard
+	 */
+  BufStats bufStats;
+};
+
+
+/**
+* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file
+*
+* All public methods may be called concurrently from several threads. The page table is protected by its own
+* shared/exclusive latch, so lookups of resident pages run in parallel, and every frame has its own latch and an atomic
+* pin count, so pinned pages can be used by several threads at once. When several threads miss on the same page, only
+* the first one reads it from disk; the others wait on the frame latch for that read to finish.
+*
+* A frame latch may be waited for before the page table latch is taken, never while it is held (then it is only
+* tried). The replacement policy latch is never held together with any other latch.
+*
+* The pool may be split into several shards (see BufShard). Every page is routed to one shard by a hash of
+* (file, page number) and is only ever cached in a frame of that shard, so a shard can run out of frames while
+* others still have some.
+*
+* An optional background cleaner (see startCleaner()) writes back dirty pages before they are chosen for
+* replacement, so that a thread missing on a page rarely has to write another page first.
+*
+* Pages can also be loaded ahead of use by a background prefetcher (see prefetchPages()). It publishes the pages
+* it reads in the page table like readPage() does, so a thread asking for such a page waits for that read instead
+* of issuing its own. readPage() hands sequential access to a file to the prefetcher on its own: once it sees pages
+* read in order (by page number or by following next page pointers) it reads ahead in windows which double from
+* READAHEAD_MIN up to READAHEAD_MAX pages while the access stays sequential, and stops at the first random access.
+*
+* Scans and bulk loads can pass a BufStrategy to readPage(), allocPage() and unPinPage(), so that the pages they go
+* through once do not replace the pages other threads keep using.
+*/
+class BufMgr
+{
+ public:
+	/**
+   * Replacement policies the buffer manager can use
+	 */
+  enum Policy {
+    /**
+     * Replaces the least recently used page.
+     */
+    LRU,
+
+    /**
+     * Replaces the page whose BufDesc::LRU_K-th most recent reference is the oldest. Pages referenced fewer times
+     * go first, least recently used first. Pins taken while a page is already pinned count as one reference, and
+     * the reference times of pages replaced recently are remembered for when they are read again.
+     */
+    LRU_K,
+
+    /**
+     * Adaptive Replacement Cache: keeps pages used once and pages used more than once in two LRU lists, and
+     * remembers as many pages replaced from each. A page read again while remembered moves the target length of
+     * the first list towards the list it was replaced from.
+     */
+    ARC,
+
+    /**
+     * 2Q: pages read for the first time go through a FIFO queue, where further hits do not move them. Pages
+     * replaced from the queue are remembered, and only those read again while remembered enter an LRU list for
+     * pages used often. Queue sizes are set with setTwoQSizes().
+     */
+    TWO_Q
+  };
+
+	/**
+   * Default share of the frames the FIFO queue of the 2Q policy holds before pages are replaced from it
+	 */
+  static constexpr double TWOQ_IN_FRACTION = 0.25;
+
+	/**
+   * Default number of pages replaced from the FIFO queue the 2Q policy remembers, as a share of the frames
+	 */
+  static constexpr double TWOQ_OUT_FRACTION = 0.5;
+
+	/**
+   * Number of pages read ahead once sequential access to a file is detected
+	 */
+  static constexpr std::uint32_t READAHEAD_MIN = 4;
+
+	/**
+   * Largest number of pages read ahead at once, the window stops doubling there
+	 */
+  static constexpr std::uint32_t READAHEAD_MAX = 256;
+
+ private:
+	/**
+   * Number of frames in the buffer pool
+	 */
+  std::uint32_t numBufs;
+
+	/**
+   * Number of shards the buffer pool is split into
+	 */
+  std::uint32_t numShards;
+
+	/**
+   * Replacement policy of the buffer pool
+	 */
+  Policy policy;
+
+	/**
+   * Number of frames of every shard except the last one, which also takes the remainder
+	 */
+  std::uint32_t framesPerShard;
+
+	/**
+   * Array of the shards of the buffer pool
+	 */
+  BufShard *shards;
+
+	/**
+   * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
+	 */
+  BufDesc *bufDescTable;
+
+	/**
+   * Dense array of the state words of all frames, see BufDesc
+	 */
+  std::atomic<std::uint64_t> *frameState;
+
+	/**
+   * Memory of all frames: one contiguous, page aligned block in which frame i
+   * takes the Page::SIZE bytes at offset i * Page::SIZE
+	 */
+  char* frameArena;
+
+	/**
+   * Size of frameArena in bytes, rounded up to a whole number of huge pages
+	 */
+  std::size_t arenaSize;
+
+	/**
+   * Shard which caches the given page.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			The shard.
+	 */
+  BufShard& pageShard(const File* file, const PageId pageNo);
+
+	/**
+   * Shard which owns the given frame.
+	 *
+	 * @param frame   	Frame number
+	 * @return  			The shard.
+	 */
+  BufShard& frameShard(FrameId frame);
+
+	/**
+   * Link a frame which was just assigned a page into the list of frames of its file.
+   * The page table latch of the shard must be held exclusively.
+	 *
+	 * @param shard   	Shard owning the frame
+	 * @param frame   	Frame to link
+	 */
+  void fileLink(BufShard& shard, FrameId frame);
+
+	/**
+   * Unlink a frame from the list of frames of its file, before its page is taken out of the buffer pool.
+   * The page table latch of the shard must be held exclusively.
+	 *
+	 * @param shard   	Shard owning the frame
+	 * @param frame   	Frame to unlink, must currently be in the list
+	 */
+  void fileUnlink(BufShard& shard, FrameId frame);
+
+	/**
+   * Collect the frames holding pages of the file, shard by shard. Takes time proportional to the number of
+   * shards and of pages of the file in the buffer pool, not to the size of the pool.
+	 *
+	 * @param file   	File object
+	 * @param frames  	Vector the frames are appended to
+	 */
+  void residentFrames(const File* file, std::vector<FrameId>& frames);
+
+	/**
+   * Put an empty frame on the free list of its shard. The policy latch of the shard must be held.
+	 *
+	 * @param shard   	Shard owning the frame
+	 * @param frame   	Frame to put on the list
+	 */
+  void freePush(BufShard& shard, FrameId frame);
+
+	/**
+   * Take an empty frame off the free list of the shard and claim it. The policy latch of the shard must be held.
+	 *
+	 * @param shard   	Shard to take the frame from
+	 * @param frame   	Frame reference, the claimed frame is returned via this variable. It holds one pin for the caller.
+	 * @return  			False if the free list is empty.
+	 */
+  bool freePop(BufShard& shard, FrameId & frame);
+
+	/**
+   * Unlink a frame from its LRU list. The policy latch of its shard must be held.
+	 *
+	 * @param frame   	Frame to unlink, must currently be in the list
+	 */
+  void lruRemove(FrameId frame);
+
+	/**
+   * Link a frame at the most recently used end of its LRU list. The policy latch of its shard must be held.
+	 *
+	 * @param frame   	Frame to link
+	 */
+  void lruPushBack(FrameId frame);
+
+	/**
+   * Link a frame at the least recently used end of its LRU list. The policy latch of its shard must be held.
+	 *
+	 * @param frame   	Frame to link
+	 */
+  void lruPushFront(FrameId frame);
+
+	/**
+   * Move a frame to another LRU list of its shard, unlinked. The policy latch of its shard must be held.
+	 *
+	 * @param frame   	Frame to move
+	 * @param list   	List the frame belongs to from now on, NULL for none
+	 */
+  void lruSetList(FrameId frame, FrameList* list);
+
+	/**
+   * Put a page which was just loaded into the list of the ARC policy it belongs to. The policy latch of the shard
+   * must be held.
+	 *
+	 * @param shard   	Shard owning the frame
+	 * @param frame   	Frame holding the page
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 */
+  void arcLoaded(BufShard& shard, FrameId frame, const File* file, const PageId pageNo);
+
+	/**
+   * Drop the oldest pages the ARC policy remembers until it remembers no more than it may. The policy latch of the
+   * shard must be held.
+	 *
+	 * @param shard   	Shard to trim
+	 */
+  void arcTrim(BufShard& shard);
+
+	/**
+   * Put a frame into the replacement order of the LRU-K policy. The policy latch of the shard must be held.
+	 *
+	 * @param shard   	Shard owning the frame
+	 * @param frame   	Frame to insert, must not be in the order yet
+	 */
+  void lruKInsert(BufShard& shard, FrameId frame);
+
+	/**
+   * Take a frame out of the replacement order of the LRU-K policy. The policy latch of the shard must be held.
+	 *
+	 * @param shard   	Shard owning the frame
+	 * @param frame   	Frame to remove, must currently be in the order
+	 */
+  void lruKRemove(BufShard& shard, FrameId frame);
+
+	/**
+   * Take the frame the replacement policy would replace first out of the replacement order. The policy latch of
+   * the shard must be held.
+	 *
+	 * @param shard   	Shard to look at
+	 * @param frame   	Frame reference, the frame is returned via this variable. It may be pinned or dirty.
+	 * @return  			False if the shard has no frame which may be replaced.
+	 */
+  bool takeVictim(BufShard& shard, FrameId & frame);
+
+	/**
+   * Tell the replacement policy that allocBuf() replaced the page in a frame.
+	 *
+	 * @param frame   	Frame which was taken
+	 * @param file   	File of the page replaced
+	 * @param pageNo  Page number of the page replaced
+	 */
+  void frameReplaced(FrameId frame, const File* file, const PageId pageNo);
+
+	/**
+   * Tell the replacement policy which page a frame was given. Called before the frame is unpinned for the first time.
+	 *
+	 * @param frame   	Frame which got the page
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 */
+  void frameLoaded(FrameId frame, const File* file, const PageId pageNo);
+
+	/**
+   * Tell the replacement policy that a frame went from unpinned to pinned.
+	 *
+	 * @param frame   	Frame which got pinned
+	 */
+  void framePinned(FrameId frame);
+
+	/**
+   * Tell the replacement policy that the last pin of a frame was released.
+	 *
+	 * @param frame   	Frame which got unpinned
+	 * @param cold   	True if the page was only used through a BufStrategy since it was loaded
+	 */
+  void frameUnpinned(FrameId frame, bool cold = false);
+
+	/**
+   * Tell the replacement policy that a frame no longer holds a page, and put it on the free list.
+	 *
+	 * @param frame   	Frame which became empty
+	 */
+  void frameFreed(FrameId frame);
+
+	/**
+   * Collect the frames of the shard in the order the replacement policy would consider them for replacement.
+	 * Frames may be pinned, dirty or empty.
+	 *
+	 * @param shard   	Shard to look at
+	 * @param count   	Maximum number of frames to collect
+	 * @param frames  	Vector the frames are appended to
+	 */
+  void nextVictims(BufShard& shard, std::uint32_t count, std::vector<FrameId>& frames);
+
+	/**
+	 * Allocate a free frame of the given shard.
+	 *
+	 * @param shard   	Shard to take the frame from
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable.
+	 *                  The frame is empty, not in the page table and holds one pin for the caller.
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  void allocBuf(BufShard& shard, FrameId & frame);
+
+	/**
+	 * Allocate a free frame of the given shard like allocBuf(), but if every frame is pinned and some of them only
+	 * by the prefetcher, wait for those to be released instead of giving up.
+	 *
+	 * @param shard   	Shard to take the frame from
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable.
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  void allocBufWaiting(BufShard& shard, FrameId & frame);
+
+	/**
+	 * Allocate a frame of the given shard for a page read or allocated through a strategy, recycling a frame of its
+	 * ring if possible.
+	 *
+	 * @param strategy	Strategy the page is used through
+	 * @param shard   	Shard to take the frame from
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable.
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  void allocStrategyBuf(BufStrategy& strategy, BufShard& shard, FrameId & frame);
+
+	/**
+	 * Give a frame handed out by allocBuf() back to the buffer pool, when the page meant for it could not be loaded.
+	 *
+	 * @param frame   	Frame to release
+	 */
+  void releaseBuf(FrameId frame);
+
+	/**
+	 * Write the page in the frame back to its file if it is dirty.
+	 *
+	 * @param frame   	Frame to write
+	 * @param written 	Set to true if the page was written, false if it was clean
+	 * @return  			False if the frame is being loaded or evicted by another thread and was skipped, true otherwise.
+	 */
+  bool writeBack(FrameId frame, bool & written);
+
+	/**
+	 * Write all dirty pages of the file back at once, in the order of their page numbers, so that pages which
+	 * are next to each other on disk are written with a single call. Frames which are being loaded or evicted by
+	 * another thread are skipped.
+	 *
+	 * @param file   	File whose pages are written
+	 * @param frames 	Frames whose pages were written are appended to this vector
+   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool, nothing is written then
+   * @throws BadBufferException If any frame allocated to the file is found to be invalid, nothing is written then
+	 */
+  void writeBackFile(const File* file, std::vector<FrameId>& frames);
+
+	/**
+	 * Remove the page in the frame from the buffer pool and claim the frame for the caller, provided the page is
+	 * neither pinned nor dirty and no other thread is doing I/O on the frame.
+	 *
+	 * @param frame   	Frame to evict
+	 * @param file   	If not NULL, the file of the page evicted is returned via this pointer, NULL if the frame was empty
+	 * @param pageNo  If not NULL, the page number of the page evicted is returned via this pointer
+	 * @return  			True if the frame was claimed (it is then empty and holds one pin), false otherwise.
+	 */
+  bool evictFrame(FrameId frame, const File** file = NULL, PageId* pageNo = NULL);
+
+	/**
+	 * Background cleaner thread, only running between startCleaner() and stopCleaner()
+	 */
+  std::thread cleaner;
+
+	/**
+	 * Latch protecting cleanerStop, also used to wait on cleanerWake
+	 */
+  std::mutex cleanerLatch;
+
+	/**
+	 * Wakes the cleaner up before its interval is over, when a frame was taken by a replacement
+	 */
+  std::condition_variable cleanerWake;
+
+	/**
+	 * Set to tell the cleaner to exit
+	 */
+  bool cleanerStop;
+
+	/**
+	 * Number of clean frames the cleaner tries to keep ready for replacement in every shard, 0 if it is not running
+	 */
+  std::atomic<std::uint32_t> cleanTarget;
+
+	/**
+	 * Main loop of the background cleaner.
+	 */
+  void cleanerLoop();
+
+	/**
+	 * Write back dirty unpinned pages of the shard which are next in line for replacement, until the shard has
+	 * cleanTarget clean frames ready for replacement or no more candidates are found.
+	 *
+	 * @param shard   	Shard to clean
+	 */
+  void cleanShard(BufShard& shard);
+
+	/**
+	 * Background prefetcher thread, started by the first call of prefetchPages()
+	 */
+  std::thread prefetcher;
+
+	/**
+	 * Latch protecting prefetchQueue, prefetchStop, prefetchFile and readahead, also used to wait on prefetchWake
+	 */
+  std::mutex prefetchLatch;
+
+	/**
+	 * Wakes the prefetcher up when a request was queued, and flushFile() when the prefetcher finished a request
+	 */
+  std::condition_variable prefetchWake;
+
+	/**
+	 * Ranges of pages waiting to be prefetched, oldest first
+	 */
+  std::deque<PrefetchRequest> prefetchQueue;
+
+	/**
+	 * Set to tell the prefetcher to exit
+	 */
+  bool prefetchStop;
+
+	/**
+	 * File of the request the prefetcher is working on, NULL if it is idle
+	 */
+  const File* prefetchFile;
+
+	/**
+	 * Access pattern of every file read through readPage() since it was last flushed
+	 */
+  std::unordered_map<const File*, ReadaheadState> readahead;
+
+	/**
+	 * Whether readPage() reads ahead, see setReadahead()
+	 */
+  std::atomic<bool> readaheadEnabled;
+
+	/**
+	 * Handle of the File close hook which drops the prefetch requests of closed files
+	 */
+  int closeHook;
+
+	/**
+	 * Queue a prefetch request, starting the prefetcher if it is not running yet. The prefetch latch must be held.
+	 *
+	 * @param file   	File object
+	 * @param first  	First page to load
+	 * @param count  	Number of pages to load
+	 */
+  void queuePrefetch(File* file, const PageId first, const std::uint32_t count);
+
+	/**
+	 * Note a page read from disk or used for the first time after being read ahead, and read further ahead if the
+	 * file is being read sequentially.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param nextPageNo	Next page pointer of the page
+	 * @param miss   	True if the page had to be read from disk, false if it had been read ahead
+	 */
+  void noteSequential(File* file, const PageId pageNo, const PageId nextPageNo, const bool miss);
+
+	/**
+	 * Main loop of the background prefetcher.
+	 */
+  void prefetchLoop();
+
+	/**
+	 * Stop the background prefetcher and wait for it to exit. Requests still queued are dropped.
+	 */
+  void stopPrefetcher();
+
+	/**
+	 * Drop the queued prefetch requests for the file and wait until the prefetcher is no longer reading its pages.
+	 * Called by flushFile() and, through a File close hook, whenever a File object is closed.
+	 *
+	 * @param file   	File object
+	 */
+  void cancelPrefetch(const File* file);
+
+	/**
+	 * Check whether the page is in the buffer pool.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			True if the page is in the page table, also if it is still being read in.
+	 */
+  bool isResident(const File* file, const PageId pageNo);
+
+	/**
+	 * Load consecutive pages, none of which was in the buffer pool when they were looked up, into unpinned frames.
+	 * Pages loaded by another thread in the meantime are skipped.
+	 *
+	 * @param file   	File object
+	 * @param first  	First page to load
+	 * @param count  	Number of pages to load, at most File::MAX_IO_PAGES
+	 * @return  			False if not enough frames could be claimed for all the pages.
+	 */
+  bool prefetchRun(File* file, const PageId first, const std::uint32_t count);
+
+	/**
+	 * Read consecutive pages into frames which were published in the page table with IO_IN_PROGRESS set and
+	 * are latched exclusively, then make them available unpinned. Pages which can not be read are taken out of the
+	 * buffer pool again.
+	 *
+	 * @param file   	File object
+	 * @param first  	Page held by the first frame
+	 * @param frames 	Frames holding the pages first, first + 1, ...
+	 */
+  void loadFrames(File* file, const PageId first, const std::vector<FrameId>& frames);
+
+ public:
+	/**
+   * Actual buffer pool from which frames are allocated. Every Page is a view
+   * over the memory of its frame in frameArena
+	 */
+  Page* bufPool;
+
+	/**
+   * Constructor of BufMgr class
+	 *
+	 * @param bufs   	Number of frames in the buffer pool
+	 * @param shards  Number of shards the buffer pool is split into, at least 1 and at most bufs
+	 * @param policy  Replacement policy
+	 */
+  BufMgr(std::uint32_t bufs, std::uint32_t shards = 1, Policy policy = LRU);
+
+	/**
+   * Destructor of BufMgr class
+	 */
+  ~BufMgr();
+
+	/**
+	 * Reads the given page from the file into a frame and returns the pointer to page.
+	 * If the requested page is already present in the buffer pool pointer to that frame is returned
+	 * otherwise a new frame is allocated from the buffer pool for reading the page.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param strategy	Access strategy for a page which is only used once, NULL for normal access
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, BufStrategy* strategy = NULL);
+
+	/**
+	 * Unpin a page from memory since it is no longer required for it to remain in memory.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 * @param dirty		True if the page to be unpinned needs to be marked dirty
+	 * @param strategy	Access strategy the page was pinned with, NULL for normal access
+   * @throws  PageNotPinnedException If the page is not already pinned
+	 */
+  void unPinPage(File* file, const PageId PageNo, const bool dirty, BufStrategy* strategy = NULL);
+
+	/**
+	 * Allocates a new, empty page in the file and returns the Page object.
+	 * The newly allocated page is also assigned a frame in the buffer pool.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 * @param strategy	Access strategy for a page which is only written once, NULL for normal access
+	 */
+  void allocPage(File* file, PageId &PageNo, Page*& page, BufStrategy* strategy = NULL);
+
+	/**
+	 * Writes out all dirty pages of the file to disk, sorted by page number and with adjacent pages written
+	 * together, followed by the header of the file.
+	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
+	 * Otherwise Error returned.
+	 *
+	 * @param file   	File object
+   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool
+   * @throws BadBufferException If any frame allocated to the file is found to be invalid
+	 */
+  void flushFile(const File* file);
+
+	/**
+	 * Delete page from file and also from buffer pool if present.
+	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 */
+  void disposePage(File* file, const PageId PageNo);
+
+	/**
+	 * Load a range of pages of the file into the buffer pool in the background, without pinning them. Returns
+	 * right away. Pages already in the buffer pool or not currently used in the file are skipped, and pages which
+	 * are next to each other are read together. A readPage() of a page which is still being loaded waits for that
+	 * load to finish. Loading stops early if every frame of a shard is pinned.
+	 *
+	 * flushFile() and closing the File object drop the requests for the file which have not been carried out yet.
+	 *
+	 * @param file   	File object
+	 * @param first  	First page to load
+	 * @param count  	Number of pages to load
+	 */
+  void prefetchPages(File* file, const PageId first, const std::uint32_t count);
+
+	/**
+	 * Turn reading ahead on sequential access in readPage() on or off; it is on by default. Requests which are
+	 * already queued, and explicit prefetchPages() calls, are not affected.
+	 *
+	 * @param enabled  Whether to read ahead
+	 */
+  void setReadahead(bool enabled);
+
+	/**
+	 * Start the background cleaner. It wakes up regularly and whenever a page was replaced, and writes back dirty,
+	 * unpinned pages which are next in line for replacement. If the cleaner is already running only its target changes.
+	 *
+	 * @param target  Number of clean frames (empty, or holding an unpinned clean page) to keep ready for replacement
+	 *                in every shard
+	 */
+  void startCleaner(std::uint32_t target);
+
+	/**
+	 * Stop the background cleaner and wait for it to exit. Does nothing if it is not running.
+	 */
+  void stopCleaner();
+
+	/**
+	 * Size the queues of the 2Q policy, in every shard as a share of the frames of the shard. Replacements from then
+	 * on follow the new sizes.
+	 *
+	 * @param inFraction  Share of the frames the FIFO queue of pages read once (A1in) holds before pages are
+	 *                    replaced from it, TWOQ_IN_FRACTION by default
+	 * @param outFraction Number of pages replaced from the FIFO queue which are remembered (A1out), as a share of
+	 *                    the frames, TWOQ_OUT_FRACTION by default
+	 */
+  void setTwoQSizes(double inFraction, double outFraction);
+
+	/**
+   * Print member variable values.
+	 */
+  void  printSelf();
+
+	/**
+   * Get buffer pool usage statistics, summed over all shards
+	 */
+  BufStats getBufStats();
+
+	/**
+   * Clear buffer pool usage statistics of all shards
+	 */
+  void clearBufStats();
+
+	/**
+   * Count the pages of the file held in the buffer pool. Only looks at the frames of the file.
+	 *
+	 * @param file   	File object
+	 * @param residentPages	Number of pages of the file in the buffer pool, returned via this reference
+	 * @param dirtyPages	Number of those pages which are dirty, returned via this reference
+	 */
+  void getFileStats(const File* file, std::uint32_t& residentPages, std::uint32_t& dirtyPages);
 };
 
 }
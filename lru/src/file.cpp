@@ -12,9 +12,15 @@
 #include <memory>
 #include <string>
 #include <cstdio>
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_format_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
@@ -24,14 +30,22 @@
 namespace badgerdb {
 
 File::StreamMap File::open_streams_;
+File::LatchMap File::open_latches_;
+File::DescriptorMap File::open_fds_;
+File::StateMap File::open_states_;
+bool File::verify_writes_ = false;
 File::CountMap File::open_counts_;
+std::map<int, std::shared_ptr<File::CloseHook> > File::close_hooks_;
+int File::next_close_hook_ = 0;
+std::mutex File::close_hooks_latch_;
+std::condition_variable File::close_hooks_done_;
 
-File File::create(const std::string& filename) {
-  return File(filename, true /* create_new */);
+File File::create(const std::string& filename, const IoBackend backend) {
+  return File(filename, true /* create_new */, backend);
 }
 
-File File::open(const std::string& filename) {
-  return File(filename, false /* create_new */);
+File File::open(const std::string& filename, const IoBackend backend) {
+  return File(filename, false /* create_new */, backend);
 }
 
 void File::remove(const std::string& filename) {
@@ -44,6 +58,27 @@ void File::remove(const std::string& filename) {
   std::remove(filename.c_str());
 }
 
+int File::addCloseHook(const CloseHook& hook) {
+  std::lock_guard<std::mutex> lock(close_hooks_latch_);
+  close_hooks_[next_close_hook_] = std::make_shared<CloseHook>(hook);
+  return next_close_hook_++;
+}
+
+void File::removeCloseHook(const int handle) {
+  std::unique_lock<std::mutex> lock(close_hooks_latch_);
+  std::map<int, std::shared_ptr<CloseHook> >::iterator it =
+      close_hooks_.find(handle);
+  if (it == close_hooks_.end()) {
+    return;
+  }
+  const std::shared_ptr<CloseHook> hook = it->second;
+  close_hooks_.erase(it);
+  // Any other reference belongs to a close() which is still calling it.
+  while (hook.use_count() > 1) {
+    close_hooks_done_.wait(lock);
+  }
+}
+
 bool File::isOpen(const std::string& filename) {
   if (!exists(filename)) {
     return false;
@@ -62,18 +97,84 @@ bool File::exists(const std::string& filename) {
 	return false;
 }
 
+void File::migrate(const std::string& filename) {
+  if (isOpen(filename)) {
+    throw FileOpenException(filename);
+  }
+  if (!exists(filename)) {
+    throw FileNotFoundException(filename);
+  }
+
+  // Version 1 files start with the four page numbers of the header, followed
+  // directly by the pages.
+  struct {
+    PageId num_pages;
+    PageId first_used_page;
+    PageId num_free_pages;
+    PageId first_free_page;
+  } old_header;
+  const std::streamoff old_header_size = sizeof(old_header);
+  std::ifstream old_file(filename, std::ios::in | std::ios::binary);
+  if (!old_file.is_open()) {
+    throw FileIOException(filename, errno);
+  }
+  old_file.read(reinterpret_cast<char*>(&old_header), sizeof(old_header));
+  // Too short for either header, so there is nothing to go by.
+  if (old_file.gcount() != old_header_size) {
+    throw FileIOException(filename, 0);
+  }
+  if (old_header.num_pages == MAGIC) {
+    return;
+  }
+
+  const std::string new_filename = filename + ".migrating";
+  try {
+    remove(new_filename);
+  } catch (const FileNotFoundException&) {
+  }
+  {
+    File new_file = create(new_filename);
+    Page page;
+    for (PageId page_number = 1; page_number < old_header.num_pages;
+         ++page_number) {
+      old_file.seekg(old_header_size + (page_number - 1) * Page::SIZE,
+                     std::ios::beg);
+      old_file.read(page.block_, Page::SIZE);
+      if (!old_file) {
+        throw FileIOException(filename, 0);
+      }
+      new_file.writePage(page_number, page);
+      new_file.markPage(page_number, page.isUsed());
+    }
+    FileHeader header = {MAGIC, FORMAT_VERSION, old_header.num_pages,
+                         old_header.first_used_page,
+                         old_header.num_free_pages,
+                         old_header.first_free_page};
+    new_file.writeHeader(header);
+  }
+  old_file.close();
+  if (std::rename(new_filename.c_str(), filename.c_str()) != 0) {
+    throw FileIOException(filename, errno);
+  }
+}
+
 File::File(const File& other)
   : filename_(other.filename_),
-    stream_(open_streams_[filename_]) {
+    stream_(open_streams_[filename_]),
+    fd_(open_fds_[filename_]),
+    latch_(open_latches_[filename_]),
+    state_(open_states_[filename_]) {
   ++open_counts_[filename_];
 }
 
 File& File::operator=(const File& rhs) {
   // This accounts for self-assignment and assignment of a File object for the
   // same file.
+  const IoBackend backend = rhs.backend();
+  const std::string filename = rhs.filename_;
   close();	//close my file and associate me with the new one
-  filename_ = rhs.filename_;
-  openIfNeeded(false /* create_new */);
+  filename_ = filename;
+  openIfNeeded(false /* create_new */, backend);
   return *this;
 }
 
@@ -82,59 +183,45 @@ File::~File() {
 }
 
 Page File::allocatePage() {
-  FileHeader header = readHeader();
   Page new_page;
+  allocatePage(new_page);
+  return new_page;
+}
+
+void File::allocatePage(Page& new_page) {
+  std::lock_guard<std::recursive_mutex> lock(*latch_);
+  FileHeader header = readHeader();
   Page existing_page;
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
+    readPage(header.first_free_page, true /* allow_free */, new_page);
     new_page.set_page_number(header.first_free_page);
     header.first_free_page = new_page.next_page_number();
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
-    }
-
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
   } else {
+    new_page.initialize();
     new_page.set_page_number(header.num_pages);
-    if (header.first_used_page == Page::INVALID_NUMBER) {
-      header.first_used_page = new_page.page_number();
-    } else {
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
-    }
     ++header.num_pages;
   }
+
+  // The used list is sorted by page number, so the new page goes right after
+  // the closest used page before it, which the allocation map tells us.
+  const PageId previous_page_number =
+      previousUsedPage(new_page.page_number());
+  if (previous_page_number == Page::INVALID_NUMBER) {
+    // Either have no pages used or the head of the used list is a page later
+    // than the one we just allocated, so add the new page to the head.
+    new_page.set_next_page_number(header.first_used_page);
+    header.first_used_page = new_page.page_number();
+  } else {
+    existing_page = readPage(previous_page_number, false /* allow_free */);
+    new_page.set_next_page_number(existing_page.next_page_number());
+    existing_page.set_next_page_number(new_page.page_number());
+  }
+  markPage(new_page.page_number(), true /* used */);
+
   writePage(new_page.page_number(), new_page);
   if (existing_page.page_number() != Page::INVALID_NUMBER) {
     // If we updated an existing page by inserting the new page into the
@@ -142,46 +229,183 @@ Page File::allocatePage() {
     writePage(existing_page.page_number(), existing_page);
   }
   writeHeader(header);
+}
 
-  return new_page;
+PageId File::pageLimit() const {
+  std::lock_guard<std::recursive_mutex> lock(*latch_);
+  return readHeader().num_pages;
+}
+
+std::vector<PageId> File::usedPagesAfter(const PageId page_number,
+                                         const std::uint32_t count) const {
+  std::lock_guard<std::recursive_mutex> lock(*latch_);
+  std::vector<PageId> pages;
+  PageId current = page_number;
+  while (pages.size() < count) {
+    current = nextUsedPage(current);
+    if (current == Page::INVALID_NUMBER) {
+      break;
+    }
+    pages.push_back(current);
+  }
+  return pages;
 }
 
 Page File::readPage(const PageId page_number) const {
+  Page page;
+  readPage(page_number, page);
+  return page;
+}
+
+void File::readPage(const PageId page_number, Page& page) const {
+  {
+    std::lock_guard<std::recursive_mutex> lock(*latch_);
+    FileHeader header = readHeader();
+    if (page_number >= header.num_pages || !isPageUsed(page_number)) {
+      throw InvalidPageException(page_number, filename_);
+    }
+    if (fd_ < 0) {
+      readPage(page_number, false /* allow_free */, page);
+      return;
+    }
+  }
+  // Positional reads do not share a file position, so the page itself is
+  // read without holding the latch.
+  readPage(page_number, false /* allow_free */, page);
+}
+
+void File::readPages(const PageId first, Page* const* pages,
+                     const std::size_t count) const {
+  std::unique_lock<std::recursive_mutex> lock(*latch_);
+  // All pages are checked before anything is read.
   FileHeader header = readHeader();
-  if (page_number >= header.num_pages) {
-    throw InvalidPageException(page_number, filename_);
+  for (std::size_t i = 0; i < count; ++i) {
+    const PageId page_number = first + i;
+    if (page_number >= header.num_pages || !isPageUsed(page_number)) {
+      throw InvalidPageException(page_number, filename_);
+    }
+  }
+  // Positional reads do not share a file position, so the pages themselves
+  // are read without holding the latch.
+  if (fd_ >= 0) {
+    lock.unlock();
+  }
+
+  struct iovec parts[MAX_IO_PAGES];
+  std::size_t done = 0;
+  while (done < count) {
+    // Extends the run as long as the next page follows directly on disk, as
+    // in writePages().
+    std::size_t last = done;
+    while (last + 1 < count && last + 1 - done < MAX_IO_PAGES &&
+           pagePosition(first + last + 1) ==
+               pagePosition(first + last) +
+                   static_cast<std::streamoff>(Page::SIZE)) {
+      ++last;
+    }
+    for (std::size_t i = done; i <= last; ++i) {
+      parts[i - done].iov_base = pages[i]->block_;
+      parts[i - done].iov_len = Page::SIZE;
+    }
+    readAt(pagePosition(first + done), parts, last - done + 1);
+    done = last + 1;
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    if (!pages[i]->isUsed()) {
+      throw InvalidPageException(first + i, filename_);
+    }
   }
-  return readPage(page_number, false /* allow_free */);
 }
 
 Page File::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(page.header_));
-  stream_->read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
+  readPage(page_number, allow_free, page);
+  return page;
+}
+
+void File::readPage(const PageId page_number, const bool allow_free,
+                    Page& page) const {
+  struct iovec part = {page.block_, Page::SIZE};
+  readAt(pagePosition(page_number), &part, 1);
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void File::writePage(const Page& new_page) {
-  PageHeader header = readPageHeader(new_page.page_number());
-  if (header.current_page_number == Page::INVALID_NUMBER) {
+  std::lock_guard<std::recursive_mutex> lock(*latch_);
+  const PageId page_number = new_page.page_number();
+  if (!isPageUsed(page_number)) {
     // Page has been deleted since it was read.
-    throw InvalidPageException(new_page.page_number(), filename_);
+    throw InvalidPageException(page_number, filename_);
   }
   // Page on disk may have had its next page pointer updated since it was read;
   // we don't modify that, but we do keep all the other modifications to the
-  // page header.
-  const PageId next_page_number = header.next_page_number;
-  header = new_page.header_;
-  header.next_page_number = next_page_number;
-  writePage(new_page.page_number(), header, new_page);
+  // page header.  The allocation map knows the current next page.
+  PageHeader header = *new_page.header_;
+  header.next_page_number = nextUsedPage(page_number);
+  if (verify_writes_) {
+    const PageHeader on_disk = readPageHeader(page_number);
+    assert(on_disk.current_page_number == page_number);
+    assert(on_disk.next_page_number == header.next_page_number);
+    (void) on_disk;
+  }
+  writePage(page_number, header, new_page);
+}
+
+void File::writePages(const Page* const* pages, const std::size_t count) {
+  std::lock_guard<std::recursive_mutex> lock(*latch_);
+  std::vector<const Page*> sorted(pages, pages + count);
+  std::sort(sorted.begin(), sorted.end(),
+            [](const Page* a, const Page* b) {
+              return a->page_number() < b->page_number();
+            });
+
+  // All pages are checked before anything is written, and they get their
+  // next page pointers from the allocation map, as in writePage().
+  std::vector<PageHeader> headers(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    const PageId page_number = sorted[i]->page_number();
+    if (!isPageUsed(page_number)) {
+      throw InvalidPageException(page_number, filename_);
+    }
+    headers[i] = *sorted[i]->header_;
+    headers[i].next_page_number = nextUsedPage(page_number);
+    if (verify_writes_) {
+      const PageHeader on_disk = readPageHeader(page_number);
+      assert(on_disk.current_page_number == page_number);
+      assert(on_disk.next_page_number == headers[i].next_page_number);
+      (void) on_disk;
+    }
+  }
+
+  struct iovec parts[2 * MAX_IO_PAGES];
+  std::size_t first = 0;
+  while (first < count) {
+    // Extends the run as long as the next page follows directly on disk; the
+    // map pages between groups of pages end a run.
+    std::size_t last = first;
+    const std::streampos position = pagePosition(sorted[first]->page_number());
+    while (last + 1 < count && last + 1 - first < MAX_IO_PAGES &&
+           pagePosition(sorted[last + 1]->page_number()) ==
+               pagePosition(sorted[last]->page_number()) +
+                   static_cast<std::streamoff>(Page::SIZE)) {
+      ++last;
+    }
+    int num_parts = 0;
+    for (std::size_t i = first; i <= last; ++i) {
+      parts[num_parts].iov_base = &headers[i];
+      parts[num_parts++].iov_len = sizeof(PageHeader);
+      parts[num_parts].iov_base = sorted[i]->data_;
+      parts[num_parts++].iov_len = Page::DATA_SIZE;
+    }
+    writeAt(position, parts, num_parts);
+    first = last + 1;
+  }
 }
 
 void File::deletePage(const PageId page_number) {
+  std::lock_guard<std::recursive_mutex> lock(*latch_);
   FileHeader header = readHeader();
   Page existing_page = readPage(page_number);
   Page previous_page;
@@ -190,16 +414,15 @@ void File::deletePage(const PageId page_number) {
   if (page_number == header.first_used_page) {
     header.first_used_page = existing_page.next_page_number();
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    // The used list is sorted, so the page pointing to this one is the
+    // closest used page before it, which the allocation map tells us.
+    previous_page = readPage(previousUsedPage(page_number),
+                             false /* allow_free */);
+    assert(previous_page.next_page_number() == page_number);
+    previous_page.set_next_page_number(existing_page.next_page_number());
   }
   // Clear the page and add it to the head of the free list.
+  markPage(page_number, false /* used */);
   existing_page.initialize();
   existing_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
@@ -212,6 +435,7 @@ void File::deletePage(const PageId page_number) {
 }
 
 FileIterator File::begin() {
+  std::lock_guard<std::recursive_mutex> lock(*latch_);
   const FileHeader& header = readHeader();
   return FileIterator(this, header.first_used_page);
 }
@@ -220,21 +444,28 @@ FileIterator File::end() {
   return FileIterator(this, Page::INVALID_NUMBER);
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
-  openIfNeeded(create_new);
+File::File(const std::string& name, const bool create_new,
+           const IoBackend backend)
+    : filename_(name), fd_(-1) {
+  openIfNeeded(create_new, backend);
 
   if (create_new) {
     // File starts with 1 page (the header).
-    FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
+    FileHeader header = {MAGIC, FORMAT_VERSION,
+                         1 /* num_pages */, 0 /* first_used_page */,
                          0 /* num_free_pages */, 0 /* first_free_page */};
     writeHeader(header);
+    flush();
   }
 }
 
-void File::openIfNeeded(const bool create_new) {
+void File::openIfNeeded(const bool create_new, const IoBackend backend) {
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
     stream_ = open_streams_[filename_];
+    fd_ = open_fds_[filename_];
+    latch_ = open_latches_[filename_];
+    state_ = open_states_[filename_];
   } else {
     std::ios_base::openmode mode =
         std::fstream::in | std::fstream::out | std::fstream::binary;
@@ -252,54 +483,322 @@ void File::openIfNeeded(const bool create_new) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
+    if (backend == POSITIONAL_IO) {
+      const int flags = create_new ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR;
+      fd_ = ::open(filename_.c_str(), flags, 0644);
+      if (fd_ < 0) {
+        throw FileNotFoundException(filename_);
+      }
+    } else {
+      stream_.reset(new std::fstream(filename_, mode));
+      fd_ = -1;
+    }
+    latch_.reset(new std::recursive_mutex());
+    state_.reset(new FileState());
+    state_->dirty = false;
+    state_->durability = FLUSH_EACH_WRITE;
+    if (!create_new) {
+      // The header and the allocation map are read once here; afterwards
+      // only the copies in memory are consulted.
+      struct iovec part = {&state_->header, sizeof(state_->header)};
+      readAt(0 /* pos */, &part, 1);
+      if (state_->header.magic != MAGIC ||
+          state_->header.version != FORMAT_VERSION) {
+        if (fd_ >= 0) {
+          ::close(fd_);
+        }
+        throw FileFormatException(filename_);
+      }
+      readMap();
+    }
     open_streams_[filename_] = stream_;
+    open_fds_[filename_] = fd_;
+    open_states_[filename_] = state_;
+    open_latches_[filename_] = latch_;
     open_counts_[filename_] = 1;
   }
 }
 
 void File::close() {
+  // The hooks are called without the latch, so that a hook which waits
+  // does not hold up the closing of other files.
+  std::vector<std::shared_ptr<CloseHook> > hooks;
+  {
+    std::lock_guard<std::mutex> lock(close_hooks_latch_);
+    for (std::map<int, std::shared_ptr<CloseHook> >::const_iterator it =
+             close_hooks_.begin();
+         it != close_hooks_.end(); ++it) {
+      hooks.push_back(it->second);
+    }
+  }
+  for (std::size_t i = 0; i < hooks.size(); ++i) {
+    (*hooks[i])(this);
+  }
+  if (!hooks.empty()) {
+    std::lock_guard<std::mutex> lock(close_hooks_latch_);
+    hooks.clear();
+    close_hooks_done_.notify_all();
+  }
+  if (open_counts_[filename_] == 1) {
+    flush();
+  }
   --open_counts_[filename_];
   stream_.reset();
+  fd_ = -1;
+  latch_.reset();
+  state_.reset();
   if (open_counts_[filename_] == 0) {
+    if (open_fds_[filename_] >= 0) {
+      ::close(open_fds_[filename_]);
+    }
     open_streams_.erase(filename_);
+    open_fds_.erase(filename_);
+    open_states_.erase(filename_);
+    open_latches_.erase(filename_);
     open_counts_.erase(filename_);
   }
 }
 
 void File::writePage(const PageId page_number, const Page& new_page) {
-  writePage(page_number, new_page.header_, new_page);
+  writePage(page_number, *new_page.header_, new_page);
 }
 
 void File::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(header));
-  stream_->write(reinterpret_cast<const char*>(&new_page.data_[0]),
-                 Page::DATA_SIZE);
-  stream_->flush();
+  struct iovec parts[2] = {
+      {const_cast<PageHeader*>(&header), sizeof(header)},
+      {new_page.data_, Page::DATA_SIZE}};
+  writeAt(pagePosition(page_number), parts, 2);
 }
 
 FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(header));
-
-  return header;
+  return state_->header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(header));
+  state_->header = header;
+  state_->dirty = true;
+}
+
+void File::flush() const {
+  std::lock_guard<std::recursive_mutex> lock(*latch_);
+  const std::size_t words_per_map = Page::SIZE / sizeof(std::uint64_t);
+  for (std::size_t i = 0; i < state_->dirty_maps.size(); ++i) {
+    if (state_->dirty_maps[i]) {
+      struct iovec map_part = {&state_->map[i * words_per_map], Page::SIZE};
+      writeAt(mapPosition(i), &map_part, 1);
+      state_->dirty_maps[i] = false;
+    }
+  }
+  if (state_->dirty) {
+    struct iovec part = {&state_->header, sizeof(state_->header)};
+    writeAt(0 /* pos */, &part, 1);
+    state_->dirty = false;
+  }
+  if (stream_ && state_->durability == FLUSH_ON_CHECKPOINT) {
+    stream_->flush();
+  }
+}
+
+void File::sync() const {
+  std::lock_guard<std::recursive_mutex> lock(*latch_);
+  flush();
+  if (fd_ >= 0) {
+    if (::fdatasync(fd_) != 0) {
+      throw FileIOException(filename_, errno);
+    }
+    return;
+  }
   stream_->flush();
+  // The stream does not give out its descriptor, but syncing any descriptor
+  // of the file writes out all of its data.
+  const int fd = ::open(filename_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw FileIOException(filename_, errno);
+  }
+  const int synced = ::fdatasync(fd);
+  const int error = errno;
+  ::close(fd);
+  if (synced != 0) {
+    throw FileIOException(filename_, error);
+  }
+}
+
+void File::setDurability(const Durability durability) {
+  std::lock_guard<std::recursive_mutex> lock(*latch_);
+  if (stream_) {
+    stream_->flush();
+  }
+  state_->durability = durability;
 }
 
 PageHeader File::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(header));
+  struct iovec part = {&header, sizeof(header)};
+  readAt(pagePosition(page_number), &part, 1);
 
   return header;
 }
 
+bool File::isPageUsed(const PageId page_number) const {
+  const std::size_t bit = page_number - 1;
+  return bit / 64 < state_->map.size() &&
+      (state_->map[bit / 64] >> (bit % 64) & 1) != 0;
+}
+
+void File::markPage(const PageId page_number, const bool used) {
+  const std::size_t bit = page_number - 1;
+  const std::size_t map_number = bit / PAGES_PER_MAP;
+  if (map_number >= state_->dirty_maps.size()) {
+    // The first page of a new group of pages also starts its map page.
+    state_->map.resize((map_number + 1) * Page::SIZE / sizeof(std::uint64_t));
+    state_->dirty_maps.resize(map_number + 1, true);
+  }
+  if (used) {
+    state_->map[bit / 64] |= std::uint64_t(1) << (bit % 64);
+  } else {
+    state_->map[bit / 64] &= ~(std::uint64_t(1) << (bit % 64));
+  }
+  state_->dirty_maps[map_number] = true;
+}
+
+PageId File::previousUsedPage(const PageId page_number) const {
+  if (page_number <= 1) {
+    return Page::INVALID_NUMBER;
+  }
+  // Look for the highest set bit below the one of the page, a word at a time.
+  std::size_t bit = std::min<std::size_t>(page_number - 1,
+                                          state_->map.size() * 64);
+  std::size_t word = bit / 64;
+  std::uint64_t bits = 0;
+  if (bit % 64 != 0) {
+    bits = state_->map[word] & ((std::uint64_t(1) << (bit % 64)) - 1);
+  }
+  while (bits == 0) {
+    if (word == 0) {
+      return Page::INVALID_NUMBER;
+    }
+    bits = state_->map[--word];
+  }
+  return word * 64 + (63 - __builtin_clzll(bits)) + 1;
+}
+
+PageId File::nextUsedPage(const PageId page_number) const {
+  // Look for the lowest set bit above the one of the page, a word at a time.
+  const std::size_t bit = page_number;
+  std::size_t word = bit / 64;
+  if (word >= state_->map.size()) {
+    return Page::INVALID_NUMBER;
+  }
+  std::uint64_t bits = state_->map[word] & (~std::uint64_t(0) << (bit % 64));
+  while (bits == 0) {
+    if (++word == state_->map.size()) {
+      return Page::INVALID_NUMBER;
+    }
+    bits = state_->map[word];
+  }
+  return word * 64 + __builtin_ctzll(bits) + 1;
+}
+
+void File::readMap() {
+  const std::size_t num_maps =
+      (state_->header.num_pages - 1 + PAGES_PER_MAP - 1) / PAGES_PER_MAP;
+  const std::size_t words_per_map = Page::SIZE / sizeof(std::uint64_t);
+  state_->map.assign(num_maps * words_per_map, 0);
+  state_->dirty_maps.assign(num_maps, false);
+  for (std::size_t i = 0; i < num_maps; ++i) {
+    struct iovec part = {&state_->map[i * words_per_map], Page::SIZE};
+    readAt(mapPosition(i), &part, 1);
+  }
+}
+
+void File::readAt(const std::streampos position, const struct iovec* parts,
+                  const int count) const {
+  if (fd_ < 0) {
+    stream_->seekg(position, std::ios::beg);
+    for (int i = 0; i < count; ++i) {
+      stream_->read(static_cast<char*>(parts[i].iov_base), parts[i].iov_len);
+    }
+    if (!*stream_) {
+      // The stream stays usable for the next call.
+      stream_->clear();
+      throw FileIOException(filename_, 0);
+    }
+    return;
+  }
+
+  // preadv may return fewer bytes than asked for, so continue where it
+  // stopped until everything is read or the end of the file is reached.
+  struct iovec remaining[2 * MAX_IO_PAGES];
+  assert(count <= static_cast<int>(2 * MAX_IO_PAGES));
+  std::copy(parts, parts + count, remaining);
+  int first = 0;
+  off_t offset = static_cast<std::streamoff>(position);
+  while (first < count) {
+    const ssize_t done = ::preadv(fd_, remaining + first, count - first, offset);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    // A page which is not there in full can not be told apart from garbage.
+    if (done <= 0) {
+      throw FileIOException(filename_, done < 0 ? errno : 0);
+    }
+    offset += done;
+    std::size_t left = done;
+    while (first < count && left >= remaining[first].iov_len) {
+      left -= remaining[first].iov_len;
+      ++first;
+    }
+    if (first < count) {
+      remaining[first].iov_base = static_cast<char*>(remaining[first].iov_base) + left;
+      remaining[first].iov_len -= left;
+    }
+  }
+}
+
+void File::writeAt(const std::streampos position, const struct iovec* parts,
+                   const int count) const {
+  if (fd_ < 0) {
+    stream_->seekp(position, std::ios::beg);
+    for (int i = 0; i < count; ++i) {
+      stream_->write(static_cast<const char*>(parts[i].iov_base),
+                     parts[i].iov_len);
+    }
+    if (state_->durability == FLUSH_EACH_WRITE) {
+      stream_->flush();
+    }
+    if (!*stream_) {
+      stream_->clear();
+      throw FileIOException(filename_, EIO);
+    }
+    return;
+  }
+
+  struct iovec remaining[2 * MAX_IO_PAGES];
+  assert(count <= static_cast<int>(2 * MAX_IO_PAGES));
+  std::copy(parts, parts + count, remaining);
+  int first = 0;
+  off_t offset = static_cast<std::streamoff>(position);
+  while (first < count) {
+    const ssize_t done = ::pwritev(fd_, remaining + first, count - first, offset);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    // The buffer manager keeps a page dirty only if its write throws.
+    if (done < 0) {
+      throw FileIOException(filename_, errno);
+    }
+    offset += done;
+    std::size_t left = done;
+    while (first < count && left >= remaining[first].iov_len) {
+      left -= remaining[first].iov_len;
+      ++first;
+    }
+    if (first < count) {
+      remaining[first].iov_base = static_cast<char*>(remaining[first].iov_base) + left;
+      remaining[first].iov_len -= left;
+    }
+  }
+}
+
 }
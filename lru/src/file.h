@@ -7,10 +7,16 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <cstdint>
 #include <fstream>
+#include <functional>
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/uio.h>
 
 #include "page.h"
 
@@ -22,6 +28,17 @@ class FileIterator;
  * @brief Header metadata for files on disk which contain pages.
  */
 struct FileHeader {
+  /**
+   * Identifies the file as a BadgerDB file, always File::MAGIC.
+   */
+  std::uint32_t magic;
+
+  /**
+   * Version of the on-disk format, File::FORMAT_VERSION for files this code
+   * can open.
+   */
+  std::uint32_t version;
+
   /**
    * Number of pages allocated in the file.
    */
@@ -43,13 +60,16 @@ struct FileHeader {
   PageId first_free_page;
 
   /**
-   * Returns true if this file header is equal to the other.
+   * Returns true if this file header is equal to the other, including the
+   * magic number and format version.
    *
    * @param rhs   Other file header to compare against.
    * @return  True if the other header is equal to this one.
    */
   bool operator==(const FileHeader& rhs) const {
-    return num_pages == rhs.num_pages &&
+    return magic == rhs.magic &&
+        version == rhs.version &&
+        num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
         first_free_page == rhs.first_free_page;
@@ -68,17 +88,97 @@ struct FileHeader {
  * detects this (by looking in the open_streams_ map) and just returns a file object with
  * the already created stream for the file without actually opening the UNIX file again. 
  *
- * @warning This class is not threadsafe.
+ * Reading, writing, allocating and deleting pages may be done from several
+ * threads at once: every underlying file has a latch, shared by all File
+ * objects referring to it, which serializes the accesses to its stream.
+ *
+ * The I/O itself is done either through the shared stream (STREAM_IO) or
+ * through a raw file descriptor with positional reads and writes
+ * (POSITIONAL_IO), which have no shared file position and no iostream
+ * buffer in between.  With POSITIONAL_IO the contents of pages are read
+ * without holding the latch, so reads of different pages run in parallel.
+ * The backend is chosen when the file is created or opened; File objects
+ * for a file that is already open share its backend.
+ *
+ * Besides the header and the pages, the file holds an allocation map: a
+ * bitmap with one bit per page, set if the page is used.  The map is split
+ * into map pages of Page::SIZE bytes, each covering the PAGES_PER_MAP pages
+ * stored right after it.  Map pages have no page number of their own.  The
+ * map is kept in memory while the file is open and lets allocatePage() and
+ * deletePage() find the neighbour of a page in the list of used pages
+ * without walking the list.
+ * Files written in the earlier format without a map have to be converted
+ * with migrate() before they can be opened.
+ *
+ * @warning Creating, opening, copying and closing File objects is not threadsafe.
  */
 class File {
  public:
+  /**
+   * Version of the on-disk format written by this code.  Version 1 files
+   * have no allocation map and no magic number in their header.
+   */
+  static const std::uint32_t FORMAT_VERSION = 2;
+
+  /**
+   * Largest number of pages writePages() writes or readPages() reads with a
+   * single call.
+   */
+  static const std::size_t MAX_IO_PAGES = 128;
+
+  /**
+   * Ways of doing I/O on the underlying file.
+   */
+  enum IoBackend {
+    /**
+     * Shared std::fstream, positioned with seekg/seekp before every access.
+     */
+    STREAM_IO,
+
+    /**
+     * File descriptor accessed with pread/pwrite at the position of the page.
+     */
+    POSITIONAL_IO
+  };
+
+  /**
+   * When the pages and the header written to a file are handed to the
+   * operating system and forced to disk.
+   */
+  enum Durability {
+    /**
+     * Every write is handed to the operating system right away.
+     */
+    FLUSH_EACH_WRITE,
+
+    /**
+     * Writes are buffered until the next flush(), which BufMgr::flushFile()
+     * calls, or until the file is closed.
+     */
+    FLUSH_ON_CHECKPOINT,
+
+    /**
+     * Writes are buffered until the next sync(), which also forces them to
+     * disk, or until the file is closed.
+     */
+    SYNC_ON_REQUEST
+  };
+
+  /**
+   * Function called with every File object that is about to be closed, see
+   * addCloseHook().
+   */
+  typedef std::function<void(const File*)> CloseHook;
+
   /**
    * Creates a new file.
    *
    * @param filename  Name of the file.
+   * @param backend   How to do I/O on the file.
    * @throws  FileExistsException     If the requested file already exists.
    */
-  static File create(const std::string& filename);
+  static File create(const std::string& filename,
+                     const IoBackend backend = STREAM_IO);
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
@@ -88,9 +188,11 @@ class File {
 	 * open_streams_ map.
    *
    * @param filename  Name of the file.
+   * @param backend   How to do I/O on the file, ignored if it is already open.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
    */
-  static File open(const std::string& filename);
+  static File open(const std::string& filename,
+                   const IoBackend backend = STREAM_IO);
 
   /**
    * Deletes an existing file.
@@ -116,6 +218,49 @@ class File {
    */
   static bool exists(const std::string& filename);
 
+  /**
+   * Converts a file written in an earlier on-disk format to the current
+   * one, keeping all of its pages and their numbers.  Files which are
+   * already in the current format are left alone.
+   *
+   * @param filename  Name of the file.
+   * @throws  FileNotFoundException   If the file doesn't exist.
+   * @throws  FileOpenException       If the file is currently open.
+   * @throws  FileIOException         If the file can not be read in full or
+   *                                  the converted file can not replace it.
+   */
+  static void migrate(const std::string& filename);
+
+  /**
+   * Turns checking of page writes on or off for all files.  When on,
+   * writePage() reads the header of the page from disk before writing it
+   * and asserts that it agrees with the allocation map.  This is meant for
+   * debugging, since it costs a read for every write; it is off by default
+   * and should only be changed while no files are being written.
+   *
+   * @param verify  Whether to check page writes.
+   */
+  static void setVerifyWrites(const bool verify) { verify_writes_ = verify; }
+
+  /**
+   * Registers a function which is called whenever a File object is closed,
+   * by its destructor or by assigning another file to it, before it lets go
+   * of the underlying file.  This lets a user that keeps pointers to File
+   * objects, like the buffer manager, stop using them in time.
+   *
+   * @param hook  Function to call with the File object being closed.
+   * @return      Handle to pass to removeCloseHook().
+   */
+  static int addCloseHook(const CloseHook& hook);
+
+  /**
+   * Unregisters a function registered with addCloseHook().  It is not called
+   * anymore once this returns; calls already under way are waited for.
+   *
+   * @param handle  Handle returned by addCloseHook().
+   */
+  static void removeCloseHook(const int handle);
+
   /**
    * Copy constructor.
    * 
@@ -145,6 +290,34 @@ class File {
    */
   Page allocatePage();
 
+  /**
+   * Allocates a new page in the file and builds it in the given page, which
+   * may be a view of a buffer frame, instead of in a new one.
+   *
+   * @param new_page  Page whose contents become the new page.
+   */
+  void allocatePage(Page& new_page);
+
+  /**
+   * Returns the page number the next page appended to the file will get.
+   * Every page of the file, used or free, has a lower number.
+   *
+   * @return  One past the highest page number in the file.
+   */
+  PageId pageLimit() const;
+
+  /**
+   * Returns the used pages which follow the given page in the list of used
+   * pages, the ones a scan reaches by following next page numbers from it.
+   * They are looked up in the allocation map, without reading any page.
+   *
+   * @param page_number   Number of page to start after.
+   * @param count         Largest number of pages to return.
+   * @return  Numbers of the pages, in the order of the list.
+   */
+  std::vector<PageId> usedPagesAfter(const PageId page_number,
+                                     const std::uint32_t count) const;
+
   /**
    * Reads an existing page from the file.
    *
@@ -155,15 +328,62 @@ class File {
    */
   Page readPage(const PageId page_number) const;
 
+  /**
+   * Reads an existing page from the file into the given page, replacing its
+   * contents.  The bytes of the page are read straight into the memory of
+   * <page>, without going through a temporary Page object.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPage(const PageId page_number, Page& page) const;
+
+  /**
+   * Reads consecutive pages from the file into the given pages, like
+   * readPage(page_number, page) does for each of them.  Pages which are next
+   * to each other on disk are read together, with one vectored read of up to
+   * MAX_IO_PAGES pages.
+   *
+   * @param first   Number of the first page to read.
+   * @param pages   Pages to read into, the i-th one gets page first + i.
+   * @param count   Number of pages.
+   * @throws  InvalidPageException  If one of the pages doesn't exist in the
+   *                                file or is not currently used.  Nothing
+   *                                is read then.
+   */
+  void readPages(const PageId first, Page* const* pages,
+                 const std::size_t count) const;
+
   /**
    * Writes a page into the file, replacing any existing contents.  The page
    * must have been already allocated in this file by a call to allocatePage().
    *
+   * The next page pointer of the page may be out of date, since allocating
+   * and deleting pages changes it on disk only.  It is replaced by the next
+   * used page from the allocation map, so the page is written without
+   * reading anything from disk first.
+   *
    * @see allocatePage()
    * @param new_page  Page to write.
+   * @throws  InvalidPageException  If the page is not currently used.
    */
   void writePage(const Page& new_page);
 
+  /**
+   * Writes several pages into the file, like writePage() does for each of
+   * them.  The pages are written in the order of their page numbers, and
+   * pages which are next to each other on disk are written together, with
+   * one vectored write of up to MAX_IO_PAGES pages.
+   *
+   * @param pages   Pages to write, in any order.
+   * @param count   Number of pages.
+   * @throws  InvalidPageException  If one of the pages is not currently used.
+   *                                Nothing is written then.
+   */
+  void writePages(const Page* const* pages, const std::size_t count);
+
   /**
    * Deletes a page from the file.
    *
@@ -171,6 +391,43 @@ class File {
    */
   void deletePage(const PageId page_number);
 
+  /**
+   * Writes the file header and the allocation map back to disk if they were
+   * changed since they were last written.  Allocating and deleting pages only
+   * update the copies kept in memory; they are written back here and when
+   * the last File object for the file is closed.
+   */
+  void flush() const;
+
+  /**
+   * Writes out everything written to the file so far, including the header
+   * and the allocation map, and waits until it is on disk (fdatasync).
+   * Works in every durability mode.
+   *
+   * @throws  FileIOException  If the data could not be written out.
+   */
+  void sync() const;
+
+  /**
+   * Sets when writes to the file are handed to the operating system.  The
+   * setting is shared by all File objects for the file and lasts until it
+   * is closed; files start out with FLUSH_EACH_WRITE.  Buffered writes are
+   * handed over before the setting changes.
+   *
+   * With POSITIONAL_IO writes are never buffered, so FLUSH_EACH_WRITE and
+   * FLUSH_ON_CHECKPOINT behave the same.
+   *
+   * @param durability  When to hand writes to the operating system.
+   */
+  void setDurability(const Durability durability);
+
+  /**
+   * Returns when writes to the file are handed to the operating system.
+   *
+   * @return  Durability mode of the file.
+   */
+  Durability durability() const { return state_->durability; }
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -178,6 +435,13 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Returns how I/O is done on the file.
+   *
+   * @return I/O backend of the file.
+   */
+  IoBackend backend() const { return fd_ < 0 ? STREAM_IO : POSITIONAL_IO; }
+
   /**
    * Returns an iterator at the first page in the file.
    *
@@ -202,9 +466,64 @@ class File {
    * @return  Position of page in file.
    */
   static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+    const std::size_t map_pages = (page_number - 1) / PAGES_PER_MAP + 1;
+    return sizeof(FileHeader) +
+        (page_number - 1 + map_pages) * Page::SIZE;
+  }
+
+  /**
+   * Returns the position of the given map page in the file.  Map page
+   * <map_number> covers pages map_number * PAGES_PER_MAP + 1 onwards.
+   *
+   * @param map_number    Number of map page, starting at 0.
+   * @return  Position of map page in file.
+   */
+  static std::streampos mapPosition(const std::size_t map_number) {
+    return sizeof(FileHeader) +
+        map_number * (PAGES_PER_MAP + 1) * Page::SIZE;
   }
 
+  /**
+   * Returns whether the given page is marked as used in the allocation map.
+   *
+   * @param page_number   Number of page.
+   * @return  True if the page is used.
+   */
+  bool isPageUsed(const PageId page_number) const;
+
+  /**
+   * Marks the given page as used or free in the allocation map kept in
+   * memory.  The map page is written back by flush().
+   *
+   * @param page_number   Number of page.
+   * @param used          Whether the page is used.
+   */
+  void markPage(const PageId page_number, const bool used);
+
+  /**
+   * Returns the used page with the highest number below the given page,
+   * looked up in the allocation map.
+   *
+   * @param page_number   Number of page.
+   * @return  Number of the used page, Page::INVALID_NUMBER if there is none.
+   */
+  PageId previousUsedPage(const PageId page_number) const;
+
+  /**
+   * Returns the used page with the lowest number above the given page,
+   * looked up in the allocation map.  Since the list of used pages is
+   * sorted, this is the page the given page points to.
+   *
+   * @param page_number   Number of page.
+   * @return  Number of the used page, Page::INVALID_NUMBER if there is none.
+   */
+  PageId nextUsedPage(const PageId page_number) const;
+
+  /**
+   * Reads the allocation map of the file from disk into memory.
+   */
+  void readMap();
+
   /**
    * Constructs a file object representing a file on the filesystem.
    * This method should not be called directly; instead use the static methods
@@ -214,12 +533,14 @@ class File {
    * @see File::open()
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param backend     How to do I/O on the file.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  File(const std::string& name, const bool create_new);
+  File(const std::string& name, const bool create_new,
+       const IoBackend backend);
 
   /**
    * Opens the underlying file named in filename_.
@@ -227,12 +548,13 @@ class File {
    * the same filesystem file; otherwise, it reuses the existing stream.
    *
    * @param create_new  Whether to create a new file.
+   * @param backend     How to do I/O on the file, if it has to be opened.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  void openIfNeeded(const bool create_new);
+  void openIfNeeded(const bool create_new, const IoBackend backend);
 
   /**
    * Closes the underlying file stream in <stream_>.
@@ -256,6 +578,19 @@ class File {
    */
   Page readPage(const PageId page_number, const bool allow_free) const;
 
+  /**
+   * Reads a page from the file into the given page.  Works like
+   * readPage(page_number, allow_free), but without creating a new Page.
+   *
+   * @param page_number   Number of page to read.
+   * @param allow_free    Whether to allow reading a free (unused) page.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page is free (unused) and
+   *                                allow_free is false.
+   */
+  void readPage(const PageId page_number, const bool allow_free,
+                Page& page) const;
+
   /**
    * Writes a page into the file at the given page number.  This does not
    * update ensure that the number in the header equals the position on disk.
@@ -279,14 +614,15 @@ class File {
                  const Page& new_page);
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file, from the copy kept in memory.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Replaces the header for this file.  Only the copy kept in memory is
+   * updated; it is written to disk by flush().
    *
    * @param header  File header to write.
    */
@@ -301,8 +637,80 @@ class File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Reads consecutive bytes of the file at the given position into the given
+   * buffers, through the backend of the file.
+   *
+   * @param position  Offset from the beginning of the file.
+   * @param parts     Buffers to fill, in order.
+   * @param count     Number of buffers, at most 2 * MAX_IO_PAGES.
+   * @throws  FileIOException  If the read fails or reaches the end of the
+   *                           file before all buffers are filled.
+   */
+  void readAt(const std::streampos position, const struct iovec* parts,
+              const int count) const;
+
+  /**
+   * Writes the given buffers to consecutive bytes of the file at the given
+   * position, through the backend of the file.
+   *
+   * @param position  Offset from the beginning of the file.
+   * @param parts     Buffers to write, in order.
+   * @param count     Number of buffers, at most 2 * MAX_IO_PAGES.
+   * @throws  FileIOException  If the write fails.
+   */
+  void writeAt(const std::streampos position, const struct iovec* parts,
+               const int count) const;
+
+  /**
+   * Value of FileHeader::magic, the bytes "BDBF" on disk.
+   */
+  static const std::uint32_t MAGIC = 0x46424442;
+
+  /**
+   * Number of pages covered by one map page, one bit each.
+   */
+  static const PageId PAGES_PER_MAP = Page::SIZE * 8;
+
+  /**
+   * File header, allocation map and settings kept in memory, shared by all
+   * File objects for a file.
+   */
+  struct FileState {
+    /**
+     * Current header of the file.
+     */
+    FileHeader header;
+
+    /**
+     * True if header differs from the header on disk.
+     */
+    bool dirty;
+
+    /**
+     * Allocation map, bit page_number - 1 set if the page is used.  Holds
+     * Page::SIZE bytes for every map page of the file.
+     */
+    std::vector<std::uint64_t> map;
+
+    /**
+     * True for every map page which differs from the one on disk.
+     */
+    std::vector<bool> dirty_maps;
+
+    /**
+     * When writes are handed to the operating system.
+     */
+    Durability durability;
+  };
+
   typedef std::map<std::string,
                    std::shared_ptr<std::fstream> > StreamMap;
+  typedef std::map<std::string,
+                   std::shared_ptr<std::recursive_mutex> > LatchMap;
+  typedef std::map<std::string, int> DescriptorMap;
+  typedef std::map<std::string,
+                   std::shared_ptr<FileState> > StateMap;
   typedef std::map<std::string, int> CountMap;
 
   /**
@@ -310,11 +718,53 @@ class File {
    */
   static StreamMap open_streams_;
 
+  /**
+   * Latches for opened files.
+   */
+  static LatchMap open_latches_;
+
+  /**
+   * File descriptors for opened files, -1 for files using STREAM_IO.
+   */
+  static DescriptorMap open_fds_;
+
+  /**
+   * Headers, allocation maps and settings of opened files.
+   */
+  static StateMap open_states_;
+
+  /**
+   * Whether writePage() checks the page header on disk, see setVerifyWrites().
+   */
+  static bool verify_writes_;
+
   /**
    * Counts for opened files.
    */
   static CountMap open_counts_;
 
+  /**
+   * Functions registered with addCloseHook(), by handle.  close() holds a
+   * reference to every function while it calls it.
+   */
+  static std::map<int, std::shared_ptr<CloseHook> > close_hooks_;
+
+  /**
+   * Handle the next function registered with addCloseHook() gets.
+   */
+  static int next_close_hook_;
+
+  /**
+   * Latch protecting close_hooks_ and next_close_hook_.  It is not held
+   * while the hooks are called, since a hook may wait for I/O.
+   */
+  static std::mutex close_hooks_latch_;
+
+  /**
+   * Signalled when close() is done calling the hooks, for removeCloseHook().
+   */
+  static std::condition_variable close_hooks_done_;
+
   /**
    * Name of the file this object represents.
    */
@@ -325,6 +775,24 @@ class File {
    */
   std::shared_ptr<std::fstream> stream_;
 
+  /**
+   * File descriptor for underlying filesystem object if the file uses
+   * POSITIONAL_IO, -1 otherwise.
+   */
+  int fd_;
+
+  /**
+   * Latch serializing accesses to stream_.  It is recursive because
+   * deletePage() reads the page it deletes through readPage().
+   */
+  std::shared_ptr<std::recursive_mutex> latch_;
+
+  /**
+   * Header, allocation map and settings of the underlying file, protected by
+   * latch_.
+   */
+  std::shared_ptr<FileState> state_;
+
   friend class FileIterator;
   friend class FileTest;
 };
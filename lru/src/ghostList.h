@@ -0,0 +1,147 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+* @brief Identifies a page of a file independently of any frame
+*/
+struct PageKey {
+	/**
+	 * File object
+	 */
+  const File *file;
+
+	/**
+	 * Page number within the file
+	 */
+  PageId pageNo;
+
+  bool operator==(const PageKey& other) const
+  {
+    return file == other.file && pageNo == other.pageNo;
+  }
+};
+
+
+/**
+* @brief Hash of a PageKey, mixing the file pointer and the page number like BufHashTbl does
+*/
+struct PageKeyHash {
+  std::size_t operator()(const PageKey& key) const
+  {
+    std::uint64_t h = (std::uint64_t) (std::uintptr_t) key.file;
+    h ^= (std::uint64_t) key.pageNo * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return (std::size_t) h;
+  }
+};
+
+
+/**
+* @brief List of pages which are no longer in the buffer pool, oldest first
+*
+* Replacement policies use it to remember pages they replaced, so that a page read again soon after can be told
+* apart from one read for the first time. Pages can be looked up, appended and removed in constant time. Every
+* entry carries a value of type T.
+*
+* @warning This class is not threadsafe.
+*/
+template <typename T>
+class GhostList
+{
+ private:
+	/**
+	 * Entries, oldest first
+	 */
+  std::list<std::pair<PageKey, T> > entries;
+
+	/**
+	 * Position of every page in entries
+	 */
+  std::unordered_map<PageKey, typename std::list<std::pair<PageKey, T> >::iterator, PageKeyHash> index;
+
+ public:
+	/**
+	 * Number of pages in the list
+	 */
+  std::size_t size() const
+  {
+    return index.size();
+  }
+
+	/**
+	 * Look a page up.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			Pointer to the value of the page, NULL if it is not in the list.
+	 */
+  T* find(const File* file, const PageId pageNo)
+  {
+    PageKey key = {file, pageNo};
+    typename std::unordered_map<PageKey, typename std::list<std::pair<PageKey, T> >::iterator, PageKeyHash>::iterator
+        entry = index.find(key);
+    return entry == index.end() ? NULL : &entry->second->second;
+  }
+
+	/**
+	 * Append a page as the newest entry, dropping the entry it had before.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param value  	Value kept with the page
+	 */
+  void pushBack(const File* file, const PageId pageNo, const T& value)
+  {
+    erase(file, pageNo);
+    PageKey key = {file, pageNo};
+    entries.push_back(std::make_pair(key, value));
+    index.insert(std::make_pair(key, --entries.end()));
+  }
+
+	/**
+	 * Remove a page from the list.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			False if the page was not in the list.
+	 */
+  bool erase(const File* file, const PageId pageNo)
+  {
+    PageKey key = {file, pageNo};
+    typename std::unordered_map<PageKey, typename std::list<std::pair<PageKey, T> >::iterator, PageKeyHash>::iterator
+        entry = index.find(key);
+    if (entry == index.end())
+      return false;
+    entries.erase(entry->second);
+    index.erase(entry);
+    return true;
+  }
+
+	/**
+	 * Remove the oldest page from the list, which must not be empty.
+	 */
+  void popFront()
+  {
+    index.erase(entries.front().first);
+    entries.pop_front();
+  }
+};
+
+}
@@ -6,6 +6,8 @@
  */
 
 #include <cassert>
+#include <cstring>
+#include <utility>
 
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_record_exception.h"
@@ -16,18 +18,75 @@
 
 namespace badgerdb {
 
-Page::Page() {
+Page::Page() : block_(new char[SIZE]), owned_(true) {
+  attach();
   initialize();
 }
 
+Page::Page(char* block) : block_(block), owned_(false) {
+  attach();
+}
+
+Page::Page(const Page& other) : block_(new char[SIZE]), owned_(true) {
+  attach();
+  std::memcpy(block_, other.block_, SIZE);
+}
+
+Page::Page(Page&& other) : block_(other.block_), owned_(other.owned_) {
+  if (owned_) {
+    other.block_ = NULL;
+    other.owned_ = false;
+    other.attach();
+  } else if (block_ != NULL) {
+    // A view stays with its frame; this page gets a copy of the contents.
+    block_ = new char[SIZE];
+    owned_ = true;
+    std::memcpy(block_, other.block_, SIZE);
+  }
+  attach();
+}
+
+Page& Page::operator=(const Page& rhs) {
+  if (this != &rhs) {
+    if (block_ == NULL) {
+      block_ = new char[SIZE];
+      owned_ = true;
+      attach();
+    }
+    std::memcpy(block_, rhs.block_, SIZE);
+  }
+  return *this;
+}
+
+Page& Page::operator=(Page&& rhs) {
+  if (owned_ && rhs.owned_) {
+    std::swap(block_, rhs.block_);
+    attach();
+    rhs.attach();
+    return *this;
+  }
+  return *this = static_cast<const Page&>(rhs);
+}
+
+Page::~Page() {
+  if (owned_) {
+    delete[] block_;
+  }
+}
+
+void Page::attach() {
+  header_ = reinterpret_cast<PageHeader*>(block_);
+  data_ = block_ == NULL ? NULL : block_ + sizeof(PageHeader);
+}
+
 void Page::initialize() {
-  header_.free_space_lower_bound = 0;
-  header_.free_space_upper_bound = DATA_SIZE;
-  header_.num_slots = 0;
-  header_.num_free_slots = 0;
-  header_.current_page_number = INVALID_NUMBER;
-  header_.next_page_number = INVALID_NUMBER;
-  data_.assign(DATA_SIZE, char());
+  header_->free_space_lower_bound = 0;
+  header_->free_space_upper_bound = DATA_SIZE;
+  header_->num_slots = 0;
+  header_->num_free_slots = 0;
+  header_->current_page_number = INVALID_NUMBER;
+  header_->next_page_number = INVALID_NUMBER;
+  std::memset(data_, 0, DATA_SIZE);
 }
 
 RecordId Page::insertRecord(const std::string& record_data) {
@@ -43,7 +102,7 @@ RecordId Page::insertRecord(const std::string& record_data) {
 std::string Page::getRecord(const RecordId& record_id) const {
   validateRecordId(record_id);
   const PageSlot& slot = getSlot(record_id.slot_number);
-  return data_.substr(slot.item_offset, slot.item_length);
+  return std::string(data_ + slot.item_offset, slot.item_length);
 }
 
 void Page::updateRecord(const RecordId& record_id,
@@ -71,12 +130,12 @@ void Page::deleteRecord(const RecordId& record_id,
                         const bool allow_slot_compaction) {
   validateRecordId(record_id);
   PageSlot* slot = getSlot(record_id.slot_number);
-  data_.replace(slot->item_offset, slot->item_length, slot->item_length, '\0');
+  std::memset(data_ + slot->item_offset, 0, slot->item_length);
 
   // Compact the data by removing the hole left by this record (if necessary).
   std::uint16_t move_offset = slot->item_offset; 
   std::size_t move_bytes = 0;
-  for (SlotId i = 1; i <= header_.num_slots; ++i) {
+  for (SlotId i = 1; i <= header_->num_slots; ++i) {
     PageSlot* other_slot = getSlot(i);
     if (other_slot->used && other_slot->item_offset < slot->item_offset) {
       if (other_slot->item_offset < move_offset) {
@@ -90,24 +149,24 @@ void Page::deleteRecord(const RecordId& record_id,
   }
   // If we have data to move, shift it to the right.
   if (move_bytes > 0) {
-    const std::string& data_to_move = data_.substr(move_offset, move_bytes);
-    data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
+    std::memmove(data_ + move_offset + slot->item_length, data_ + move_offset,
+                 move_bytes);
   }
-  header_.free_space_upper_bound += slot->item_length;
+  header_->free_space_upper_bound += slot->item_length;
 
   // Mark slot as unused.
   slot->used = false;
   slot->item_offset = 0;
   slot->item_length = 0;
-  ++header_.num_free_slots;
+  ++header_->num_free_slots;
 
-  if (allow_slot_compaction && record_id.slot_number == header_.num_slots) {
+  if (allow_slot_compaction && record_id.slot_number == header_->num_slots) {
     // Last slot in the list, so we need to free any unused slots that are at
     // the end of the slot list.
     int num_slots_to_delete = 1;
-    for (SlotId i = 1; i < header_.num_slots; ++i) {
+    for (SlotId i = 1; i < header_->num_slots; ++i) {
       // Traverse list backwards, looking for unused slots.
-      const PageSlot* other_slot = getSlot(header_.num_slots - i);
+      const PageSlot* other_slot = getSlot(header_->num_slots - i);
       if (!other_slot->used) {
         ++num_slots_to_delete;
       } else {
@@ -116,15 +175,15 @@ void Page::deleteRecord(const RecordId& record_id,
         break;
       }
     }
-    header_.num_slots -= num_slots_to_delete;
-    header_.num_free_slots -= num_slots_to_delete;
-    header_.free_space_lower_bound -= sizeof(PageSlot) * num_slots_to_delete;
+    header_->num_slots -= num_slots_to_delete;
+    header_->num_free_slots -= num_slots_to_delete;
+    header_->free_space_lower_bound -= sizeof(PageSlot) * num_slots_to_delete;
   }
 }
 
 bool Page::hasSpaceForRecord(const std::string& record_data) const {
   std::size_t record_size = record_data.length();
-  if (header_.num_free_slots == 0) {
+  if (header_->num_free_slots == 0) {
     record_size += sizeof(PageSlot);
   }
   return record_size <= getFreeSpace();
@@ -142,9 +201,9 @@ const PageSlot& Page::getSlot(const SlotId slot_number) const {
 
 SlotId Page::getAvailableSlot() {
   SlotId slot_number = INVALID_SLOT;
-  if (header_.num_free_slots > 0) {
+  if (header_->num_free_slots > 0) {
     // Have an allocated but unused slot that we can reuse.
-    for (SlotId i = 1; i <= header_.num_slots; ++i) {
+    for (SlotId i = 1; i <= header_->num_slots; ++i) {
       const PageSlot* slot = getSlot(i);
       if (!slot->used) {
         // We don't decrement the number of free slots until someone actually
@@ -155,10 +214,10 @@ SlotId Page::getAvailableSlot() {
     }
   } else {
     // Have to allocate a new slot.
-    slot_number = header_.num_slots + 1;
-    ++header_.num_slots;
-    ++header_.num_free_slots;
-    header_.free_space_lower_bound = sizeof(PageSlot) * header_.num_slots;
+    slot_number = header_->num_slots + 1;
+    ++header_->num_slots;
+    ++header_->num_free_slots;
+    header_->free_space_lower_bound = sizeof(PageSlot) * header_->num_slots;
   }
   assert(slot_number != INVALID_SLOT);
   return static_cast<SlotId>(slot_number);
@@ -166,7 +225,7 @@ SlotId Page::getAvailableSlot() {
 
 void Page::insertRecordInSlot(const SlotId slot_number,
                               const std::string& record_data) {
-  if (slot_number > header_.num_slots ||
+  if (slot_number > header_->num_slots ||
       slot_number == INVALID_SLOT) {
     throw InvalidSlotException(page_number(), slot_number);
   }
@@ -177,10 +236,11 @@ void Page::insertRecordInSlot(const SlotId slot_number,
   const int record_length = record_data.length();
   slot->used = true;
   slot->item_length = record_length;
-  slot->item_offset = header_.free_space_upper_bound - record_length;
-  header_.free_space_upper_bound = slot->item_offset;
-  --header_.num_free_slots;
-  data_.replace(slot->item_offset, slot->item_length, record_data);
+  slot->item_offset = header_->free_space_upper_bound - record_length;
+  header_->free_space_upper_bound = slot->item_offset;
+  --header_->num_free_slots;
+  std::memcpy(data_ + slot->item_offset, record_data.data(),
+              slot->item_length);
 }
 
 void Page::validateRecordId(const RecordId& record_id) const {
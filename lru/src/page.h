@@ -102,6 +102,12 @@ class PageIterator;
  * slots and identified by a RecordId.  Although a record's actual contents may
  * be moved on the page, accessing a record by its slot is consistent.
  *
+ * The header and data of a page are stored in one block of SIZE bytes, laid
+ * out like the page on disk.  A page normally owns its block.  The buffer
+ * manager instead creates pages which are views over its frames; assigning
+ * to such a page copies the contents into the frame, and copying it gives a
+ * page with its own block.
+ *
  * @warning This class is not threadsafe.
  */
 class Page {
@@ -132,6 +138,43 @@ class Page {
    */
   Page();
 
+  /**
+   * Constructs a page with its own copy of the contents of another page.
+   *
+   * @param other   Page to copy.
+   */
+  Page(const Page& other);
+
+  /**
+   * Constructs a page from another page, taking over its block if it owns
+   * one.  The other page may only be assigned to or destroyed afterwards.
+   *
+   * @param other   Page to move.
+   */
+  Page(Page&& other);
+
+  /**
+   * Replaces the contents of this page with those of another page.
+   *
+   * @param rhs   Page to copy.
+   * @return  This page.
+   */
+  Page& operator=(const Page& rhs);
+
+  /**
+   * Replaces the contents of this page with those of another page, taking
+   * over its block if both pages own one.
+   *
+   * @param rhs   Page to move.
+   * @return  This page.
+   */
+  Page& operator=(Page&& rhs);
+
+  /**
+   * Frees the block of the page if the page owns it.
+   */
+  ~Page();
+
   /**
    * Inserts a new record into the page.
    *
@@ -182,22 +225,22 @@ class Page {
    *
    * @return  Free space in bytes.
    */
-  std::uint16_t getFreeSpace() const { return header_.free_space_upper_bound -
-                                              header_.free_space_lower_bound; }
+  std::uint16_t getFreeSpace() const { return header_->free_space_upper_bound -
+                                              header_->free_space_lower_bound; }
 
   /**
    * Returns this page's number in its file.
    *
    * @return  Page number.
    */
-  PageId page_number() const { return header_.current_page_number; }
+  PageId page_number() const { return header_->current_page_number; }
 
   /**
    * Returns the number of the next used page this page in its file.
    *
    * @return  Page number of next used page in file.
    */
-  PageId next_page_number() const { return header_.next_page_number; }
+  PageId next_page_number() const { return header_->next_page_number; }
 
   /**
    * Returns an iterator at the first record in the page.
@@ -215,6 +258,19 @@ class Page {
   PageIterator end();
 
  private:
+  /**
+   * Constructs a page which is a view over the given block of SIZE bytes,
+   * without initializing it.  The block stays owned by the caller.
+   *
+   * @param block   Memory holding the page.
+   */
+  explicit Page(char* block);
+
+  /**
+   * Points header_ and data_ into the block of the page.
+   */
+  void attach();
+
   /**
    * Initializes this page as a new page with no header information or data.
    */
@@ -226,7 +282,7 @@ class Page {
    * @param page_number   Number of page in file.
    */
   void set_page_number(const PageId new_page_number) {
-    header_.current_page_number = new_page_number;
+    header_->current_page_number = new_page_number;
   }
 
   /**
@@ -235,7 +291,7 @@ class Page {
    * @param next_page_number  Page number of next used page in file.
    */
   void set_next_page_number(const PageId new_next_page_number) {
-    header_.next_page_number = new_next_page_number;
+    header_->next_page_number = new_next_page_number;
   }
 
   /**
@@ -321,21 +377,32 @@ class Page {
   bool isUsed() const { return page_number() != INVALID_NUMBER; }
 
   /**
-   * Header metadata.
+   * Block of SIZE bytes holding the header followed by the data, NULL if the
+   * page was moved from.
+   */
+  char* block_;
+
+  /**
+   * Whether the page owns block_ and has to free it.
    */
-  PageHeader header_;
+  bool owned_;
 
   /**
-   * Data stored on the page.  Includes bookkeeping information about slots as
-   * well as actual content.
+   * Header metadata, at the beginning of block_.
    */
+  PageHeader* header_;
 
-  std::string data_;
+  /**
+   * Data stored on the page, DATA_SIZE bytes following the header.  Includes
+   * bookkeeping information about slots as well as actual content.
+   */
+  char* data_;
 
   friend class File;
   friend class PageIterator;
   friend class PageTest;
   friend class BufferTest;
+  friend class BufMgr;
 };
 
 static_assert(Page::SIZE > sizeof(PageHeader),
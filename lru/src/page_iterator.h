@@ -110,7 +110,7 @@ class PageIterator {
    */
   SlotId getNextUsedSlot(const SlotId start) const {
     SlotId slot_number = Page::INVALID_SLOT;
-    for (SlotId i = start + 1; i <= page_->header_.num_slots; ++i) {
+    for (SlotId i = start + 1; i <= page_->header_->num_slots; ++i) {
       const PageSlot* slot = page_->getSlot(i);
       if (slot->used) {
         slot_number = i;